@@ -0,0 +1,414 @@
+#include "AnkiImport.hpp"
+#include "Metrics.hpp"
+#include "SM2Scheduler.hpp"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <unistd.h>
+#include <unordered_set>
+#include <vector>
+
+#ifdef TANKI_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef TANKI_HAVE_SQLITE
+#include <sqlite3.h>
+#endif
+
+static const size_t CHUNK_BYTES = 64 * 1024;
+
+static uint32_t le16(const unsigned char *p) { return p[0] | (p[1] << 8); }
+
+static uint32_t le32(const unsigned char *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool AnkiImport::available() {
+#if defined(TANKI_HAVE_ZLIB) && defined(TANKI_HAVE_SQLITE)
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool AnkiImport::isPackage(const std::string &path) {
+  std::string ext = std::filesystem::path(path).extension().string();
+  std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+  return ext == ".apkg" || ext == ".colpkg";
+}
+
+bool AnkiImport::import(Deck &deck, const std::string &path,
+                        const Options &options, Result &result) {
+  result = Result();
+  if (!available()) {
+    result.error = "Anki import needs zlib and SQLite";
+    return false;
+  }
+  std::error_code ec;
+  std::string tmp = (std::filesystem::temp_directory_path(ec) /
+                     ("tanki-anki-" + std::to_string(getpid()) + ".db"))
+                        .string();
+  auto start = std::chrono::steady_clock::now();
+  bool ok = extractCollection(path, tmp, result.error) &&
+            readCollection(deck, tmp, options, result);
+  std::remove(tmp.c_str());
+
+  // card and review log rows alike
+  static auto &rowCount = Metrics::counter("tanki_import_rows_total",
+                                           "Rows read by CSV and Anki imports");
+  static auto &rowRate = Metrics::gauge("tanki_import_rows_per_second",
+                                        "Row rate of the last import");
+  size_t rows = result.cards + result.reviews + result.skipped;
+  std::chrono::duration<double> took =
+      std::chrono::steady_clock::now() - start;
+  rowCount.add(rows);
+  if (ok)
+    rowRate.set(rows / std::max(took.count(), 1e-6));
+  return ok;
+}
+
+std::string AnkiImport::plainText(std::string_view html) {
+  static const std::pair<std::string_view, char> entities[] = {
+      {"&amp;", '&'}, {"&lt;", '<'},  {"&gt;", '>'},
+      {"&quot;", '"'}, {"&#39;", '\''}, {"&nbsp;", ' '}};
+  std::string out;
+  for (size_t i = 0; i < html.size(); i++) {
+    char ch = html[i];
+    if (ch == '<') {
+      size_t end = html.find('>', i);
+      if (end == std::string_view::npos)
+        break;
+      // block tags separate words, inline ones (<b>, <span>) do not
+      std::string_view tag = html.substr(i + 1, end - i - 1);
+      if (!tag.empty() && tag[0] == '/')
+        tag.remove_prefix(1);
+      i = end;
+      bool block = false;
+      for (std::string_view b : {"br", "div", "p", "li", "tr"}) {
+        block = block || (tag.substr(0, b.size()) == b &&
+                          (tag.size() == b.size() ||
+                           !std::isalpha((unsigned char)tag[b.size()])));
+      }
+      if (!block)
+        continue;
+      ch = ' ';
+    } else if (ch == '&') {
+      for (auto &e : entities) {
+        if (html.substr(i, e.first.size()) == e.first) {
+          ch = e.second;
+          i += e.first.size() - 1;
+          break;
+        }
+      }
+    }
+    // '|' separates fields in deck files, which are one card per line
+    if (ch == '|')
+      ch = '/';
+    if (ch == '\n' || ch == '\r' || ch == '\t')
+      ch = ' ';
+    if (ch == ' ' && (out.empty() || out.back() == ' '))
+      continue;
+    out += ch;
+  }
+  if (!out.empty() && out.back() == ' ')
+    out.pop_back();
+  return out;
+}
+
+int AnkiImport::quality(int button) {
+  // Again, Hard, Good, Easy
+  static const int qualities[] = {0, 1, 3, 4, 5};
+  return button >= 1 && button <= 4 ? qualities[button] : 0;
+}
+
+/**
+ * Copy the collection database out of the package zip, inflating it in
+ * chunks. Prefers collection.anki21 over the legacy collection.anki2.
+ */
+bool AnkiImport::extractCollection(const std::string &package,
+                                   const std::string &out,
+                                   std::string &error) {
+#ifdef TANKI_HAVE_ZLIB
+  std::ifstream in(package, std::ios::binary);
+  if (!in) {
+    error = "cannot open " + package;
+    return false;
+  }
+  in.seekg(0, std::ios::end);
+  size_t size = (size_t)in.tellg();
+
+  // end of central directory: last 22 bytes, plus a comment of < 64 KiB
+  size_t tailLen = std::min<size_t>(size, 22 + 0xffff);
+  std::string tail(tailLen, '\0');
+  in.seekg(size - tailLen);
+  in.read(&tail[0], tailLen);
+  size_t eocd = tail.rfind(std::string("PK\5\6", 4));
+  if (!in || eocd == std::string::npos || eocd + 22 > tail.size()) {
+    error = package + " is not a zip file";
+    return false;
+  }
+  auto *e = (const unsigned char *)tail.data() + eocd;
+  uint32_t entries = le16(e + 10), dirSize = le32(e + 12),
+           dirOffset = le32(e + 16);
+  if (dirOffset == 0xffffffff || entries == 0xffff) {
+    error = "zip64 packages are not supported";
+    return false;
+  }
+  std::string dir(dirSize, '\0');
+  in.seekg(dirOffset);
+  if (!in.read(&dir[0], dirSize)) {
+    error = package + " is truncated";
+    return false;
+  }
+
+  int rank = 0;
+  bool newFormat = false;
+  uint32_t method = 0, packed = 0, crc = 0, local = 0;
+  for (size_t pos = 0, n = 0; n < entries && pos + 46 <= dir.size(); n++) {
+    auto *h = (const unsigned char *)dir.data() + pos;
+    if (le32(h) != 0x02014b50)
+      break;
+    std::string name(dir, pos + 46, le16(h + 28));
+    int r = name == "collection.anki21" ? 2 : name == "collection.anki2";
+    newFormat = newFormat || name == "collection.anki21b";
+    if (r > rank) {
+      rank = r;
+      method = le16(h + 10);
+      crc = le32(h + 16);
+      packed = le32(h + 20);
+      local = le32(h + 42);
+    }
+    pos += 46 + le16(h + 28) + le16(h + 30) + le16(h + 32);
+  }
+  if (rank == 0) {
+    error = newFormat ? "this package uses the newer Anki format; export "
+                        "it with \"Support older Anki versions\""
+                      : "no Anki collection in " + package;
+    return false;
+  }
+  if (method != 0 && method != Z_DEFLATED) {
+    error = "unsupported zip compression method " + std::to_string(method);
+    return false;
+  }
+
+  unsigned char header[30];
+  in.seekg(local);
+  if (!in.read((char *)header, 30) || le32(header) != 0x04034b50) {
+    error = package + " is damaged";
+    return false;
+  }
+  in.seekg(local + 30 + le16(header + 26) + le16(header + 28));
+
+  std::ofstream fout(out, std::ios::binary | std::ios::trunc);
+  z_stream zs{};
+  if (method == Z_DEFLATED && inflateInit2(&zs, -MAX_WBITS) != Z_OK)
+    return false;
+  std::vector<char> src(CHUNK_BYTES), dst(CHUNK_BYTES);
+  uLong sum = crc32(0, nullptr, 0);
+  int status = Z_OK;
+  for (uint32_t left = packed; left > 0 && status != Z_STREAM_END;) {
+    uint32_t len = std::min<uint32_t>(left, CHUNK_BYTES);
+    if (!in.read(src.data(), len))
+      break;
+    left -= len;
+    if (method == 0) {
+      sum = crc32(sum, (const Bytef *)src.data(), len);
+      fout.write(src.data(), len);
+      continue;
+    }
+    zs.next_in = (Bytef *)src.data();
+    zs.avail_in = len;
+    do {
+      zs.next_out = (Bytef *)dst.data();
+      zs.avail_out = CHUNK_BYTES;
+      status = inflate(&zs, Z_NO_FLUSH);
+      if (status != Z_OK && status != Z_STREAM_END)
+        break;
+      size_t got = CHUNK_BYTES - zs.avail_out;
+      sum = crc32(sum, (const Bytef *)dst.data(), got);
+      fout.write(dst.data(), got);
+    } while (zs.avail_out == 0 && status == Z_OK);
+    if (status != Z_OK && status != Z_STREAM_END)
+      break;
+  }
+  if (method == Z_DEFLATED)
+    inflateEnd(&zs);
+  fout.close();
+  if (!fout || sum != crc) {
+    error = "could not extract the collection from " + package;
+    return false;
+  }
+  return true;
+#else
+  (void)package;
+  (void)out;
+  error = "Anki import needs zlib";
+  return false;
+#endif
+}
+
+/**
+ * Both cursors are ordered by card id, so the review log is consumed
+ * alongside the cards. With the revlog's cid index SQLite streams the
+ * rows without sorting.
+ */
+bool AnkiImport::readCollection(Deck &deck, const std::string &dbPath,
+                                const Options &options, Result &result) {
+#ifdef TANKI_HAVE_SQLITE
+  sqlite3 *db = nullptr;
+  if (sqlite3_open_v2(dbPath.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) !=
+      SQLITE_OK) {
+    result.error = sqlite3_errmsg(db);
+    sqlite3_close(db);
+    return false;
+  }
+  sqlite3_stmt *col = nullptr, *cloze = nullptr, *cards = nullptr,
+               *revs = nullptr;
+  auto prepare = [&](const char *sql, sqlite3_stmt **st) {
+    return sqlite3_prepare_v2(db, sql, -1, st, nullptr) == SQLITE_OK;
+  };
+  bool ok = prepare("SELECT crt FROM col", &col) &&
+            prepare("SELECT c.id, c.ord, c.type, c.queue, c.due, c.ivl, "
+                    "c.factor, n.flds, n.tags, n.mid FROM cards c "
+                    "JOIN notes n ON n.id = c.nid ORDER BY c.id",
+                    &cards) &&
+            prepare("SELECT cid, id, ease, type FROM revlog "
+                    "ORDER BY cid, id",
+                    &revs);
+  if (!ok)
+    result.error = std::string("not an Anki collection: ") +
+                   sqlite3_errmsg(db);
+
+  // note types (models) of type 1 are cloze; without SQLite's JSON
+  // functions only the template number tells them apart
+  std::unordered_set<int64_t> clozeModels;
+  if (ok && prepare("SELECT key FROM col, json_each(col.models) "
+                    "WHERE json_extract(value, '$.type') = 1",
+                    &cloze)) {
+    while (sqlite3_step(cloze) == SQLITE_ROW)
+      clozeModels.insert(sqlite3_column_int64(cloze, 0));
+  }
+
+  std::vector<Card> added;
+  if (ok) {
+    const time_t day = 24 * 60 * 60;
+    time_t now = std::time(nullptr);
+    time_t created =
+        sqlite3_step(col) == SQLITE_ROW ? sqlite3_column_int64(col, 0) : now;
+    auto text = [](sqlite3_stmt *st, int i) {
+      auto *p = (const char *)sqlite3_column_text(st, i);
+      return std::string(p ? p : "");
+    };
+
+    std::unordered_set<std::string> existing;
+    for (size_t i = 0; i < deck.size(); i++) {
+      const Card &c = deck.at(i);
+      existing.insert(std::string(c.front()) + "|" + std::string(c.back()));
+    }
+
+    int step;
+    bool moreReviews = sqlite3_step(revs) == SQLITE_ROW;
+    while ((step = sqlite3_step(cards)) == SQLITE_ROW) {
+      int64_t cid = sqlite3_column_int64(cards, 0);
+      int ord = sqlite3_column_int(cards, 1);
+      int type = sqlite3_column_int(cards, 2);
+      int queue = sqlite3_column_int(cards, 3);
+      int64_t due = sqlite3_column_int64(cards, 4);
+      int ivl = sqlite3_column_int(cards, 5);
+      int factor = sqlite3_column_int(cards, 6);
+      bool isCloze = clozeModels.count(sqlite3_column_int64(cards, 9)) > 0;
+
+      // reviews of cards that no longer exist are passed over
+      while (moreReviews && sqlite3_column_int64(revs, 0) < cid)
+        moreReviews = sqlite3_step(revs) == SQLITE_ROW;
+      Card::Schedule s{now, 0, 0, 2500, 0, 0};
+      size_t reviews = 0;
+      int lastButton = 0;
+      for (; moreReviews && sqlite3_column_int64(revs, 0) == cid;
+           moreReviews = sqlite3_step(revs) == SQLITE_ROW) {
+        int button = sqlite3_column_int(revs, 2);
+        // type 4 and up: manual reschedules, not answers
+        if (button < 1 || button > 4 || sqlite3_column_int(revs, 3) >= 4)
+          continue;
+        time_t when = sqlite3_column_int64(revs, 1) / 1000;
+        if (!options.keepIntervals)
+          SM2Scheduler::step(s, quality(button), when);
+        s.modified = when;
+        lastButton = button;
+        reviews++;
+      }
+      // Tanki ratings are Anki's buttons: 1=Again ... 4=Easy
+      s.lastRating = (uint8_t)lastButton;
+
+      std::string flds = text(cards, 7);
+      size_t sep = flds.find('\x1f');
+      std::string first = plainText(std::string_view(flds).substr(0, sep));
+      std::string second =
+          sep == std::string::npos
+              ? ""
+              : plainText(std::string_view(flds).substr(
+                    sep + 1, flds.find('\x1f', sep + 1) - sep - 1));
+      if (isCloze || ord > 1 || first.empty()) {
+        result.skipped++;
+        continue;
+      }
+      std::string front = ord == 1 ? second : first;
+      std::string back = ord == 1 ? first : second;
+      if (!existing.insert(front + "|" + back).second) {
+        result.skipped++;
+        continue;
+      }
+
+      if (options.keepIntervals) {
+        // review cards (and day-learning, queue 3) count due in days
+        // since the collection was created; learning cards in seconds
+        if (type == 2 || queue == 3) {
+          s.due = created + due * day;
+          s.interval = std::max(ivl, 0);
+        } else if (type == 1 || type == 3) {
+          s.due = due;
+          s.interval = std::max(ivl, 0);
+        }
+        if (factor > 0)
+          s.ease = (uint16_t)std::min(std::max(factor, 1300), 65000);
+      }
+      if (queue == -1)
+        s.flags |= Card::Schedule::Suspended;
+
+      // Anki tags are space separated, Tanki's comma separated
+      std::string tags = text(cards, 8);
+      std::replace(tags.begin(), tags.end(), ' ', ',');
+      Card card(front, back);
+      card.setTags(tags);
+      card.schedule() = s;
+      added.push_back(std::move(card));
+      result.reviews += reviews;
+    }
+    if (step != SQLITE_DONE) {
+      result.error = std::string("reading the collection failed: ") +
+                     sqlite3_errmsg(db);
+      ok = false;
+    }
+  }
+  sqlite3_finalize(col);
+  sqlite3_finalize(cloze);
+  sqlite3_finalize(cards);
+  sqlite3_finalize(revs);
+  sqlite3_close(db);
+  if (!ok)
+    return false;
+  result.cards = added.size();
+  deck.addCards(std::move(added));
+  return true;
+#else
+  (void)deck;
+  (void)dbPath;
+  (void)options;
+  result.error = "Anki import needs SQLite";
+  return false;
+#endif
+}
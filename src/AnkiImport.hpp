@@ -0,0 +1,58 @@
+#ifndef TANKI_ANKIIMPORT_HPP
+#define TANKI_ANKIIMPORT_HPP
+
+#include "Deck.hpp"
+#include <cstddef>
+#include <ctime>
+#include <string>
+#include <string_view>
+
+/**
+ * Import from an Anki package (.apkg or .colpkg; needs zlib and SQLite,
+ * see TANKI_HAVE_ZLIB / TANKI_HAVE_SQLITE).
+ * - the collection database is inflated from the zip to a temp file
+ * - cards (joined with their notes) and the review log are read as two
+ *   cursors ordered by card id and merged, so neither table is ever
+ *   held in memory
+ * - card template 0 becomes front/back = first/second note field,
+ *   template 1 the reverse; other templates and every card of a cloze
+ *   note type are skipped
+ * - by default each card's review log is replayed through SM-2 to
+ *   rebuild its schedule; keepIntervals takes Anki's own due date,
+ *   interval and ease instead
+ */
+class AnkiImport {
+public:
+  struct Options {
+    bool keepIntervals = false;
+  };
+
+  struct Result {
+    size_t cards = 0;      // added to the deck
+    size_t reviews = 0;    // review log rows applied
+    size_t skipped = 0;    // cloze, other templates, exact duplicates
+    std::string error;     // set when import returns false
+  };
+
+  static bool available();
+  // By file extension
+  static bool isPackage(const std::string &path);
+
+  // Add the cards of the package to deck
+  static bool import(Deck &deck, const std::string &path,
+                     const Options &options, Result &result);
+
+  // Field HTML as plain single-line card text
+  static std::string plainText(std::string_view html);
+  // Anki answer button (1-4) as an SM-2 quality (0-5): Hard is a pass
+  // (3), only Again is a lapse
+  static int quality(int button);
+
+private:
+  static bool extractCollection(const std::string &package,
+                                const std::string &out, std::string &error);
+  static bool readCollection(Deck &deck, const std::string &dbPath,
+                             const Options &options, Result &result);
+};
+
+#endif // TANKI_ANKIIMPORT_HPP
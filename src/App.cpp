@@ -1,36 +1,41 @@
 #include "App.hpp"
+#include "AnkiImport.hpp"
+#include "CompressedDeck.hpp"
+#include "DeckIO.hpp"
+#include "DeckOps.hpp"
 #include "FileManager.hpp"
+#include "Metrics.hpp"
+#include "NearDuplicates.hpp"
+#include "ReviewSession.hpp"
 #include "SM2Scheduler.hpp"
 #include "Stats.hpp"
+#include "Utf8.hpp"
+#include <algorithm>
+#include <cstdio>
 #include <ctime>
 #include <filesystem>
 #include <ncurses.h>
-#include <pwd.h>
-#include <sys/types.h>
-#include <unistd.h>
-
-static std::string getHomeDirectory() {
-  const char *home = getenv("HOME");
-  if (!home) {
-    struct passwd *pw = getpwuid(getuid());
-    home = pw->pw_dir;
-  }
-  return std::string(home);
-}
 
 App::App() : running(true) {
   // Create the deck folder if not exist
-  std::string deckDir = getHomeDirectory() + "/.tanki_decks";
+  std::string deckDir = FileManager::deckDirectory();
   if (!std::filesystem::exists(deckDir)) {
     std::filesystem::create_directories(deckDir);
   }
 
+  dailyCounts.file = DailyCounts::fileIn(deckDir);
   ui.init();
   loadDecks();
+  watcher.start(deckDir);
+  autosave.start(deckDir);
+  Metrics::startExport(deckDir, "ui");
 }
 
 App::~App() {
+  watcher.stop();
+  autosave.stop();
   saveDecks();
+  Metrics::stopExport();
   ui.shutdown();
 }
 
@@ -43,8 +48,11 @@ void App::run() {
   }
 
   flushinp();
+  // wake up once a second to pick up decks changed on disk
+  timeout(1000);
 
   while (running) {
+    applyDeckChanges();
     if (!currentDeck) {
       // if user didn't pick a deck, or we have no decks, re-run
       startScreen();
@@ -62,6 +70,10 @@ void App::run() {
     wrefresh(stdscr); // Ensure the UI is drawn immediately
 
     int ch = getch();
+    while (ch == ERR && !applyDeckChanges()) {
+      autosave.tick();
+      ch = getch();
+    }
     switch (ch) {
     case 'q':
       running = false;
@@ -69,6 +81,9 @@ void App::run() {
     case 'r':
       review();
       break;
+    case 'a':
+      reviewAll();
+      break;
     case 'c':
       cram();
       break;
@@ -81,6 +96,9 @@ void App::run() {
     case 'x':
       deleteCard();
       break;
+    case 'X':
+      deleteMatching();
+      break;
     case 't':
       showStats();
       break;
@@ -93,9 +111,27 @@ void App::run() {
     case 'n':
       createDeck();
       break;
+    case 'z':
+      toggleCompression();
+      break;
+    case 'm':
+      mergeDecks();
+      break;
+    case 'p':
+      splitDeck();
+      break;
+    case 'u':
+      undo();
+      break;
+    case 'y':
+      redo();
+      break;
     case 'e':
       examDrillMode();
       break;
+    case 'f':
+      findDuplicates();
+      break;
     case '?':
       helpScreen();
       break;
@@ -105,22 +141,149 @@ void App::run() {
   }
 }
 
+/**
+ * Only the manifest is read here; deck files are parsed when they are
+ * opened, or when their manifest entry is stale (and then kept).
+ */
 void App::loadDecks() {
-  std::string deckDir = getHomeDirectory() + "/.tanki_decks";
-  auto files = FileManager::listDeckFiles(deckDir);
-  for (auto &f : files) {
-    auto deck = FileManager::loadDeck(f);
-    if (deck) {
-      allDecks.push_back(deck);
+  std::string deckDir = FileManager::deckDirectory();
+  bool changed = false;
+  auto progress = [this](size_t done, size_t total) {
+    ui.drawProgress("Reading decks", done, total);
+  };
+  std::vector<std::shared_ptr<Deck>> loaded;
+  auto summaries = DeckManifest::scan(deckDir, changed, progress, &loaded);
+  for (size_t i = 0; i < summaries.size(); i++) {
+    allDecks.push_back({summaries[i], loaded[i]});
+  }
+  if (changed) {
+    DeckManifest::save(deckDir, deckSummaries());
+  }
+  rebuildDeckTree();
+}
+
+bool App::saveDecks() {
+  autosave.settle();
+  std::string deckDir = FileManager::deckDirectory();
+  std::vector<DeckSlot *> loaded;
+  std::vector<std::shared_ptr<Deck>> decks;
+  for (auto &slot : allDecks) {
+    if (slot.deck) {
+      loaded.push_back(&slot);
+      decks.push_back(slot.deck);
     }
   }
+  auto saved = DeckIO::saveAll(decks, deckDir, [this](size_t d, size_t n) {
+    ui.drawProgress("Saving decks", d, n);
+  });
+  bool ok = true;
+  for (size_t i = 0; i < loaded.size(); i++) {
+    if (saved[i])
+      loaded[i]->summary = DeckManifest::summarize(
+          *decks[i], deckDir + "/" + decks[i]->name() + ".deck");
+    ok = ok && saved[i];
+  }
+  DeckManifest::save(deckDir, deckSummaries());
+  return ok;
+}
+
+std::shared_ptr<Deck> App::openDeck(size_t idx) {
+  if (idx >= allDecks.size())
+    return nullptr;
+  DeckSlot &slot = allDecks[idx];
+  if (!slot.deck) {
+    slot.deck = FileManager::loadDeck(slot.summary.path);
+  }
+  return slot.deck;
+}
+
+std::vector<DeckSummary> App::deckSummaries() {
+  std::vector<DeckSummary> out;
+  for (auto &slot : allDecks) {
+    if (slot.deck)
+      DeckManifest::refreshCounts(slot.summary, *slot.deck);
+    out.push_back(slot.summary);
+  }
+  return out;
+}
+
+void App::rebuildDeckTree() {
+  deckTree.build(deckSummaries(), std::time(nullptr));
+}
+
+/**
+ * Summaries of loaded decks are recounted (a search of each due index)
+ * and only the differences are pushed up the tree; decks not loaded
+ * just have their due counts rechecked against the clock.
+ */
+DeckTree &App::refreshDeckTree() {
+  time_t now = std::time(nullptr);
+  for (size_t i = 0; i < allDecks.size(); i++) {
+    if (allDecks[i].deck)
+      DeckManifest::refreshCounts(allDecks[i].summary, *allDecks[i].deck);
+    deckTree.update((int)i, allDecks[i].summary, now);
+  }
+  return deckTree;
 }
 
-void App::saveDecks() {
-  std::string deckDir = getHomeDirectory() + "/.tanki_decks";
-  for (auto &d : allDecks) {
-    FileManager::saveDeck(d, deckDir);
+int App::slotOf(const std::shared_ptr<Deck> &deck) const {
+  for (size_t i = 0; i < allDecks.size(); i++) {
+    if (allDecks[i].deck == deck)
+      return (int)i;
   }
+  return -1;
+}
+
+/**
+ * Reload deck files other programs changed since the last call.
+ * Only the changed files are read; files we wrote ourselves still match
+ * their manifest entry and are skipped. Returns true if anything changed.
+ */
+bool App::applyDeckChanges() {
+  auto changed = watcher.takeChanges();
+  if (changed.empty())
+    return false;
+
+  bool any = false;
+  for (auto &path : changed) {
+    auto it = std::find_if(allDecks.begin(), allDecks.end(),
+                           [&](const DeckSlot &s) {
+                             return s.summary.path == path;
+                           });
+    if (!std::filesystem::exists(path)) {
+      if (it == allDecks.end())
+        continue;
+      if (it->deck && it->deck == currentDeck)
+        currentDeck = nullptr;
+      history.forget(it->deck);
+      autosave.forget(it->deck);
+      allDecks.erase(it);
+      any = true;
+      continue;
+    }
+    if (it != allDecks.end() && DeckManifest::isCurrent(it->summary))
+      continue;
+
+    auto disk = FileManager::loadDeck(path);
+    if (!disk)
+      continue;
+    if (it == allDecks.end()) {
+      allDecks.push_back({DeckManifest::summarize(*disk, path), nullptr});
+    } else if (it->deck) {
+      history.forget(it->deck);
+      it->deck->reloadFrom(*disk);
+      ui.invalidateLayouts();
+      it->summary = DeckManifest::summarize(*it->deck, path);
+    } else {
+      it->summary = DeckManifest::summarize(*disk, path);
+    }
+    any = true;
+  }
+  if (any) {
+    DeckManifest::save(FileManager::deckDirectory(), deckSummaries());
+    rebuildDeckTree();
+  }
+  return any;
 }
 
 /**
@@ -140,7 +303,7 @@ void App::startScreen() {
   }
 
   // If decks exist, show them with the logo
-  int idx = ui.startScreenWithDecks(allDecks);
+  int idx = ui.startScreenWithDecks(refreshDeckTree());
   if (idx == -1) {
     // user pressed q => quit
     running = false;
@@ -150,7 +313,9 @@ void App::startScreen() {
   } else {
     // user picked existing deck
     if (idx >= 0 && idx < (int)allDecks.size()) {
-      currentDeck = allDecks[idx];
+      currentDeck = openDeck(idx);
+      if (!currentDeck)
+        ui.showMessage("Failed to load deck: " + allDecks[idx].summary.name);
     }
   }
 }
@@ -162,16 +327,20 @@ void App::createDeck() {
     return;
   }
   // Check duplicates
-  for (auto &d : allDecks) {
-    if (d->name() == name) {
+  for (auto &slot : allDecks) {
+    if (slot.summary.name == name) {
       ui.showMessage("A deck with that name already exists.");
       return;
     }
   }
   auto deck = std::make_shared<Deck>(name);
-  allDecks.push_back(deck);
+  DeckSummary summary;
+  summary.path = FileManager::deckDirectory() + "/" + name + ".deck";
+  summary.name = name;
+  allDecks.push_back({summary, deck});
   currentDeck = deck;
   saveDecks();
+  rebuildDeckTree();
   ui.showMessage("Created new deck: " + name);
 }
 
@@ -180,50 +349,270 @@ void App::switchDeck() {
     ui.showMessage("No decks available.");
     return;
   }
-  int idx = ui.showDeckSelection(allDecks);
+  int idx = ui.showDeckSelection(refreshDeckTree());
   if (idx >= 0 && idx < (int)allDecks.size()) {
-    currentDeck = allDecks[idx];
+    auto deck = openDeck(idx);
+    if (!deck) {
+      ui.showMessage("Failed to load deck: " + allDecks[idx].summary.name);
+      return;
+    }
+    currentDeck = deck;
     ui.showMessage("Switched to deck: " + currentDeck->name());
   }
 }
 
-void App::mergeDecks() { ui.showMessage("Merging not implemented."); }
-void App::splitDeck() { ui.showMessage("Splitting not implemented."); }
+void App::toggleCompression() {
+  if (!currentDeck) {
+    ui.showMessage("No deck selected!");
+    return;
+  }
+  if (currentDeck->format() == Deck::Compressed) {
+    currentDeck->setFormat(Deck::Plain);
+    ui.showMessage("Deck will be saved as plain text.");
+  } else if (!CompressedDeck::available()) {
+    ui.showMessage("Compression is not available in this build (no zlib).");
+  } else {
+    currentDeck->setFormat(Deck::Compressed);
+    ui.showMessage("Deck will be saved compressed.");
+  }
+}
+
+/**
+ * Move every card of another deck into the current one and delete the
+ * other deck. The current deck is saved before the source file goes,
+ * so an interrupted merge leaves duplicates rather than losing cards.
+ */
+void App::mergeDecks() {
+  if (!currentDeck) {
+    ui.showMessage("No deck selected!");
+    return;
+  }
+  if (allDecks.size() < 2) {
+    ui.showMessage("There is no other deck to merge.");
+    return;
+  }
+  int idx = ui.showDeckSelection(refreshDeckTree());
+  if (idx < 0 || idx >= (int)allDecks.size())
+    return;
+  auto source = openDeck(idx);
+  if (!source) {
+    ui.showMessage("Failed to load deck: " + allDecks[idx].summary.name);
+    return;
+  }
+  if (source == currentDeck) {
+    ui.showMessage("Cannot merge a deck into itself.");
+    return;
+  }
+
+  std::string sourcePath = allDecks[idx].summary.path;
+  std::string sourceName = source->name();
+  history.forget(currentDeck);
+  history.forget(source);
+  autosave.forget(source);
+  auto result = DeckOps::merge(*currentDeck, *source);
+  DeckSlot sourceSlot = allDecks[idx];
+  allDecks.erase(allDecks.begin() + idx);
+  // the source file goes only once the merged cards are on disk
+  if (!saveDecks()) {
+    sourceSlot.deck = nullptr; // emptied by the merge; read it again
+    allDecks.insert(allDecks.begin() + idx, sourceSlot);
+    rebuildDeckTree();
+    ui.showMessage("Could not save " + currentDeck->name() + "; " +
+                   sourceName + " was kept.");
+    return;
+  }
+  FileManager::deleteDeck(sourcePath);
+  rebuildDeckTree();
+
+  ui.showMessage("Merged " + sourceName + ": " +
+                 std::to_string(result.added) + " added, " +
+                 std::to_string(result.duplicates) + " duplicates (" +
+                 std::to_string(result.newerTaken) +
+                 " took newer progress).");
+}
+
+void App::splitDeck() {
+  if (!currentDeck) {
+    ui.showMessage("No deck selected!");
+    return;
+  }
+  std::string spec = ui.promptString(
+      "Cards to move (tag:NAME, search:TEXT or range:FROM-TO):");
+  DeckOps::SplitRule rule;
+  if (!DeckOps::parseSplitRule(spec, rule)) {
+    ui.showMessage("Could not understand: " + spec);
+    return;
+  }
+  std::string name = ui.promptString("Enter a name for the new deck:");
+  if (name.empty()) {
+    ui.showMessage("No name provided.");
+    return;
+  }
+  for (auto &slot : allDecks) {
+    if (slot.summary.name == name) {
+      ui.showMessage("A deck with that name already exists.");
+      return;
+    }
+  }
+
+  auto deck = DeckOps::split(*currentDeck, name, rule);
+  if (deck->size() == 0) {
+    ui.showMessage("No cards matched; nothing was split.");
+    return;
+  }
+  history.forget(currentDeck);
+  DeckSummary summary;
+  summary.path = FileManager::deckDirectory() + "/" + name + ".deck";
+  summary.name = name;
+  allDecks.push_back({summary, deck});
+  saveDecks();
+  rebuildDeckTree();
+  ui.showMessage("Moved " + std::to_string(deck->size()) +
+                 " cards into new deck: " + name);
+}
+
+void App::undo() {
+  std::shared_ptr<Deck> deck;
+  std::string label;
+  if (!history.undo(deck, label)) {
+    ui.showMessage("Nothing to undo.");
+    return;
+  }
+  ui.showMessage("Undid " + label + " in " + deck->name() + ".");
+}
+
+void App::redo() {
+  std::shared_ptr<Deck> deck;
+  std::string label;
+  if (!history.redo(deck, label)) {
+    ui.showMessage("Nothing to redo.");
+    return;
+  }
+  ui.showMessage("Redid " + label + " in " + deck->name() + ".");
+}
 
 void App::importCSV() {
   if (!currentDeck) {
     ui.showMessage("No deck selected to import into!");
     return;
   }
-  std::string path = ui.promptString("Enter CSV file path:");
+  std::string path = ui.promptString("Enter CSV or Anki (.apkg) file path:");
   if (path.empty()) {
     ui.showMessage("No path given.");
     return;
   }
-  bool ok = FileManager::importCSV(currentDeck, path);
-  if (ok)
+  if (AnkiImport::isPackage(path)) {
+    importAnki(path);
+    return;
+  }
+  history.record(currentDeck, "CSV import");
+  size_t similar = 0;
+  bool ok = FileManager::importCSV(currentDeck, path, &similar);
+  if (ok && similar > 0)
+    ui.showMessage("Import successful! Skipped " + std::to_string(similar) +
+                   " near-duplicate cards.");
+  else if (ok)
     ui.showMessage("Import successful!");
   else
     ui.showMessage("Failed to import (file missing or invalid).");
 }
 
+void App::importAnki(const std::string &path) {
+  history.record(currentDeck, "Anki import");
+  AnkiImport::Result result;
+  if (!AnkiImport::import(*currentDeck, path, AnkiImport::Options(),
+                          result)) {
+    ui.showMessage("Anki import failed: " + result.error);
+    return;
+  }
+  ui.showMessage("Imported " + std::to_string(result.cards) + " cards with " +
+                 std::to_string(result.reviews) + " reviews (" +
+                 std::to_string(result.skipped) + " skipped).");
+}
+
 void App::exportCSV() { ui.showMessage("Export CSV is not implemented."); }
 
+/**
+ * Review the current deck and its subdecks (`Deck::Sub`) together.
+ * Subdecks whose summary says nothing is due are not even loaded; the
+ * rest are merged lazily by due date like reviewAll.
+ */
 void App::review() {
   if (!currentDeck) {
     ui.showMessage("No deck selected.");
     return;
   }
-  auto dueCards = currentDeck->getDueCards();
-  SM2Scheduler sched;
-  for (auto &card : dueCards) {
-    bool cont = ui.reviewCard(card, false);
+  std::vector<std::shared_ptr<Deck>> decks{currentDeck};
+  time_t now = std::time(nullptr);
+  for (int i : deckTree.decksUnder(deckTree.nodeOf(slotOf(currentDeck)))) {
+    DeckSlot &slot = allDecks[i];
+    if (slot.deck == currentDeck ||
+        (!slot.deck && !slot.summary.mayHaveDue(now)))
+      continue;
+    if (auto deck = openDeck(i))
+      decks.push_back(deck);
+  }
+  runReview(decks, 0);
+}
+
+/**
+ * Review the due cards of every deck in one session.
+ * Cards are merged lazily in due-date order, so nothing is copied up front.
+ */
+void App::reviewAll() {
+  if (allDecks.empty()) {
+    ui.showMessage("No decks available.");
+    return;
+  }
+  std::string lim = ui.promptString("Max cards per deck (blank=no limit):");
+  int perDeck = 0;
+  if (!lim.empty()) {
+    try {
+      perDeck = std::stoi(lim);
+    } catch (...) {
+      ui.showMessage("Invalid limit.");
+      return;
+    }
+  }
+  // decks the manifest says have nothing due are not even parsed
+  std::vector<std::shared_ptr<Deck>> decks;
+  time_t now = std::time(nullptr);
+  for (size_t i = 0; i < allDecks.size(); i++) {
+    if (allDecks[i].deck || allDecks[i].summary.mayHaveDue(now)) {
+      if (auto d = openDeck(i))
+        decks.push_back(d);
+    }
+  }
+  runReview(decks, perDeck);
+}
+
+void App::runReview(const std::vector<std::shared_ptr<Deck>> &decks,
+                    int perDeckLimit) {
+  SessionLimits limits = sessionLimits;
+  limits.perDeck = perDeckLimit;
+  ReviewSession session(decks, limits, dailyCounts);
+  ReviewSession::Item item;
+  while (true) {
+    if (!session.next(std::time(nullptr), item)) {
+      // failed cards still to come back: wait for them, unless the
+      // user would rather stop
+      time_t ready = session.nextReady();
+      if (ready == 0 || !ui.waitForCard(ready, session.learningCount()))
+        break;
+      continue;
+    }
+    Card card = *item.deck->findCard(item.cardId);
+    UI::Timing timing;
+    bool cont = ui.reviewCard(card, false, &timing);
     if (!cont)
       break;
-    int rating = card.lastRating();
-    sched.updateCard(card, rating);
-    currentDeck->updateCard(card);
+    card.addRecallTime(timing.flip);
+    history.record(item.deck,
+                   "review of \"" + Utf8::truncate(card.front(), 30) + "\"");
+    session.answer(item, card, std::time(nullptr));
+    autosave.changed(item.deck);
   }
+  autosave.flush();
   ui.showMessage("Review session complete.");
 }
 
@@ -232,19 +621,15 @@ void App::cram() {
     ui.showMessage("No deck selected.");
     return;
   }
-  std::string tag = ui.promptString("Enter tag to cram (blank=all):");
-  auto all = currentDeck->cards();
-  std::vector<Card> subset;
-  if (tag.empty()) {
-    subset = all;
-  } else {
-    for (auto &c : all) {
-      if (c.hasTag(tag)) {
-        subset.push_back(c);
-      }
-    }
-  }
-  for (auto &card : subset) {
+  CardQuery query;
+  if (!promptQuery("Cards to cram, e.g. tag:verbs ease<2 (blank=all):",
+                   query))
+    return;
+  for (int id : query.select(*currentDeck)) {
+    const Card *found = currentDeck->findCard(id);
+    if (!found)
+      continue;
+    Card card = *found;
     bool cont = ui.reviewCard(card, true);
     if (!cont)
       break;
@@ -275,20 +660,88 @@ void App::deleteCard() {
     return;
   }
   // Actually remove the card
-  cards.erase(cards.begin() + indexToDel);
-  // We have to update the deck’s internal vector
-  // simplest is to set the entire new vector:
-  currentDeck->setCards(cards);
+  history.record(currentDeck, "delete card");
+  currentDeck->removeCard(cards[indexToDel].id());
 
   ui.showMessage("Card " + std::to_string(indexToDel) + " deleted.");
 }
 
+/**
+ * Delete every card of the current deck that matches a query.
+ */
+void App::deleteMatching() {
+  if (!currentDeck) {
+    ui.showMessage("No deck selected!");
+    return;
+  }
+  CardQuery query;
+  if (!promptQuery("Delete cards matching (e.g. tag:old ivl>100):", query))
+    return;
+  if (query.empty()) {
+    ui.showMessage("Delete canceled: the query matches every card.");
+    return;
+  }
+  auto ids = query.select(*currentDeck);
+  if (ids.empty()) {
+    ui.showMessage("No cards match " + query.text() + ".");
+    return;
+  }
+  std::string answer =
+      ui.promptString("Delete " + std::to_string(ids.size()) +
+                      " cards? Type yes to confirm:");
+  if (answer != "yes") {
+    ui.showMessage("Delete canceled.");
+    return;
+  }
+  history.record(currentDeck, "delete " + query.text());
+  std::sort(ids.begin(), ids.end());
+  currentDeck->extractIf([&](const Card &c) {
+    return std::binary_search(ids.begin(), ids.end(), c.id());
+  });
+  ui.showMessage("Deleted " + std::to_string(ids.size()) + " cards.");
+}
+
+bool App::promptQuery(const std::string &message, CardQuery &query) {
+  std::string error;
+  if (CardQuery::parse(ui.promptString(message), query, error))
+    return true;
+  ui.showMessage("Bad query: " + error);
+  return false;
+}
+
+/**
+ * List cards that nearly repeat an earlier card of the current deck.
+ */
+void App::findDuplicates() {
+  if (!currentDeck) {
+    ui.showMessage("No deck selected!");
+    return;
+  }
+  ui.drawProgress("Comparing cards", 0, currentDeck->size());
+  auto matches = NearDuplicates::findInDeck(*currentDeck);
+  if (matches.empty()) {
+    ui.showMessage("No near-duplicate cards found.");
+    return;
+  }
+  std::string text = std::to_string(matches.size()) +
+                     " cards nearly repeat an earlier card:\n\n";
+  for (auto &m : matches) {
+    const Card *keep = currentDeck->findCard(m.keep);
+    const Card *dup = currentDeck->findCard(m.duplicate);
+    text += Utf8::truncate(dup->front(), 30) + "  ~  " +
+            Utf8::truncate(keep->front(), 30) + "  (" +
+            std::to_string((int)(m.similarity * 100 + 0.5)) + "%)\n";
+  }
+  ui.showLongText("Near Duplicates", text);
+}
+
 void App::showStats() {
   if (!currentDeck) {
     ui.showMessage("No deck selected!");
     return;
   }
-  auto info = Stats::generateStats(currentDeck);
+  auto info = Stats::generateStats(currentDeck) +
+              Stats::generateMemoryReport(currentDeck);
   ui.showLongText("Stats", info);
 }
 
@@ -303,20 +756,128 @@ void App::showSchedule() {
 
 void App::helpScreen() {
   std::string help = "Shortcuts:\n"
-                     "  r = Review\n"
+                     "  r = Review (with Subdecks)\n"
+                     "  a = Review All Decks\n"
                      "  c = Cram\n"
+                     "  e = Timed Drill, Slowest Cards First\n"
                      "  b = Browse\n"
-                     "  i = Import CSV\n"
+                     "  i = Import CSV or Anki Package\n"
                      "  x = Delete Card\n"
+                     "  X = Delete Cards Matching a Query\n"
                      "  t = Stats\n"
                      "  s = Schedule\n"
                      "  d = Switch Deck\n"
                      "  n = Create Deck\n"
+                     "  z = Toggle Compressed Storage\n"
+                     "  m = Merge Another Deck In\n"
+                     "  p = Split Cards Into New Deck\n"
+                     "  f = Find Near-Duplicate Cards\n"
+                     "  u = Undo Last Change\n"
+                     "  y = Redo\n"
                      "  ? = Help\n"
-                     "  q = Quit\n";
+                     "  q = Quit\n"
+                     "\n"
+                     "Decks named Parent::Child show as a tree; Space\n"
+                     "folds a branch in the deck lists.\n";
   ui.showLongText("Help", help);
 }
 
+/**
+ * Timed drill over the current deck, slowest cards first. Each card has
+ * a time limit to flip it; the times feed the cards' recall averages
+ * (so the slow ones come first next time too) but nothing is
+ * rescheduled.
+ */
 void App::examDrillMode() {
-  ui.showMessage("Exam/Drill mode not implemented yet.");
+  if (!currentDeck) {
+    ui.showMessage("No deck selected.");
+    return;
+  }
+  CardQuery query;
+  if (!promptQuery("Cards to drill, e.g. tag:exam time>5 (blank=all):",
+                   query))
+    return;
+  std::string lim = ui.promptString("Seconds per card (blank=10):");
+  int limit = 10;
+  if (!lim.empty()) {
+    try {
+      limit = std::stoi(lim);
+    } catch (...) {
+      limit = 0;
+    }
+    if (limit <= 0) {
+      ui.showMessage("Invalid time limit.");
+      return;
+    }
+  }
+
+  // untimed cards count as taking half the limit
+  auto ids = query.select(*currentDeck);
+  std::vector<std::pair<double, int>> order;
+  order.reserve(ids.size());
+  for (int id : ids) {
+    double t = currentDeck->findCard(id)->recallTime();
+    order.push_back({t > 0 ? t : limit / 2.0, id});
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [](const std::pair<double, int> &a,
+                      const std::pair<double, int> &b) {
+                     return a.first > b.first;
+                   });
+
+  int drilled = 0, correct = 0, timeouts = 0;
+  double total = 0;
+  std::vector<std::pair<double, int>> slowest;
+  for (auto &o : order) {
+    const Card *found = currentDeck->findCard(o.second);
+    if (!found)
+      continue;
+    Card card = *found;
+    UI::Timing timing;
+    bool timedOut = false;
+    if (!ui.drillCard(card, limit, timing, timedOut))
+      break;
+    drilled++;
+    total += timing.flip;
+    if (timedOut)
+      timeouts++;
+    else if (!SM2Scheduler::isLapse(card.lastRating()))
+      correct++;
+    slowest.push_back({timing.flip, card.id()});
+
+    if (drilled == 1)
+      history.record(currentDeck, "drill");
+    Card updated = *found;
+    // not a review: the stamp stays, so a drill never outranks a real
+    // answer given elsewhere when decks are merged or synced
+    updated.addRecallTime(timing.flip);
+    currentDeck->updateCard(updated);
+    autosave.changed(currentDeck);
+  }
+  autosave.flush();
+  if (drilled == 0) {
+    ui.showMessage("Drill ended.");
+    return;
+  }
+
+  char line[96];
+  std::snprintf(line, sizeof(line),
+                "Cards: %d\nCorrect in time: %d\nTimed out: %d\n"
+                "Average time to flip: %.1fs\n",
+                drilled, correct, timeouts, total / drilled);
+  std::string text = line;
+  std::sort(slowest.begin(), slowest.end(),
+            [](const std::pair<double, int> &a,
+               const std::pair<double, int> &b) {
+              return a.first > b.first;
+            });
+  if (slowest.size() > 10)
+    slowest.resize(10);
+  text += "\nSlowest cards:\n";
+  for (auto &s : slowest) {
+    const Card *c = currentDeck->findCard(s.second);
+    std::snprintf(line, sizeof(line), "  %5.1fs  ", s.first);
+    text += line + (c ? Utf8::truncate(c->front(), 40) : "?") + "\n";
+  }
+  ui.showLongText("Drill Results", text);
 }
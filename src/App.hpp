@@ -1,8 +1,15 @@
 #ifndef TANKI_APP_HPP
 #define TANKI_APP_HPP
 
+#include "Autosave.hpp"
+#include "CardQuery.hpp"
 #include "Deck.hpp"
+#include "DeckManifest.hpp"
+#include "DeckTree.hpp"
+#include "DeckWatcher.hpp"
+#include "ReviewSession.hpp"
 #include "UI.hpp"
+#include "UndoHistory.hpp"
 #include <memory>
 #include <string>
 #include <vector>
@@ -24,14 +31,41 @@ private:
   bool running;
   UI ui;
 
-  // All decks
-  std::vector<std::shared_ptr<Deck>> allDecks;
+  // All deck files. A deck is parsed only once it is opened;
+  // until then only its manifest summary is known.
+  struct DeckSlot {
+    DeckSummary summary;
+    std::shared_ptr<Deck> deck;
+  };
+  std::vector<DeckSlot> allDecks;
+  // allDecks as `Parent::Child` tree with counts per subtree; rebuilt
+  // when decks come or go, updated in place when their counts change
+  DeckTree deckTree;
+  // Picks up deck files changed by other programs
+  DeckWatcher watcher;
+  // Checkpoints reviewed decks in the background
+  Autosave autosave;
   // Current deck
   std::shared_ptr<Deck> currentDeck;
+  // Card changes made from the UI, for undo/redo
+  UndoHistory history;
+
+  // Review session settings and today's progress
+  SessionLimits sessionLimits;
+  DailyCounts dailyCounts;
 
   // Deck I/O
   void loadDecks();
-  void saveDecks();
+  // False if any loaded deck could not be written
+  bool saveDecks();
+  std::shared_ptr<Deck> openDeck(size_t idx);
+  std::vector<DeckSummary> deckSummaries();
+  void rebuildDeckTree();
+  // The tree with the counts of loaded decks brought up to date
+  DeckTree &refreshDeckTree();
+  // Index of a loaded deck in allDecks, -1 if none
+  int slotOf(const std::shared_ptr<Deck> &deck) const;
+  bool applyDeckChanges();
 
   // The fancy start screen
   void startScreen();
@@ -39,22 +73,33 @@ private:
   // Deck mgmt
   void createDeck();
   void switchDeck();
-  void mergeDecks(); // stub
-  void splitDeck();  // stub
+  void mergeDecks();
+  void splitDeck();
+  void toggleCompression();
+  void undo();
+  void redo();
 
   // CSV
   void importCSV();
+  void importAnki(const std::string &path);
   void exportCSV(); // stub
 
   // Main actions
   void review();
+  void reviewAll();
+  void runReview(const std::vector<std::shared_ptr<Deck>> &decks,
+                 int perDeckLimit);
   void cram();
   void deleteCard(); // NEW: user can delete a card
+  void deleteMatching();
+  // false (after saying why) when the query does not parse
+  bool promptQuery(const std::string &message, CardQuery &query);
+  void findDuplicates();
   void showStats();
   void showSchedule();
   void helpScreen();
 
-  // Stub
+  // Timed drill, slowest cards first
   void examDrillMode();
 };
 
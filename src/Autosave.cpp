@@ -0,0 +1,152 @@
+#include "Autosave.hpp"
+#include "FileManager.hpp"
+#include "Metrics.hpp"
+#include <algorithm>
+
+Autosave::Autosave() {}
+
+Autosave::~Autosave() { stop(); }
+
+void Autosave::start(const std::string &directory) {
+  if (_thread.joinable())
+    return;
+  _directory = directory;
+  _stopping = false;
+  _thread = std::thread(&Autosave::run, this);
+}
+
+void Autosave::stop() {
+  if (!_thread.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    _queue.clear();
+    _stopping = true;
+  }
+  _wake.notify_all();
+  _thread.join();
+  releaseDone();
+  _pending.clear();
+}
+
+void Autosave::changed(const std::shared_ptr<Deck> &deck) {
+  time_t now = std::time(nullptr);
+  auto it = std::find_if(_pending.begin(), _pending.end(),
+                         [&](const Pending &p) { return p.deck == deck; });
+  if (it == _pending.end()) {
+    _pending.push_back({deck, 0, 0});
+    it = _pending.end() - 1;
+  }
+  if (it->changes++ == 0)
+    it->since = now;
+  if (it->changes >= EVERY_CHANGES || now - it->since >= EVERY_SECONDS)
+    enqueue(*it);
+}
+
+void Autosave::forget(const std::shared_ptr<Deck> &deck) {
+  auto it = std::find_if(_pending.begin(), _pending.end(),
+                         [&](const Pending &p) { return p.deck == deck; });
+  if (it == _pending.end())
+    return;
+  std::string path = _directory + "/" + deck->name() + ".deck";
+  _pending.erase(it);
+  Job dropped;
+  std::lock_guard<std::mutex> guard(_lock);
+  auto queued = std::find_if(_queue.begin(), _queue.end(),
+                             [&](const Job &j) { return j.path == path; });
+  if (queued != _queue.end()) {
+    dropped = std::move(*queued);
+    _queue.erase(queued);
+  }
+}
+
+void Autosave::tick() {
+  time_t now = std::time(nullptr);
+  for (auto &p : _pending) {
+    if (p.changes > 0 && now - p.since >= EVERY_SECONDS)
+      enqueue(p);
+  }
+  releaseDone();
+}
+
+void Autosave::flush() {
+  for (auto &p : _pending) {
+    if (p.changes > 0)
+      enqueue(p);
+  }
+}
+
+void Autosave::settle() {
+  std::vector<Job> dropped;
+  {
+    std::unique_lock<std::mutex> lock(_lock);
+    dropped.assign(std::make_move_iterator(_queue.begin()),
+                   std::make_move_iterator(_queue.end()));
+    _queue.clear();
+    _idle.wait(lock, [&] { return !_writing; });
+  }
+  releaseDone();
+  for (auto &p : _pending)
+    p.changes = 0;
+}
+
+void Autosave::enqueue(Pending &p) {
+  p.changes = 0;
+  if (!_thread.joinable())
+    return;
+  Job job{_directory + "/" + p.deck->name() + ".deck", p.deck->snapshot()};
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    auto it = std::find_if(_queue.begin(), _queue.end(), [&](const Job &j) {
+      return j.path == job.path;
+    });
+    if (it != _queue.end())
+      std::swap(*it, job); // the older snapshot is released below
+    else
+      _queue.push_back(std::move(job));
+  }
+  _wake.notify_one();
+  releaseDone();
+}
+
+void Autosave::releaseDone() {
+  std::vector<Job> done;
+  {
+    std::lock_guard<std::mutex> guard(_lock);
+    done.swap(_done);
+  }
+}
+
+void Autosave::run() {
+  static auto &seconds = Metrics::histogram(
+      "tanki_autosave_write_seconds", "Time to write one deck checkpoint");
+  std::unique_lock<std::mutex> lock(_lock);
+  while (true) {
+    _wake.wait(lock, [&] { return _stopping || !_queue.empty(); });
+    if (_stopping)
+      break;
+    Job job = std::move(_queue.front());
+    _queue.pop_front();
+    _writing = true;
+    lock.unlock();
+
+    {
+      Metrics::Timer timer(seconds);
+      const Deck::Snapshot &s = job.snapshot;
+      std::string data = s.name + "\n";
+      for (auto &c : s.cards) {
+        data += FileManager::formatCardLine(c);
+        data += '\n';
+      }
+      data += FileManager::formatTombstones(s.tombstones);
+      FileManager::replaceFile(FileManager::checkpointPath(job.path), data);
+    }
+
+    lock.lock();
+    _done.push_back(std::move(job));
+    _writing = false;
+    _idle.notify_all();
+  }
+  _writing = false;
+  _idle.notify_all();
+}
@@ -0,0 +1,81 @@
+#ifndef TANKI_AUTOSAVE_HPP
+#define TANKI_AUTOSAVE_HPP
+
+#include "Deck.hpp"
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Checkpoints decks while they are being reviewed, so a crash or a
+ * dropped terminal loses at most a few answers. The UI thread only takes
+ * a Deck::Snapshot (unchanged card chunks are shared, so it is cheap) and
+ * goes on; a writer thread turns it into `.<deck>.deck.autosave` beside
+ * the deck file with FileManager::replaceFile. Snapshots of a deck that
+ * queue up behind a slow write replace each other, so a burst of answers
+ * costs one write. FileManager::loadDeck folds a checkpoint left behind
+ * into the deck, and saving the deck removes it.
+ */
+class Autosave {
+public:
+  // Checkpoint a deck after this many changes, or once its oldest
+  // unsaved change is this old
+  static const int EVERY_CHANGES = 20;
+  static const int EVERY_SECONDS = 30;
+
+  Autosave();
+  ~Autosave();
+
+  void start(const std::string &directory);
+  // Drop queued checkpoints and finish the one being written
+  void stop();
+
+  // Note one change to `deck` (UI thread)
+  void changed(const std::shared_ptr<Deck> &deck);
+  // Stop checkpointing a deck that is going away
+  void forget(const std::shared_ptr<Deck> &deck);
+  // Checkpoint decks whose changes are EVERY_SECONDS old; for idle loops
+  void tick();
+  // Checkpoint every deck with changes now, without waiting for it
+  void flush();
+  // Drop queued checkpoints and wait for the one being written. Call
+  // before saving decks, so no checkpoint older than the save is left.
+  void settle();
+
+private:
+  struct Pending {
+    std::shared_ptr<Deck> deck;
+    int changes = 0;
+    time_t since = 0; // first change not checkpointed yet
+  };
+  struct Job {
+    std::string path; // of the deck file
+    Deck::Snapshot snapshot;
+  };
+
+  std::string _directory;
+  std::vector<Pending> _pending; // UI thread only
+
+  std::thread _thread;
+  std::mutex _lock;
+  std::condition_variable _wake;
+  std::condition_variable _idle;
+  std::deque<Job> _queue; // at most one job per deck
+  // Written snapshots go back to the UI thread to be released there:
+  // CardStore decides whether to copy a chunk from its use count, and
+  // that must only drop on the thread that writes to the cards.
+  std::vector<Job> _done;
+  bool _writing = false;
+  bool _stopping = false;
+
+  void enqueue(Pending &p);
+  void releaseDone();
+  void run();
+};
+
+#endif // TANKI_AUTOSAVE_HPP
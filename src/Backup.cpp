@@ -0,0 +1,471 @@
+#include "Backup.hpp"
+#include "DeckIO.hpp"
+#include "DeckLock.hpp"
+#include "FileManager.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string_view>
+#include <unistd.h>
+#include <unordered_map>
+
+#ifdef TANKI_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+static const char MAGIC[] = "TANKI-SNAPSHOT 1";
+
+// Chunks are 2-64 KiB, about 10 KiB on average: a cut is taken where
+// the top 13 bits of the rolling hash are zero
+static const size_t MIN_CHUNK = 2 * 1024;
+static const size_t MAX_CHUNK = 64 * 1024;
+static const uint64_t CUT_MASK = ((1ull << 13) - 1) << (64 - 13);
+
+namespace {
+struct ChunkRef {
+  std::string id;
+  uint32_t length = 0;
+};
+
+struct FileEntry {
+  std::string path; // relative to the deck directory
+  uintmax_t size = 0;
+  int64_t mtime = 0;
+  std::vector<ChunkRef> chunks;
+};
+
+struct Counters {
+  std::atomic<uintmax_t> bytesRead{0};
+  std::atomic<size_t> chunks{0};
+  std::atomic<size_t> newChunks{0};
+  std::atomic<uintmax_t> bytesStored{0};
+  std::atomic<unsigned> tmp{0};
+  std::mutex lock;
+  std::set<std::string> dirs; // chunk directories with new entries
+};
+} // namespace
+
+static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+static uint64_t mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+// Per-byte values of the rolling hash, the same in every build
+static const uint64_t *gearTable() {
+  static uint64_t table[256];
+  static bool ready = [] {
+    uint64_t x = 0x2545f4914f6cdd1dull;
+    for (auto &t : table) {
+      x += 0x9e3779b97f4a7c15ull;
+      t = mix(x);
+    }
+    return true;
+  }();
+  (void)ready;
+  return table;
+}
+
+// Ends of the chunks of data. The gear hash shifts one bit per byte, so
+// its top bits depend on the last 64 bytes only, and a cut moves with
+// the content around it.
+static std::vector<size_t> chunkEnds(std::string_view data) {
+  const uint64_t *gear = gearTable();
+  std::vector<size_t> ends;
+  size_t start = 0;
+  while (start < data.size()) {
+    size_t end = std::min(data.size(), start + MAX_CHUNK);
+    size_t i = std::min(end, start + MIN_CHUNK);
+    uint64_t h = 0;
+    while (i < end) {
+      h = (h << 1) + gear[(unsigned char)data[i++]];
+      if ((h & CUT_MASK) == 0)
+        break;
+    }
+    ends.push_back(i);
+    start = i;
+  }
+  return ends;
+}
+
+// 128-bit chunk id as 32 hex digits: two murmur-style lanes over 8-byte
+// words. Not cryptographic; it only has to tell chunks apart.
+static std::string chunkId(std::string_view data) {
+  uint64_t h1 = 0x9e3779b97f4a7c15ull ^ data.size();
+  uint64_t h2 = 0x6a09e667f3bcc909ull + data.size();
+  auto step = [&](uint64_t w) {
+    h1 = rotl(h1 ^ (w * 0x87c37b91114253d5ull), 31) * 0x4cf5ad432745937full;
+    h2 = rotl(h2 ^ (w * 0x4cf5ad432745937full), 33) * 0x87c37b91114253d5ull +
+         h1;
+  };
+  size_t i = 0;
+  for (; i + 8 <= data.size(); i += 8) {
+    uint64_t w;
+    std::memcpy(&w, data.data() + i, 8);
+    step(w);
+  }
+  uint64_t w = 0;
+  std::memcpy(&w, data.data() + i, data.size() - i);
+  step(w);
+  h1 = mix(h1 ^ h2);
+  h2 = mix(h2 + h1);
+  char out[33];
+  std::snprintf(out, sizeof(out), "%016llx%016llx", (unsigned long long)h1,
+                (unsigned long long)h2);
+  return out;
+}
+
+static std::string chunkPath(const std::string &repo, const std::string &id) {
+  return repo + "/chunks/" + id.substr(0, 2) + "/" + id;
+}
+
+// 'z' + zlib stream, or 'r' + the bytes when that is not smaller
+static std::string pack(std::string_view data) {
+#ifdef TANKI_HAVE_ZLIB
+  uLongf size = compressBound(data.size());
+  std::string out(1 + size, 'z');
+  if (compress2((Bytef *)&out[1], &size, (const Bytef *)data.data(),
+                data.size(), 6) == Z_OK &&
+      size < data.size()) {
+    out.resize(1 + size);
+    return out;
+  }
+#endif
+  return "r" + std::string(data);
+}
+
+static bool unpack(const std::string &stored, size_t length,
+                   std::string &out) {
+  if (!stored.empty() && stored[0] == 'r') {
+    out.assign(stored, 1);
+    return out.size() == length;
+  }
+#ifdef TANKI_HAVE_ZLIB
+  if (!stored.empty() && stored[0] == 'z') {
+    out.resize(length);
+    uLongf size = length;
+    return uncompress((Bytef *)&out[0], &size,
+                      (const Bytef *)stored.data() + 1,
+                      stored.size() - 1) == Z_OK &&
+           size == length;
+  }
+#endif
+  return false;
+}
+
+// A stored chunk that unpacks to `length` bytes with the right id
+static bool chunkIntact(const std::string &path, const std::string &id,
+                        size_t length) {
+  std::string stored, data;
+  return FileManager::readFile(path, stored) && unpack(stored, length, data) &&
+         chunkId(data) == id;
+}
+
+static bool storeChunk(const std::string &repo, const std::string &id,
+                       std::string_view data, Counters &counters) {
+  std::string path = chunkPath(repo, id);
+  // a damaged copy (say, from a crash of an older version) is replaced
+  if (access(path.c_str(), F_OK) == 0 && chunkIntact(path, id, data.size()))
+    return true;
+  std::string dir = std::filesystem::path(path).parent_path().string();
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  // workers may store the same chunk at once; either rename wins. The
+  // chunk is on disk before its name is, and before any snapshot is.
+  std::string packed = pack(data);
+  std::string tmp = path + ".tmp" + std::to_string(counters.tmp++);
+  if (!FileManager::writeFile(tmp, packed, true) ||
+      std::rename(tmp.c_str(), path.c_str()) != 0) {
+    std::remove(tmp.c_str());
+    return false;
+  }
+  counters.newChunks++;
+  counters.bytesStored += packed.size();
+  std::lock_guard<std::mutex> hold(counters.lock);
+  counters.dirs.insert(dir);
+  return true;
+}
+
+static bool storeFile(const std::string &path, const std::string &repo,
+                      FileEntry &f, Counters &counters) {
+  std::string data;
+  if (!FileManager::readFile(path, data))
+    return false;
+  f.size = data.size();
+  f.chunks.clear();
+  counters.bytesRead += data.size();
+  std::string_view all(data);
+  size_t start = 0;
+  for (size_t end : chunkEnds(all)) {
+    std::string_view chunk = all.substr(start, end - start);
+    ChunkRef ref{chunkId(chunk), (uint32_t)chunk.size()};
+    if (!storeChunk(repo, ref.id, chunk, counters))
+      return false;
+    f.chunks.push_back(ref);
+    start = end;
+  }
+  counters.chunks += f.chunks.size();
+  return true;
+}
+
+static std::string formatSnapshot(const std::vector<FileEntry> &files) {
+  std::string text = std::string(MAGIC) + "\n";
+  for (auto &f : files) {
+    text += std::to_string(f.size) + "|" + std::to_string(f.mtime) + "|";
+    for (size_t i = 0; i < f.chunks.size(); i++) {
+      text += (i ? "," : "") + f.chunks[i].id + ":" +
+              std::to_string(f.chunks[i].length);
+    }
+    text += "|" + f.path + "\n";
+  }
+  return text;
+}
+
+static bool readSnapshot(const std::string &path,
+                         std::vector<FileEntry> &files) {
+  std::string text;
+  if (!FileManager::readFile(path, text))
+    return false;
+  size_t pos = text.find('\n');
+  if (pos == std::string::npos || text.compare(0, pos, MAGIC) != 0)
+    return false;
+  files.clear();
+  for (pos++; pos < text.size();) {
+    size_t nl = text.find('\n', pos);
+    if (nl == std::string::npos)
+      nl = text.size();
+    std::string_view line(text.data() + pos, nl - pos);
+    pos = nl + 1;
+    // the path comes last and may itself hold '|'
+    size_t a = line.find('|');
+    size_t b = a == line.npos ? a : line.find('|', a + 1);
+    size_t c = b == line.npos ? b : line.find('|', b + 1);
+    if (c == line.npos)
+      return false;
+    FileEntry f;
+    std::string fields(line.substr(0, b)); // size|mtime
+    f.size = std::strtoull(fields.c_str(), nullptr, 10);
+    f.mtime = std::strtoll(fields.c_str() + a + 1, nullptr, 10);
+    f.path = std::string(line.substr(c + 1));
+    std::string_view list = line.substr(b + 1, c - b - 1);
+    while (!list.empty()) {
+      size_t comma = list.find(',');
+      std::string_view item = list.substr(0, comma);
+      size_t colon = item.find(':');
+      if (colon == item.npos)
+        return false;
+      ChunkRef ref;
+      ref.id = std::string(item.substr(0, colon));
+      ref.length = (uint32_t)std::strtoul(
+          std::string(item.substr(colon + 1)).c_str(), nullptr, 10);
+      f.chunks.push_back(ref);
+      list = comma == list.npos ? std::string_view() : list.substr(comma + 1);
+    }
+    files.push_back(std::move(f));
+  }
+  return true;
+}
+
+static std::string snapshotPath(const std::string &repo,
+                                const std::string &name) {
+  return repo + "/snapshots/" + name;
+}
+
+// Files to back up, relative to dir: everything but lock and temporary
+// files, metrics and the repository itself
+static std::vector<FileEntry> listFiles(const std::string &dir,
+                                        const std::string &repo) {
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  fs::path skip = fs::weakly_canonical(repo, ec);
+  std::vector<FileEntry> files;
+  auto opts = fs::directory_options::skip_permission_denied;
+  for (auto it = fs::recursive_directory_iterator(dir, opts, ec);
+       it != fs::recursive_directory_iterator(); it.increment(ec)) {
+    if (ec)
+      break;
+    const fs::path &p = it->path();
+    std::string name = p.filename().string();
+    if (it->is_directory(ec)) {
+      if (name == ".metrics" || fs::weakly_canonical(p, ec) == skip)
+        it.disable_recursion_pending();
+      continue;
+    }
+    if (!it->is_regular_file(ec) || p.extension() == ".lock" ||
+        p.extension() == ".tmp")
+      continue;
+    FileEntry f;
+    f.path = fs::relative(p, dir, ec).generic_string();
+    if (!FileManager::fileIdentity(p.string(), f.mtime, f.size))
+      continue;
+    files.push_back(std::move(f));
+  }
+  std::sort(files.begin(), files.end(),
+            [](const FileEntry &a, const FileEntry &b) {
+              return a.path < b.path;
+            });
+  return files;
+}
+
+static std::string newSnapshotName(const std::string &repo) {
+  char stamp[32];
+  time_t now = std::time(nullptr);
+  std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+  std::string name = stamp;
+  for (int n = 2; access(snapshotPath(repo, name).c_str(), F_OK) == 0; n++)
+    name = std::string(stamp) + "-" + std::to_string(n);
+  return name;
+}
+
+bool Backup::create(const std::string &deckDir, const std::string &repo,
+                    Result &result, std::string &error) {
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  if (!fs::is_directory(deckDir, ec)) {
+    error = "Not a directory: " + deckDir;
+    return false;
+  }
+  fs::create_directories(repo + "/chunks", ec);
+  fs::create_directories(repo + "/snapshots", ec);
+  if (ec) {
+    error = "Cannot create " + repo;
+    return false;
+  }
+
+  // decks are read under shared locks, so no save is seen half done
+  std::vector<std::unique_ptr<DeckLock>> locks;
+  for (auto &path : FileManager::listDeckFiles(deckDir))
+    locks.push_back(std::make_unique<DeckLock>(path, DeckLock::Shared));
+
+  std::vector<FileEntry> files = listFiles(deckDir, repo);
+  std::unordered_map<std::string, const FileEntry *> before;
+  std::vector<FileEntry> last;
+  auto names = list(repo);
+  if (!names.empty() && readSnapshot(snapshotPath(repo, names.back()), last)) {
+    for (auto &f : last)
+      before[f.path] = &f;
+  }
+
+  std::vector<size_t> changed;
+  for (size_t i = 0; i < files.size(); i++) {
+    auto it = before.find(files[i].path);
+    if (it != before.end() && it->second->size == files[i].size &&
+        it->second->mtime == files[i].mtime)
+      files[i].chunks = it->second->chunks;
+    else
+      changed.push_back(i);
+  }
+
+  Counters counters;
+  std::vector<char> ok(changed.size(), 0);
+  DeckIO::runBatch(changed.size(), [&](size_t k) {
+    FileEntry &f = files[changed[k]];
+    ok[k] = storeFile(deckDir + "/" + f.path, repo, f, counters);
+  });
+  locks.clear();
+  for (size_t k = 0; k < changed.size(); k++) {
+    if (!ok[k]) {
+      error = "Cannot back up " + files[changed[k]].path;
+      return false;
+    }
+  }
+
+  for (auto &dir : counters.dirs)
+    FileManager::syncDirectory(dir);
+  FileManager::syncDirectory(repo + "/chunks");
+  result.snapshot = newSnapshotName(repo);
+  if (!FileManager::replaceFile(snapshotPath(repo, result.snapshot),
+                                formatSnapshot(files))) {
+    error = "Cannot write snapshot " + result.snapshot;
+    return false;
+  }
+  result.files = files.size();
+  result.filesRead = changed.size();
+  for (auto &f : files)
+    result.bytes += f.size;
+  result.bytesRead = counters.bytesRead;
+  result.chunks = counters.chunks;
+  result.newChunks = counters.newChunks;
+  result.bytesStored = counters.bytesStored;
+  return true;
+}
+
+std::vector<std::string> Backup::list(const std::string &repo) {
+  std::vector<std::string> names;
+  std::error_code ec;
+  for (auto &e :
+       std::filesystem::directory_iterator(repo + "/snapshots", ec)) {
+    std::string name = e.path().filename().string();
+    if (name.find('.') == std::string::npos) // not a temporary file
+      names.push_back(name);
+  }
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+bool Backup::describe(const std::string &repo, const std::string &snapshot,
+                      size_t &files, uintmax_t &bytes) {
+  std::vector<FileEntry> entries;
+  if (!readSnapshot(snapshotPath(repo, snapshot), entries))
+    return false;
+  files = entries.size();
+  bytes = 0;
+  for (auto &f : entries)
+    bytes += f.size;
+  return true;
+}
+
+bool Backup::restore(const std::string &repo, const std::string &snapshot,
+                     const std::string &target, std::string &error) {
+  namespace fs = std::filesystem;
+  std::vector<FileEntry> files;
+  if (snapshot.find('/') != std::string::npos ||
+      !readSnapshot(snapshotPath(repo, snapshot), files)) {
+    error = "No such snapshot: " + snapshot;
+    return false;
+  }
+  std::error_code ec;
+  if (fs::exists(target, ec) && !fs::is_empty(target, ec)) {
+    error = "Not empty: " + target + " (restore into a new directory)";
+    return false;
+  }
+
+  // not vector<bool>: workers write neighbouring elements
+  std::vector<char> ok(files.size(), 0);
+  DeckIO::runBatch(files.size(), [&](size_t i) {
+    const FileEntry &f = files[i];
+    std::string data, stored, chunk;
+    data.reserve(f.size);
+    for (auto &ref : f.chunks) {
+      if (!FileManager::readFile(chunkPath(repo, ref.id), stored) ||
+          !unpack(stored, ref.length, chunk) || chunkId(chunk) != ref.id)
+        return;
+      data += chunk;
+    }
+    if (data.size() != f.size)
+      return;
+    std::string path = target + "/" + f.path;
+    std::error_code dirError;
+    fs::create_directories(fs::path(path).parent_path(), dirError);
+    ok[i] = FileManager::writeFile(path, data);
+  });
+  for (size_t i = 0; i < files.size(); i++) {
+    if (!ok[i]) {
+      error = "Cannot restore " + files[i].path +
+              " (missing or damaged chunk, or a write failed)";
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,48 @@
+#ifndef TANKI_BACKUP_HPP
+#define TANKI_BACKUP_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * Deduplicated backups of the deck directory into a repository folder.
+ * Files are cut into chunks where a rolling hash of the last bytes says
+ * so, not at fixed offsets, so changing a few card lines changes only
+ * the chunks around them. Each chunk is stored once, under its hash:
+ *   chunks/<ab>/<id>     one chunk (deflated when built with zlib)
+ *   snapshots/<name>     one backup, a line per file:
+ *                        size|mtime|id:length,id:length,...|path
+ * A backup re-reads only files whose size or mtime differ from the last
+ * snapshot, and writes only chunks the repository lacks (or holds
+ * damaged). Chunks are fsynced before the snapshot naming them is
+ * written. Files are chunked and hashed on DeckIO's worker threads.
+ */
+class Backup {
+public:
+  struct Result {
+    std::string snapshot; // name of the new snapshot
+    size_t files = 0;
+    size_t filesRead = 0; // new or changed since the last snapshot
+    uintmax_t bytes = 0;  // of all files in the snapshot
+    uintmax_t bytesRead = 0;
+    size_t chunks = 0; // in the files read
+    size_t newChunks = 0;
+    uintmax_t bytesStored = 0; // by the new chunks
+  };
+
+  // Back up every file under deckDir (lock files and metrics aside)
+  static bool create(const std::string &deckDir, const std::string &repo,
+                     Result &result, std::string &error);
+  // Snapshot names, oldest first
+  static std::vector<std::string> list(const std::string &repo);
+  // Files and total bytes of one snapshot
+  static bool describe(const std::string &repo, const std::string &snapshot,
+                       size_t &files, uintmax_t &bytes);
+  // Write the files of a snapshot under target, which must be empty or
+  // missing. Every chunk is checked against its hash.
+  static bool restore(const std::string &repo, const std::string &snapshot,
+                      const std::string &target, std::string &error);
+};
+
+#endif // TANKI_BACKUP_HPP
@@ -0,0 +1,99 @@
+#ifndef TANKI_BATCHSCHEDULER_HPP
+#define TANKI_BATCHSCHEDULER_HPP
+
+#include "Card.hpp"
+#include "SM2Scheduler.hpp"
+#include <cmath>
+#include <ctime>
+#include <string>
+
+/**
+ * Policies and filters for Deck::reschedule, which changes many cards in
+ * one pass. Each is a small value type whose call operator is inlined
+ * into the deck loop it is instantiated with, so no per-card dispatch
+ * happens. changes() tells whether applying the policy would alter a
+ * card; cards it would leave alone are skipped. Every change stamps
+ * Card::modified(), so a merge on save keeps the new scheduling over an
+ * older copy on disk.
+ */
+class BatchScheduler {
+public:
+  // Move due dates by `seconds` (negative brings them forward)
+  struct ShiftDue {
+    static constexpr bool movesDue = true;
+    time_t seconds;
+    time_t now;
+    ShiftDue(time_t seconds, time_t now) : seconds(seconds), now(now) {}
+    bool changes(const Card::Schedule &) const { return seconds != 0; }
+    void operator()(Card::Schedule &s) const {
+      s.due += seconds;
+      s.modified = now;
+    }
+  };
+
+  // Same ease factor for every card (clamped to the SM-2 range)
+  struct SetEase {
+    static constexpr bool movesDue = false;
+    uint16_t ease;
+    time_t now;
+    SetEase(double ease, time_t now)
+        : ease((uint16_t)std::lround(std::fmin(std::fmax(ease, 1.3), 65.0) *
+                                     1000.0)),
+          now(now) {}
+    bool changes(const Card::Schedule &s) const { return s.ease != ease; }
+    void operator()(Card::Schedule &s) const {
+      s.ease = ease;
+      s.modified = now;
+    }
+  };
+
+  // Forget all progress: the card is new and due now
+  struct ResetProgress {
+    static constexpr bool movesDue = true;
+    time_t now;
+    explicit ResetProgress(time_t now) : now(now) {}
+    // a card already new and due counts as reset
+    bool changes(const Card::Schedule &s) const {
+      return s.due > now || s.interval != 0 || s.ease != 2500 ||
+             s.lastRating != 0;
+    }
+    void operator()(Card::Schedule &s) const {
+      s.due = now;
+      s.interval = 0;
+      s.ease = 2500;
+      s.lastRating = 0;
+      s.modified = now;
+    }
+  };
+
+  // Answer every card with the same rating (SM-2, as in a review)
+  struct ApplyRating {
+    static constexpr bool movesDue = true;
+    int quality;
+    time_t now;
+    ApplyRating(int quality, time_t now) : quality(quality), now(now) {}
+    bool changes(const Card::Schedule &) const { return true; }
+    void operator()(Card::Schedule &s) const {
+      s.lastRating = (uint8_t)quality;
+      SM2Scheduler::step(s, quality, now);
+    }
+  };
+
+  struct AllCards {
+    bool operator()(const Card &) const { return true; }
+  };
+
+  // Cards carrying a tag; the name is looked up once, not per card
+  class WithTag {
+  public:
+    explicit WithTag(const std::string &tag)
+        : _known(Card::findTag(tag, _id)) {}
+    bool operator()(const Card &c) const { return _known && c.hasTagId(_id); }
+
+  private:
+    uint32_t _id = 0;
+    bool _known;
+  };
+};
+
+#endif // TANKI_BATCHSCHEDULER_HPP
@@ -0,0 +1,457 @@
+#include "CLI.hpp"
+#include "AnkiImport.hpp"
+#include "Backup.hpp"
+#include "BatchScheduler.hpp"
+#include "CardQuery.hpp"
+#include "DeckIO.hpp"
+#include "DeckManifest.hpp"
+#include "DeckOps.hpp"
+#include "DeckSync.hpp"
+#include "FileManager.hpp"
+#include "Metrics.hpp"
+#include "NearDuplicates.hpp"
+#include "Stats.hpp"
+#include "StudyServer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+// A whole argument as a number in [lo, hi]; "2x", "" and "nan" fail
+static bool parseNumber(const std::string &text, double lo, double hi,
+                        double &out) {
+  char *end = nullptr;
+  double n = std::strtod(text.c_str(), &end);
+  if (end == text.c_str() || *end || !(n >= lo && n <= hi))
+    return false;
+  out = n;
+  return true;
+}
+
+int CLI::run(int argc, char **argv) {
+  std::string cmd = argv[1];
+  std::vector<std::string> args(argv + 2, argv + argc);
+
+  if (cmd == "mem")
+    return memCommand(args);
+  if (cmd == "merge")
+    return mergeCommand(args);
+  if (cmd == "split")
+    return splitCommand(args);
+  if (cmd == "dups")
+    return dupsCommand(args);
+  if (cmd == "shift" || cmd == "ease" || cmd == "reset")
+    return rescheduleCommand(cmd, args);
+  if (cmd == "find" || cmd == "delete")
+    return queryCommand(cmd, args);
+  if (cmd == "anki")
+    return ankiCommand(args);
+  if (cmd == "sync")
+    return syncCommand(args);
+  if (cmd == "backup" || cmd == "snapshots" || cmd == "restore")
+    return backupCommand(cmd, args);
+  if (cmd == "metrics" && args.empty())
+    return metricsCommand();
+  if (cmd == "serve" && args.empty())
+    return StudyServer(FileManager::deckDirectory()).run();
+  return usage();
+}
+
+int CLI::usage() {
+  std::cerr << "Usage: Tanki [command]\n"
+               "  (no command)   start the terminal UI (a thin client when\n"
+               "                 `Tanki serve` is running)\n"
+               "  --local        start the full UI even if a server runs\n"
+               "  mem [deck]     memory used by loaded decks\n"
+               "  merge <target> <source>\n"
+               "                 move all cards of source into target\n"
+               "  split <deck> <new> tag:NAME|search:TEXT|range:FROM-TO\n"
+               "                 move matching cards into a new deck\n"
+               "  dups <deck> [threshold]\n"
+               "                 list near-duplicate cards (threshold 0-1)\n"
+               "  find <deck> <query>\n"
+               "                 list cards matching a query, e.g.\n"
+               "                 'tag:verbs due<3d ease<2.0 -suspended'\n"
+               "  delete <deck> <query>\n"
+               "                 delete the cards matching a query\n"
+               "  shift <deck> <days> [tag]\n"
+               "                 move due dates by days (negative = sooner)\n"
+               "  ease <deck> <ease> [tag]\n"
+               "                 set the ease factor (1.3-65)\n"
+               "  reset <deck> [tag]\n"
+               "                 forget review progress, cards become new\n"
+               "  anki <file.apkg> <deck> [--keep-intervals]\n"
+               "                 import an Anki package, replaying its\n"
+               "                 review history (or keeping its intervals)\n"
+               "  sync [dir] <other-dir>\n"
+               "                 two-way sync of the deck folder (or dir)\n"
+               "                 with another one, e.g. a mounted copy\n"
+               "  backup <repo>  back up the deck folder into a backup\n"
+               "                 repository, storing only changed chunks\n"
+               "  snapshots <repo>\n"
+               "                 list the backups in a repository\n"
+               "  restore <repo> <snapshot> <dir>\n"
+               "                 write a backup into a new folder\n"
+               "  metrics        print the metrics last exported by running\n"
+               "                 UIs and servers (Prometheus text format)\n"
+               "  serve          keep all decks loaded and serve local UIs\n";
+  return 2;
+}
+
+int CLI::memCommand(const std::vector<std::string> &args) {
+  std::vector<std::shared_ptr<Deck>> decks;
+  if (args.empty()) {
+    decks = openAllDecks();
+  } else {
+    auto deck = openDeck(args[0]);
+    if (!deck) {
+      std::cerr << "No such deck: " << args[0] << "\n";
+      return 1;
+    }
+    decks.push_back(deck);
+  }
+
+  Deck::MemoryUsage total;
+  for (auto &d : decks) {
+    std::cout << Stats::generateMemoryReport(d) << "\n";
+    auto m = d->memoryUsage();
+    total.cards += m.cards;
+    total.text += m.text;
+    total.tags += m.tags;
+    total.scheduling += m.scheduling;
+    total.indexes += m.indexes;
+  }
+  if (decks.size() > 1) {
+    std::cout << "All decks: " << total.cards << " cards, " << total.total()
+              << " bytes for " << total.text << " bytes of text\n";
+  }
+  return 0;
+}
+
+int CLI::mergeCommand(const std::vector<std::string> &args) {
+  if (args.size() != 2 || args[0] == args[1])
+    return usage();
+  auto target = openDeck(args[0]);
+  auto source = openDeck(args[1]);
+  if (!target || !source) {
+    std::cerr << "No such deck: " << (target ? args[1] : args[0]) << "\n";
+    return 1;
+  }
+
+  std::string dir = FileManager::deckDirectory();
+  auto result = DeckOps::merge(*target, *source);
+  if (!FileManager::saveDeck(target, dir)) {
+    std::cerr << "Could not save " << target->name() << "\n";
+    return 1;
+  }
+  FileManager::deleteDeck(dir + "/" + source->name() + ".deck");
+  std::cout << "Merged " << args[1] << " into " << args[0] << ": "
+            << result.added << " added, " << result.duplicates
+            << " duplicates (" << result.newerTaken
+            << " took newer progress)\n";
+  return 0;
+}
+
+int CLI::splitCommand(const std::vector<std::string> &args) {
+  DeckOps::SplitRule rule;
+  if (args.size() != 3 || !DeckOps::parseSplitRule(args[2], rule))
+    return usage();
+  if (!deckPath(args[1]).empty()) {
+    std::cerr << "Deck already exists: " << args[1] << "\n";
+    return 1;
+  }
+  auto source = openDeck(args[0]);
+  if (!source) {
+    std::cerr << "No such deck: " << args[0] << "\n";
+    return 1;
+  }
+
+  std::string dir = FileManager::deckDirectory();
+  auto deck = DeckOps::split(*source, args[1], rule);
+  if (deck->size() == 0) {
+    std::cerr << "No cards matched " << args[2] << "\n";
+    return 1;
+  }
+  // new deck first, so a failure never loses the moved cards
+  if (!FileManager::saveDeck(deck, dir) ||
+      !FileManager::saveDeck(source, dir)) {
+    std::cerr << "Could not save decks\n";
+    return 1;
+  }
+  std::cout << "Moved " << deck->size() << " cards from " << args[0]
+            << " into " << args[1] << "\n";
+  return 0;
+}
+
+int CLI::dupsCommand(const std::vector<std::string> &args) {
+  if (args.empty() || args.size() > 2)
+    return usage();
+  double threshold = NearDuplicates::defaultThreshold;
+  if (args.size() == 2 && !parseNumber(args[1], 0, 1, threshold))
+    return usage();
+  auto deck = openDeck(args[0]);
+  if (!deck) {
+    std::cerr << "No such deck: " << args[0] << "\n";
+    return 1;
+  }
+
+  // similarity, duplicate front, earlier front - tab separated
+  auto matches = NearDuplicates::findInDeck(*deck, threshold);
+  for (auto &m : matches) {
+    std::cout << (int)(m.similarity * 100 + 0.5) << "%\t"
+              << deck->findCard(m.duplicate)->front() << "\t"
+              << deck->findCard(m.keep)->front() << "\n";
+  }
+  std::cerr << matches.size() << " near-duplicate cards in " << deck->size()
+            << "\n";
+  return 0;
+}
+
+int CLI::queryCommand(const std::string &cmd,
+                      const std::vector<std::string> &args) {
+  if (args.size() < 2)
+    return usage();
+  // the shell has split the query already; keep multi-word values whole
+  std::string text;
+  for (size_t i = 1; i < args.size(); i++) {
+    bool spaced = args[i].find(' ') != std::string::npos &&
+                  args[i].find('"') == std::string::npos;
+    text += (i > 1 ? " " : "") +
+            (spaced ? "\"" + args[i] + "\"" : args[i]);
+  }
+  CardQuery query;
+  std::string error;
+  if (!CardQuery::parse(text, query, error)) {
+    std::cerr << "Bad query: " << error << "\n";
+    return 2;
+  }
+  auto deck = openDeck(args[0]);
+  if (!deck) {
+    std::cerr << "No such deck: " << args[0] << "\n";
+    return 1;
+  }
+
+  auto ids = query.select(*deck);
+  if (cmd == "find") {
+    // front, back, tags - tab separated
+    for (int id : ids) {
+      const Card *c = deck->findCard(id);
+      std::cout << c->front() << "\t" << c->back() << "\t" << c->tagsString()
+                << "\n";
+    }
+    std::cerr << ids.size() << " of " << deck->size() << " cards match\n";
+    return 0;
+  }
+
+  std::sort(ids.begin(), ids.end());
+  deck->extractIf([&](const Card &c) {
+    return std::binary_search(ids.begin(), ids.end(), c.id());
+  });
+  if (!ids.empty() &&
+      !FileManager::saveDeck(deck, FileManager::deckDirectory())) {
+    std::cerr << "Could not save " << args[0] << "\n";
+    return 1;
+  }
+  std::cout << "Deleted " << ids.size() << " cards from " << args[0] << "\n";
+  return 0;
+}
+
+int CLI::rescheduleCommand(const std::string &cmd,
+                           const std::vector<std::string> &args) {
+  size_t fixed = cmd == "reset" ? 1 : 2;
+  if (args.size() < fixed || args.size() > fixed + 1)
+    return usage();
+  double value = 0;
+  if (cmd == "shift" && !parseNumber(args[1], -36500, 36500, value))
+    return usage();
+  if (cmd == "ease" && !parseNumber(args[1], 1.3, 65, value))
+    return usage();
+  auto deck = openDeck(args[0]);
+  if (!deck) {
+    std::cerr << "No such deck: " << args[0] << "\n";
+    return 1;
+  }
+
+  time_t now = std::time(nullptr);
+  auto apply = [&](const auto &filter) -> size_t {
+    if (cmd == "shift")
+      return deck->reschedule(
+          BatchScheduler::ShiftDue((time_t)(value * 24 * 60 * 60), now),
+          filter);
+    if (cmd == "ease")
+      return deck->reschedule(BatchScheduler::SetEase(value, now), filter);
+    return deck->reschedule(BatchScheduler::ResetProgress(now), filter);
+  };
+  size_t changed = args.size() > fixed
+                       ? apply(BatchScheduler::WithTag(args[fixed]))
+                       : apply(BatchScheduler::AllCards());
+  if (changed && !FileManager::saveDeck(deck, FileManager::deckDirectory())) {
+    std::cerr << "Could not save " << args[0] << "\n";
+    return 1;
+  }
+  std::cout << "Rescheduled " << changed << " of " << deck->size()
+            << " cards\n";
+  return 0;
+}
+
+int CLI::ankiCommand(const std::vector<std::string> &args) {
+  AnkiImport::Options options;
+  if (args.size() == 3 && args[2] == "--keep-intervals")
+    options.keepIntervals = true;
+  else if (args.size() != 2)
+    return usage();
+  auto deck = openDeck(args[1]);
+  if (!deck)
+    deck = std::make_shared<Deck>(args[1]);
+
+  AnkiImport::Result result;
+  if (!AnkiImport::import(*deck, args[0], options, result)) {
+    std::cerr << "Import failed: " << result.error << "\n";
+    return 1;
+  }
+  if (!FileManager::saveDeck(deck, FileManager::deckDirectory())) {
+    std::cerr << "Could not save " << args[1] << "\n";
+    return 1;
+  }
+  std::cout << "Imported " << result.cards << " cards into " << args[1]
+            << " (" << result.reviews << " reviews, " << result.skipped
+            << " skipped)\n";
+  return 0;
+}
+
+int CLI::metricsCommand() {
+  std::string dir = Metrics::exportDirectory(FileManager::deckDirectory());
+  std::vector<std::string> files;
+  std::error_code ec;
+  for (auto &e : std::filesystem::directory_iterator(dir, ec)) {
+    if (e.path().extension() == ".prom")
+      files.push_back(e.path().string());
+  }
+  if (files.empty()) {
+    std::cerr << "No metrics in " << dir
+              << "; they are written while the UI or server runs\n";
+    return 1;
+  }
+  std::sort(files.begin(), files.end());
+  for (auto &f : files) {
+    std::ifstream fin(f);
+    std::cout << fin.rdbuf();
+  }
+  return 0;
+}
+
+int CLI::syncCommand(const std::vector<std::string> &args) {
+  if (args.empty() || args.size() > 2)
+    return usage();
+  std::string a = args.size() == 2 ? args[0] : FileManager::deckDirectory();
+  DeckSync::Result r;
+  std::string error;
+  if (!DeckSync::syncDirectories(a, args.back(), r, error)) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+  std::cout << "Synced " << r.decks << " decks, copied " << r.decksCopied
+            << "\n"
+            << "Cards taken: " << r.toA << " into " << a << ", " << r.toB
+            << " into " << args.back() << " (" << r.ties
+            << " equal stamps settled by content)\n"
+            << "Segments: " << r.segmentsSkipped << " equal, "
+            << r.segmentsRead << " compared; " << r.cardsWritten
+            << " cards written\n";
+  for (auto &name : r.failed)
+    std::cerr << "Could not sync " << name << "\n";
+  return r.failed.empty() ? 0 : 1;
+}
+
+int CLI::backupCommand(const std::string &cmd,
+                       const std::vector<std::string> &args) {
+  std::string error;
+  if (cmd == "backup" && args.size() == 1) {
+    Backup::Result r;
+    auto start = std::chrono::steady_clock::now();
+    if (!Backup::create(FileManager::deckDirectory(), args[0], r, error)) {
+      std::cerr << error << "\n";
+      return 1;
+    }
+    double secs = std::chrono::duration<double>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+    std::cout << "Snapshot " << r.snapshot << ": " << r.files << " files, "
+              << r.bytes / 1024 << " KiB\n"
+              << "Read " << r.filesRead << " new or changed files ("
+              << r.bytesRead / 1024 << " KiB, " << r.chunks << " chunks)\n"
+              << "Stored " << r.newChunks << " new chunks ("
+              << r.bytesStored / 1024 << " KiB) in " << std::fixed
+              << std::setprecision(2) << secs << " s\n";
+    return 0;
+  }
+  if (cmd == "snapshots" && args.size() == 1) {
+    for (auto &name : Backup::list(args[0])) {
+      size_t files = 0;
+      uintmax_t bytes = 0;
+      if (Backup::describe(args[0], name, files, bytes))
+        std::cout << name << "  " << files << " files, " << bytes / 1024
+                  << " KiB\n";
+    }
+    return 0;
+  }
+  if (cmd == "restore" && args.size() == 3) {
+    if (!Backup::restore(args[0], args[1], args[2], error)) {
+      std::cerr << error << "\n";
+      return 1;
+    }
+    std::cout << "Restored " << args[1] << " into " << args[2] << "\n";
+    return 0;
+  }
+  return usage();
+}
+
+std::string CLI::deckPath(const std::string &name) {
+  std::string dir = FileManager::deckDirectory();
+  std::string path = (std::filesystem::path(dir) / (name + ".deck")).string();
+  std::error_code ec;
+  if (std::filesystem::exists(path, ec))
+    return path;
+  // a file named apart from its deck, as far as the manifest knows
+  for (auto &s : DeckManifest::load(dir)) {
+    if (s.name == name && std::filesystem::exists(s.path, ec))
+      return s.path;
+  }
+  return "";
+}
+
+std::shared_ptr<Deck> CLI::openDeck(const std::string &name) {
+  std::string path = deckPath(name);
+  auto deck = path.empty() ? nullptr : FileManager::loadDeck(path);
+  if (!deck)
+    return nullptr;
+
+  // refresh this deck's manifest entry only, so the UI need not parse it
+  std::string dir = FileManager::deckDirectory();
+  auto entries = DeckManifest::load(dir);
+  auto it = std::find_if(entries.begin(), entries.end(),
+                         [&](const DeckSummary &s) { return s.path == path; });
+  if (it == entries.end() || !DeckManifest::isCurrent(*it)) {
+    DeckSummary fresh = DeckManifest::summarize(*deck, path);
+    if (it == entries.end())
+      entries.push_back(fresh);
+    else
+      *it = fresh;
+    DeckManifest::save(dir, entries);
+  }
+  return deck;
+}
+
+std::vector<std::shared_ptr<Deck>> CLI::openAllDecks() {
+  std::vector<std::shared_ptr<Deck>> decks;
+  auto paths = FileManager::listDeckFiles(FileManager::deckDirectory());
+  for (auto &d : DeckIO::loadAll(paths)) {
+    if (d)
+      decks.push_back(d);
+  }
+  return decks;
+}
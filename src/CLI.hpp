@@ -0,0 +1,45 @@
+#ifndef TANKI_CLI_HPP
+#define TANKI_CLI_HPP
+
+#include "Deck.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Non-interactive commands: `Tanki <command> [args...]`.
+ * Runs without ncurses, so it can be used from scripts and cron.
+ */
+class CLI {
+public:
+  static int run(int argc, char **argv);
+
+private:
+  static int usage();
+  static int memCommand(const std::vector<std::string> &args);
+  static int mergeCommand(const std::vector<std::string> &args);
+  static int splitCommand(const std::vector<std::string> &args);
+  static int dupsCommand(const std::vector<std::string> &args);
+  static int ankiCommand(const std::vector<std::string> &args);
+  static int metricsCommand();
+  static int syncCommand(const std::vector<std::string> &args);
+  // backup, snapshots and restore
+  static int backupCommand(const std::string &cmd,
+                           const std::vector<std::string> &args);
+  // find and delete: cards matching a CardQuery
+  static int queryCommand(const std::string &cmd,
+                          const std::vector<std::string> &args);
+  // shift, ease and reset: batch rescheduling of a deck or one tag
+  static int rescheduleCommand(const std::string &cmd,
+                               const std::vector<std::string> &args);
+
+  // File of the deck with this name: <dir>/<name>.deck, or the
+  // manifest's entry for it; empty if there is none
+  static std::string deckPath(const std::string &name);
+  // Load a deck from the deck directory by its name, reading only its
+  // own file
+  static std::shared_ptr<Deck> openDeck(const std::string &name);
+  static std::vector<std::shared_ptr<Deck>> openAllDecks();
+};
+
+#endif // TANKI_CLI_HPP
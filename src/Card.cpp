@@ -1,80 +1,288 @@
 #include "Card.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
-static int globalId = 0;
+static std::atomic<int> globalId{0};
 
 static int genId() { return ++globalId; }
 
-Card::Card()
-    : _id(genId()), _front(""), _back(""), _dueDate(std::time(nullptr)),
-      _suspended(false), _interval(0), _easeFactor(2.5), _lastRating(0) {}
+// Recall times: longest single measurement counted, and the weight of
+// the newest one in the running average
+static const double RECALL_CAP = 60.0;
+static const double RECALL_WEIGHT = 0.3;
 
-Card::Card(const std::string &front, const std::string &back)
-    : _id(genId()), _front(front), _back(back), _dueDate(std::time(nullptr)),
-      _suspended(false), _interval(0), _easeFactor(2.5), _lastRating(0) {}
+static_assert(sizeof(void *) != 8 || sizeof(Card) == 48,
+              "Card grew; decks are held in memory card by card");
+
+// Process-wide tag table: tag name <-> small integer id
+namespace {
+struct TagTable {
+  std::mutex mutex;
+  std::deque<std::string> names;
+  std::unordered_map<std::string, uint32_t> ids;
+  size_t bytes = 0;
+
+  uint32_t intern(const std::string &name) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = ids.find(name);
+    if (it != ids.end())
+      return it->second;
+    uint32_t id = (uint32_t)names.size();
+    names.push_back(name);
+    ids.emplace(name, id);
+    bytes += 2 * (sizeof(std::string) + name.size()) + 16;
+    return id;
+  }
+
+  bool find(const std::string &name, uint32_t &id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = ids.find(name);
+    if (it == ids.end())
+      return false;
+    id = it->second;
+    return true;
+  }
+
+  std::string name(uint32_t id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return names[id];
+  }
+};
+
+TagTable &tagTable() {
+  static TagTable table;
+  return table;
+}
+} // namespace
+
+Card::Card() : Card("", "") {}
+
+Card::Card(std::string_view front, std::string_view back)
+    : _sched{std::time(nullptr), 0, 0, 2500, 0, 0}, _id(genId()),
+      _frontLen(0), _backLen(0), _tagCount(0), _recall(0) {
+  rebuild(front, back, nullptr, 0);
+}
+
+Card::Card(const Card &o)
+    : _sched(o._sched), _id(o._id), _frontLen(o._frontLen),
+      _backLen(o._backLen), _tagCount(o._tagCount), _recall(o._recall) {
+  size_t n = o.heapBytes();
+  if (n) {
+    _data.reset(new char[n]);
+    std::memcpy(_data.get(), o._data.get(), n);
+  }
+}
+
+Card::Card(Card &&o) noexcept
+    : _data(std::move(o._data)), _sched(o._sched), _id(o._id),
+      _frontLen(o._frontLen), _backLen(o._backLen), _tagCount(o._tagCount),
+      _recall(o._recall) {
+  o._frontLen = o._backLen = 0;
+  o._tagCount = 0;
+}
+
+Card &Card::operator=(const Card &o) {
+  if (this != &o) {
+    Card copy(o);
+    *this = std::move(copy);
+  }
+  return *this;
+}
+
+Card &Card::operator=(Card &&o) noexcept {
+  if (this != &o) {
+    _data = std::move(o._data);
+    _sched = o._sched;
+    _id = o._id;
+    _frontLen = o._frontLen;
+    _backLen = o._backLen;
+    _tagCount = o._tagCount;
+    _recall = o._recall;
+    o._frontLen = o._backLen = 0;
+    o._tagCount = 0;
+  }
+  return *this;
+}
 
 Card::~Card() {}
 
+// The views and tag bytes may point into the current block; it is only
+// released after everything has been copied.
+void Card::rebuild(std::string_view front, std::string_view back,
+                   const void *tags, size_t tagCount) {
+  size_t n = front.size() + back.size() + tagCount * sizeof(uint32_t);
+  std::unique_ptr<char[]> data(n ? new char[n] : nullptr);
+  char *p = data.get();
+  if (!front.empty())
+    std::memcpy(p, front.data(), front.size());
+  p += front.size();
+  if (!back.empty())
+    std::memcpy(p, back.data(), back.size());
+  p += back.size();
+  if (tagCount)
+    std::memcpy(p, tags, tagCount * sizeof(uint32_t));
+  _data = std::move(data);
+  _frontLen = (uint32_t)front.size();
+  _backLen = (uint32_t)back.size();
+  _tagCount = (uint16_t)tagCount;
+}
+
+uint32_t Card::tagAt(size_t i) const {
+  uint32_t id;
+  std::memcpy(&id, _data.get() + _frontLen + _backLen + i * sizeof(uint32_t),
+              sizeof(uint32_t));
+  return id;
+}
+
 int Card::id() const { return _id; }
 
-const std::string &Card::front() const { return _front; }
+std::string_view Card::front() const {
+  return std::string_view(_data.get(), _frontLen);
+}
 
-const std::string &Card::back() const { return _back; }
+std::string_view Card::back() const {
+  return std::string_view(_data.get() + _frontLen, _backLen);
+}
 
-time_t Card::dueDate() const { return _dueDate; }
-void Card::setDueDate(time_t t) { _dueDate = t; }
+time_t Card::dueDate() const { return _sched.due; }
+void Card::setDueDate(time_t t) { _sched.due = t; }
 
-bool Card::isSuspended() const { return _suspended; }
-void Card::setSuspended(bool s) { _suspended = s; }
+bool Card::isSuspended() const { return _sched.flags & Schedule::Suspended; }
+void Card::setSuspended(bool s) {
+  if (s)
+    _sched.flags |= Schedule::Suspended;
+  else
+    _sched.flags &= ~Schedule::Suspended;
+}
 
-int Card::interval() const { return _interval; }
-void Card::setInterval(int i) { _interval = i; }
+int Card::interval() const { return _sched.interval; }
+void Card::setInterval(int i) { _sched.interval = i; }
 
-double Card::easeFactor() const { return _easeFactor; }
-void Card::setEaseFactor(double e) { _easeFactor = e; }
+double Card::easeFactor() const { return _sched.ease / 1000.0; }
+void Card::setEaseFactor(double e) {
+  e = std::max(0.0, std::min(e, 65.0));
+  _sched.ease = (uint16_t)std::lround(e * 1000.0);
+}
+
+int Card::lastRating() const { return _sched.lastRating; }
+void Card::setLastRating(int r) { _sched.lastRating = (uint8_t)r; }
+
+time_t Card::modified() const { return _sched.modified; }
+void Card::setModified(time_t t) { _sched.modified = t; }
+
+double Card::recallTime() const { return _recall / 10.0; }
 
-int Card::lastRating() const { return _lastRating; }
-void Card::setLastRating(int r) { _lastRating = r; }
+void Card::setRecallTime(double seconds) {
+  seconds = std::max(0.0, std::min(seconds, 6553.5));
+  _recall = (uint16_t)std::lround(seconds * 10.0);
+}
+
+void Card::addRecallTime(double seconds) {
+  // a card left on screen while the user was away says little about it
+  seconds = std::min(seconds, RECALL_CAP);
+  if (_recall == 0)
+    setRecallTime(seconds);
+  else
+    setRecallTime(recallTime() + RECALL_WEIGHT * (seconds - recallTime()));
+  if (_recall == 0)
+    _recall = 1; // timed, however fast
+}
 
-void Card::setFront(const std::string &f) { _front = f; }
-void Card::setBack(const std::string &b) { _back = b; }
+void Card::copySchedulingFrom(const Card &o) {
+  _sched = o._sched;
+  _recall = o._recall;
+}
+
+Card::Schedule &Card::schedule() { return _sched; }
+const Card::Schedule &Card::schedule() const { return _sched; }
+
+void Card::setFront(std::string_view f) {
+  rebuild(f, back(), _data.get() + _frontLen + _backLen, _tagCount);
+}
+
+void Card::setBack(std::string_view b) {
+  rebuild(front(), b, _data.get() + _frontLen + _backLen, _tagCount);
+}
 
 void Card::setTags(const std::string &tagString) {
-  _tags.clear();
+  // split on ',' and trim; kept sorted by name and unique
+  std::vector<std::string> names;
   size_t start = 0;
-  while (true) {
+  while (start <= tagString.size()) {
     size_t pos = tagString.find(',', start);
-    if (pos == std::string::npos) {
-      std::string t = tagString.substr(start);
-      if (!t.empty()) {
-        // trim
-        t.erase(0, t.find_first_not_of(" \t"));
-        t.erase(t.find_last_not_of(" \t") + 1);
-        if (!t.empty())
-          _tags.insert(t);
-      }
-      break;
-    } else {
-      std::string t = tagString.substr(start, pos - start);
-      t.erase(0, t.find_first_not_of(" \t"));
-      t.erase(t.find_last_not_of(" \t") + 1);
-      if (!t.empty())
-        _tags.insert(t);
-      start = pos + 1;
-    }
+    if (pos == std::string::npos)
+      pos = tagString.size();
+    std::string t = tagString.substr(start, pos - start);
+    t.erase(0, t.find_first_not_of(" \t"));
+    t.erase(t.find_last_not_of(" \t") + 1);
+    if (!t.empty())
+      names.push_back(t);
+    start = pos + 1;
   }
+  std::sort(names.begin(), names.end());
+  names.erase(std::unique(names.begin(), names.end()), names.end());
+
+  std::vector<uint32_t> tags;
+  for (auto &n : names)
+    tags.push_back(tagTable().intern(n));
+  rebuild(front(), back(), tags.data(), tags.size());
 }
 
 bool Card::hasTag(const std::string &tag) const {
-  return _tags.find(tag) != _tags.end();
+  uint32_t id;
+  if (!_tagCount || !tagTable().find(tag, id))
+    return false;
+  for (size_t i = 0; i < _tagCount; i++) {
+    if (tagAt(i) == id)
+      return true;
+  }
+  return false;
 }
+
+bool Card::hasTagId(uint32_t id) const {
+  for (size_t i = 0; i < _tagCount; i++) {
+    if (tagAt(i) == id)
+      return true;
+  }
+  return false;
+}
+
+bool Card::findTag(const std::string &tag, uint32_t &id) {
+  return tagTable().find(tag, id);
+}
+
 std::string Card::tagsString() const {
   std::string out;
-  for (auto &t : _tags) {
+  for (size_t i = 0; i < _tagCount; i++) {
     if (!out.empty())
       out += ", ";
-    out += t;
+    out += tagTable().name(tagAt(i));
   }
   return out;
 }
+
+size_t Card::tagCount() const { return _tagCount; }
+
+size_t Card::textBytes() const { return _frontLen + _backLen; }
+
+size_t Card::heapBytes() const {
+  return _frontLen + _backLen + _tagCount * sizeof(uint32_t);
+}
+
+size_t Card::tagTableSize() {
+  std::lock_guard<std::mutex> lock(tagTable().mutex);
+  return tagTable().names.size();
+}
+
+size_t Card::tagTableBytes() {
+  std::lock_guard<std::mutex> lock(tagTable().mutex);
+  return tagTable().bytes;
+}
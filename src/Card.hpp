@@ -1,19 +1,44 @@
 #ifndef TANKI_CARD_HPP
 #define TANKI_CARD_HPP
 
+#include <cstdint>
 #include <ctime>
-#include <set>
+#include <memory>
 #include <string>
+#include <string_view>
 
+/**
+ * One flashcard, laid out to keep a loaded deck close to its text size:
+ * - front, back and tag ids share a single heap block
+ * - tags are ids into a process-wide tag table
+ * - ease is stored in thousandths, rating and flags in a byte each
+ * - the scheduling fields form one block (Schedule) that batch
+ *   rescheduling works on directly
+ * - the recall time fills what would otherwise be padding
+ */
 class Card {
 public:
+  struct Schedule {
+    static constexpr uint8_t Suspended = 1;
+    time_t due;
+    time_t modified; // 0 = never reviewed
+    int32_t interval;
+    uint16_t ease; // ease factor * 1000
+    uint8_t lastRating;
+    uint8_t flags;
+  };
+
   Card();
-  Card(const std::string &front, const std::string &back);
+  Card(std::string_view front, std::string_view back);
+  Card(const Card &o);
+  Card(Card &&o) noexcept;
+  Card &operator=(const Card &o);
+  Card &operator=(Card &&o) noexcept;
   ~Card();
 
   int id() const;
-  const std::string &front() const;
-  const std::string &back() const;
+  std::string_view front() const;
+  std::string_view back() const;
 
   time_t dueDate() const;
   void setDueDate(time_t t);
@@ -30,24 +55,55 @@ public:
   int lastRating() const;
   void setLastRating(int r);
 
-  void setFront(const std::string &f);
-  void setBack(const std::string &b);
+  // When the scheduling state last changed (0 = never reviewed)
+  time_t modified() const;
+  void setModified(time_t t);
+
+  // Average time from seeing the front to flipping the card, in seconds;
+  // 0 until the card has been timed. Kept to a tenth of a second.
+  double recallTime() const;
+  void setRecallTime(double seconds);
+  // Fold one measured time into the average. Does not touch modified().
+  void addRecallTime(double seconds);
+
+  // Take due date, interval, ease, rating, suspension, stamp and recall
+  // time from o
+  void copySchedulingFrom(const Card &o);
+  Schedule &schedule();
+  const Schedule &schedule() const;
+
+  void setFront(std::string_view f);
+  void setBack(std::string_view b);
 
   void setTags(const std::string &tags);
   bool hasTag(const std::string &tag) const;
+  // Same, with the id from findTag (no tag table lookup per card)
+  bool hasTagId(uint32_t id) const;
+  static bool findTag(const std::string &tag, uint32_t &id);
   std::string tagsString() const;
+  size_t tagCount() const;
+
+  // Bytes of card text, and of the whole heap block (text + tag ids)
+  size_t textBytes() const;
+  size_t heapBytes() const;
+
+  // Entries and approximate bytes of the shared tag table
+  static size_t tagTableSize();
+  static size_t tagTableBytes();
 
 private:
+  // [front][back][tag ids (uint32, unaligned)]
+  std::unique_ptr<char[]> _data;
+  Schedule _sched;
   int _id;
-  std::string _front;
-  std::string _back;
-  time_t _dueDate;
-  bool _suspended;
-  int _interval;
-  double _easeFactor;
-  int _lastRating;
-
-  std::set<std::string> _tags;
+  uint32_t _frontLen;
+  uint32_t _backLen;
+  uint16_t _tagCount;
+  uint16_t _recall; // tenths of a second
+
+  void rebuild(std::string_view front, std::string_view back,
+               const void *tags, size_t tagCount);
+  uint32_t tagAt(size_t i) const;
 };
 
 #endif // TANKI_CARD_HPP
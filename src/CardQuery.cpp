@@ -0,0 +1,317 @@
+#include "CardQuery.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+
+static char lower(char ch) { return (char)std::tolower((unsigned char)ch); }
+
+static std::string lowered(std::string_view s) {
+  std::string out(s);
+  std::transform(out.begin(), out.end(), out.begin(), lower);
+  return out;
+}
+
+// `needle` is already lowercase
+static bool containsNoCase(std::string_view hay, const std::string &needle) {
+  auto it = std::search(hay.begin(), hay.end(), needle.begin(), needle.end(),
+                        [](char a, char b) { return lower(a) == b; });
+  return it != hay.end();
+}
+
+static bool equalsNoCase(std::string_view s, const std::string &lowerText) {
+  return s.size() == lowerText.size() &&
+         std::equal(s.begin(), s.end(), lowerText.begin(),
+                    [](char a, char b) { return lower(a) == b; });
+}
+
+bool CardQuery::parse(const std::string &text, CardQuery &out,
+                      std::string &error) {
+  CardQuery q;
+  q._text = text;
+  time_t now = std::time(nullptr);
+
+  // split on spaces outside double quotes; the quotes are dropped
+  std::vector<std::string> words(1);
+  bool quoted = false;
+  for (char ch : text) {
+    if (ch == '"')
+      quoted = !quoted;
+    else if (ch == ' ' && !quoted)
+      words.emplace_back();
+    else
+      words.back() += ch;
+  }
+  if (quoted) {
+    error = "unbalanced quote";
+    return false;
+  }
+  for (auto &w : words) {
+    if (w.empty())
+      continue;
+    Term t;
+    if (!parseTerm(w, now, t, error))
+      return false;
+    q._terms.push_back(t);
+  }
+  out = q;
+  return true;
+}
+
+bool CardQuery::parseTerm(std::string_view word, time_t now, Term &t,
+                          std::string &error) {
+  if (word.size() > 1 && word[0] == '-') {
+    t.negate = true;
+    word.remove_prefix(1);
+  }
+  size_t pos = word.find_first_of(":<>=");
+  std::string key = lowered(word.substr(0, pos));
+  if (pos == std::string_view::npos) {
+    if (key == "suspended") {
+      t.field = Suspended;
+    } else if (key == "due") {
+      t.field = Due;
+      t.op = LessEq;
+      t.number = now;
+    } else {
+      t.field = Text;
+      t.op = Contains;
+      t.text = key;
+      t.cost = 8;
+    }
+    return true;
+  }
+
+  std::string_view value = word.substr(pos + 1);
+  if (word[pos] == ':') {
+    if (key == "tag") {
+      t.field = Tag;
+      t.text = std::string(value);
+      t.knownTag = Card::findTag(t.text, t.tag);
+      t.cost = 2;
+    } else if (key == "front" || key == "back") {
+      t.field = key == "front" ? Front : Back;
+      t.op = Equal;
+      if (!value.empty() && value[0] == '~') {
+        t.op = Contains;
+        value.remove_prefix(1);
+      }
+      t.text = lowered(value);
+      t.cost = 8;
+    } else {
+      error = "unknown field in \"" + std::string(word) + "\"";
+      return false;
+    }
+    return true;
+  }
+
+  if (value.substr(0, 1) == "=") {
+    t.op = word[pos] == '<' ? LessEq : word[pos] == '>' ? GreaterEq : Equal;
+    value.remove_prefix(1);
+  } else {
+    t.op = word[pos] == '<' ? Less : word[pos] == '>' ? Greater : Equal;
+  }
+  std::string v(value);
+  char *end = nullptr;
+  double n = std::strtod(v.c_str(), &end);
+  bool ok = end != v.c_str();
+  if (key == "due") {
+    t.field = Due;
+    static const std::string units = "mhdw";
+    static const double seconds[] = {60, 3600, 86400, 604800};
+    size_t unit = *end ? units.find(*end++) : 2;
+    ok = ok && unit != std::string::npos;
+    t.number = now + (int64_t)std::llround(n * seconds[ok ? unit : 0]);
+  } else if (key == "ease") {
+    t.field = Ease;
+    t.number = std::llround(n * 1000);
+  } else if (key == "ivl" || key == "interval") {
+    t.field = Interval;
+    t.number = std::llround(n);
+  } else if (key == "rating") {
+    t.field = Rating;
+    t.number = std::llround(n);
+  } else if (key == "time") {
+    t.field = Recall;
+    t.number = std::llround(n * 10);
+  } else {
+    error = "unknown field in \"" + std::string(word) + "\"";
+    return false;
+  }
+  if (!ok || *end) {
+    error = "bad value in \"" + std::string(word) + "\"";
+    return false;
+  }
+  return true;
+}
+
+const std::string &CardQuery::text() const { return _text; }
+
+bool CardQuery::empty() const { return _terms.empty(); }
+
+bool CardQuery::matches(const Card &c) const {
+  for (auto &t : _terms) {
+    if (!test(t, c))
+      return false;
+  }
+  return true;
+}
+
+bool CardQuery::test(const Term &t, const Card &c) {
+  const Card::Schedule &s = c.schedule();
+  int64_t v = 0;
+  bool r = false;
+  switch (t.field) {
+  case Tag:
+    r = t.knownTag ? c.hasTagId(t.tag) : c.hasTag(t.text);
+    return r != t.negate;
+  case Suspended:
+    r = s.flags & Card::Schedule::Suspended;
+    return r != t.negate;
+  case Front:
+  case Back: {
+    std::string_view f = t.field == Front ? c.front() : c.back();
+    r = t.op == Contains ? containsNoCase(f, t.text) : equalsNoCase(f, t.text);
+    return r != t.negate;
+  }
+  case Text:
+    r = containsNoCase(c.front(), t.text) || containsNoCase(c.back(), t.text);
+    return r != t.negate;
+  case Due:
+    v = s.due;
+    break;
+  case Ease:
+    v = s.ease;
+    break;
+  case Interval:
+    v = s.interval;
+    break;
+  case Rating:
+    v = s.lastRating;
+    break;
+  case Recall:
+    v = std::lround(c.recallTime() * 10);
+    break;
+  }
+  switch (t.op) {
+  case Less:
+    r = v < t.number;
+    break;
+  case LessEq:
+    r = v <= t.number;
+    break;
+  case Greater:
+    r = v > t.number;
+    break;
+  case GreaterEq:
+    r = v >= t.number;
+    break;
+  default:
+    r = v == t.number;
+    break;
+  }
+  return r != t.negate;
+}
+
+/**
+ * Estimate how often each term passes on a sample of the deck, then run
+ * terms by cost / (1 - pass rate): cheap terms that reject most cards
+ * first, so the expensive text terms see only what is left.
+ */
+std::vector<CardQuery::Term> CardQuery::plan(const Deck &deck) const {
+  const size_t samples = std::min<size_t>(deck.size(), 512);
+  std::vector<Term> terms = _terms;
+  std::vector<std::pair<double, size_t>> ranked;
+  for (size_t i = 0; i < terms.size(); i++) {
+    // a tag unknown at parse time may have been loaded since
+    if (terms[i].field == Tag && !terms[i].knownTag)
+      terms[i].knownTag = Card::findTag(terms[i].text, terms[i].tag);
+    size_t passed = 0;
+    for (size_t k = 0; k < samples; k++) {
+      if (test(terms[i], deck.at(k * deck.size() / samples)))
+        passed++;
+    }
+    double rate = samples ? (double)passed / samples : 0;
+    ranked.push_back({terms[i].cost / std::max(1 - rate, 1e-3), i});
+  }
+  std::stable_sort(ranked.begin(), ranked.end());
+  std::vector<Term> ordered;
+  for (auto &r : ranked)
+    ordered.push_back(terms[r.second]);
+  return ordered;
+}
+
+std::vector<int> CardQuery::select(const Deck &deck) const {
+  std::vector<const Card *> sel;
+  sel.reserve(deck.size());
+  for (size_t i = 0, n = deck.size(); i < n; i++)
+    sel.push_back(&deck.at(i));
+  for (auto &t : plan(deck))
+    narrow(sel, t);
+  std::vector<int> ids;
+  ids.reserve(sel.size());
+  for (auto *c : sel)
+    ids.push_back(c->id());
+  return ids;
+}
+
+// Keep the cards pred accepts, in order, without a branch per card
+template <typename Pred>
+static void compact(std::vector<const Card *> &sel, Pred pred) {
+  size_t n = 0;
+  for (const Card *c : sel) {
+    sel[n] = c;
+    n += pred(*c);
+  }
+  sel.resize(n);
+}
+
+template <typename Get>
+static void compare(std::vector<const Card *> &sel, int op, int64_t v,
+                    bool negate, Get get) {
+  switch (op) {
+  case 0:
+    return compact(sel, [&](const Card &c) { return (get(c) < v) != negate; });
+  case 1:
+    return compact(sel,
+                   [&](const Card &c) { return (get(c) <= v) != negate; });
+  case 2:
+    return compact(sel, [&](const Card &c) { return (get(c) > v) != negate; });
+  case 3:
+    return compact(sel,
+                   [&](const Card &c) { return (get(c) >= v) != negate; });
+  default:
+    return compact(sel,
+                   [&](const Card &c) { return (get(c) == v) != negate; });
+  }
+}
+
+/**
+ * Apply one term to the whole selection, so each pass runs a loop
+ * specialised for one field and operator.
+ */
+void CardQuery::narrow(std::vector<const Card *> &sel, const Term &t) {
+  static_assert(Less == 0 && LessEq == 1 && Greater == 2 && GreaterEq == 3,
+                "compare() numbers the operators");
+  switch (t.field) {
+  case Due:
+    return compare(sel, t.op, t.number, t.negate, [](const Card &c) {
+      return (int64_t)c.schedule().due;
+    });
+  case Ease:
+    return compare(sel, t.op, t.number, t.negate,
+                   [](const Card &c) { return c.schedule().ease; });
+  case Interval:
+    return compare(sel, t.op, t.number, t.negate,
+                   [](const Card &c) { return c.schedule().interval; });
+  case Rating:
+    return compare(sel, t.op, t.number, t.negate,
+                   [](const Card &c) { return c.schedule().lastRating; });
+  case Recall:
+    return compare(sel, t.op, t.number, t.negate, [](const Card &c) {
+      return std::lround(c.recallTime() * 10);
+    });
+  default:
+    return compact(sel, [&](const Card &c) { return test(t, c); });
+  }
+}
@@ -0,0 +1,82 @@
+#ifndef TANKI_CARDQUERY_HPP
+#define TANKI_CARDQUERY_HPP
+
+#include "Deck.hpp"
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Card filter, e.g. `tag:verbs due<3d ease<2.0 -suspended front:~ing`.
+ * Terms are separated by spaces and must all hold; a leading '-'
+ * negates one. Values may be quoted ("two words").
+ *   tag:NAME              has the tag
+ *   due<3d  due>=-1w      due before/after now + duration (m, h, d, w)
+ *   due                   due now
+ *   ease<2.0  ivl>=21  rating<3  time>5
+ *                         ease factor, interval in days, last rating,
+ *                         average seconds to recall (0 = never timed)
+ *                         (operators < <= > >= =)
+ *   suspended
+ *   front:TEXT back:TEXT  field equals TEXT (ignoring case);
+ *                         front:~TEXT contains it
+ *   TEXT                  front or back contains TEXT
+ * Parsed once; select() orders the terms for each deck so the cheapest,
+ * most selective ones run first and rule most cards out.
+ */
+class CardQuery {
+public:
+  // Parse `text`; on failure `error` says which term is wrong
+  static bool parse(const std::string &text, CardQuery &out,
+                    std::string &error);
+
+  // The query as given; an empty query matches every card
+  const std::string &text() const;
+  bool empty() const;
+
+  bool matches(const Card &c) const;
+  // Ids of the matching cards, in deck order
+  std::vector<int> select(const Deck &deck) const;
+
+private:
+  enum Field {
+    Tag,
+    Due,
+    Ease,
+    Interval,
+    Rating,
+    Recall,
+    Suspended,
+    Front,
+    Back,
+    Text
+  };
+  enum Op { Less, LessEq, Greater, GreaterEq, Equal, Contains };
+
+  struct Term {
+    Field field = Text;
+    Op op = Equal;
+    bool negate = false;
+    int64_t number = 0; // due as a time, ease * 1000, days, rating,
+                        // recall in tenths of a second
+    uint32_t tag = 0;
+    bool knownTag = false;
+    std::string text; // lowercased, or the tag name
+    double cost = 1;  // relative cost of testing one card
+  };
+
+  std::string _text;
+  std::vector<Term> _terms;
+
+  static bool parseTerm(std::string_view word, time_t now, Term &t,
+                        std::string &error);
+  static bool test(const Term &t, const Card &c);
+  // Drop the cards t rejects from sel
+  static void narrow(std::vector<const Card *> &sel, const Term &t);
+  // Terms in evaluation order for this deck
+  std::vector<Term> plan(const Deck &deck) const;
+};
+
+#endif // TANKI_CARDQUERY_HPP
@@ -0,0 +1,132 @@
+#include "CardStore.hpp"
+#include <algorithm>
+
+CardStore::const_iterator &CardStore::const_iterator::operator++() {
+  if (++_offset >= _store->_chunks[_chunk]->size()) {
+    _chunk++;
+    _offset = 0;
+  }
+  return *this;
+}
+
+const Card &CardStore::operator[](size_t i) const {
+  size_t c = chunkOf(i);
+  return (*_chunks[c])[i - _starts[c]];
+}
+
+Card &CardStore::edit(size_t i) {
+  size_t c = chunkOf(i);
+  return own(c)[i - _starts[c]];
+}
+
+void CardStore::push_back(const Card &c) {
+  tail().push_back(c);
+  _size++;
+}
+
+void CardStore::push_back(Card &&c) {
+  tail().push_back(std::move(c));
+  _size++;
+}
+
+void CardStore::erase(size_t i) {
+  size_t c = chunkOf(i);
+  Chunk &chunk = own(c);
+  chunk.erase(chunk.begin() + (i - _starts[c]));
+  _size--;
+  if (chunk.empty()) {
+    _chunks.erase(_chunks.begin() + c);
+    _starts.erase(_starts.begin() + c);
+  }
+  restart(c);
+}
+
+void CardStore::clear() {
+  _chunks.clear();
+  _starts.clear();
+  _size = 0;
+}
+
+void CardStore::assign(std::vector<Card> &&cards) {
+  clear();
+  _chunks.reserve((cards.size() + ChunkCards - 1) / ChunkCards);
+  for (auto &c : cards)
+    push_back(std::move(c));
+  cards.clear();
+}
+
+std::vector<Card> CardStore::toVector() const {
+  std::vector<Card> out;
+  out.reserve(_size);
+  for (auto &chunk : _chunks)
+    out.insert(out.end(), chunk->begin(), chunk->end());
+  return out;
+}
+
+std::vector<Card> CardStore::release() {
+  std::vector<Card> out;
+  out.reserve(_size);
+  for (auto &chunk : _chunks) {
+    if (chunk.use_count() == 1)
+      std::move(chunk->begin(), chunk->end(), std::back_inserter(out));
+    else
+      out.insert(out.end(), chunk->begin(), chunk->end());
+  }
+  clear();
+  return out;
+}
+
+void CardStore::shrink_to_fit() {
+  bool packed = true;
+  for (size_t c = 0; c + 1 < _chunks.size(); c++)
+    packed = packed && _chunks[c]->size() == ChunkCards;
+  if (!packed)
+    assign(release());
+  if (!_chunks.empty() && _chunks.back().use_count() == 1)
+    _chunks.back()->shrink_to_fit();
+  _chunks.shrink_to_fit();
+  _starts.shrink_to_fit();
+}
+
+size_t CardStore::capacityBytes() const {
+  size_t bytes = _chunks.capacity() * (sizeof(std::shared_ptr<Chunk>) +
+                                       sizeof(size_t));
+  for (auto &chunk : _chunks)
+    bytes += sizeof(Chunk) + chunk->capacity() * sizeof(Card);
+  return bytes;
+}
+
+CardStore::Chunk &CardStore::own(size_t chunk) {
+  auto &p = _chunks[chunk];
+  if (p.use_count() > 1)
+    p = std::make_shared<Chunk>(*p);
+  return *p;
+}
+
+CardStore::Chunk &CardStore::tail() {
+  if (_chunks.empty() || _chunks.back()->size() >= ChunkCards) {
+    _chunks.push_back(std::make_shared<Chunk>());
+    _chunks.back()->reserve(ChunkCards);
+    _starts.push_back(_size);
+  }
+  return own(_chunks.size() - 1);
+}
+
+size_t CardStore::chunkOf(size_t i) const {
+  // chunks are full unless cards were erased from them
+  size_t guess = i / ChunkCards;
+  if (guess < _starts.size() && _starts[guess] <= i &&
+      i - _starts[guess] < _chunks[guess]->size())
+    return guess;
+  auto it = std::upper_bound(_starts.begin(), _starts.end(), i);
+  return (it - _starts.begin()) - 1;
+}
+
+void CardStore::restart(size_t fromChunk) {
+  size_t pos = fromChunk == 0 ? 0 : _starts[fromChunk - 1] +
+                                        _chunks[fromChunk - 1]->size();
+  for (size_t c = fromChunk; c < _chunks.size(); c++) {
+    _starts[c] = pos;
+    pos += _chunks[c]->size();
+  }
+}
@@ -0,0 +1,109 @@
+#ifndef TANKI_CARDSTORE_HPP
+#define TANKI_CARDSTORE_HPP
+
+#include "Card.hpp"
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+/**
+ * The cards of a deck, in order, kept in chunks that copies share.
+ * Copying a CardStore copies only the chunk table; a chunk is cloned the
+ * first time it is written through a store that shares it. A copy kept
+ * for undo therefore costs memory only for the chunks changed after it.
+ */
+class CardStore {
+  using Chunk = std::vector<Card>;
+
+public:
+  // Cards per chunk when appending
+  static constexpr size_t ChunkCards = 64;
+
+  class const_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Card;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Card *;
+    using reference = const Card &;
+
+    const_iterator(const CardStore *store, size_t chunk, size_t offset)
+        : _store(store), _chunk(chunk), _offset(offset) {}
+    reference operator*() const {
+      return (*_store->_chunks[_chunk])[_offset];
+    }
+    pointer operator->() const { return &**this; }
+    const_iterator &operator++();
+    bool operator==(const const_iterator &o) const {
+      return _chunk == o._chunk && _offset == o._offset;
+    }
+    bool operator!=(const const_iterator &o) const { return !(*this == o); }
+
+  private:
+    const CardStore *_store;
+    size_t _chunk;
+    size_t _offset;
+  };
+
+  size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+  const_iterator begin() const { return {this, 0, 0}; }
+  const_iterator end() const { return {this, _chunks.size(), 0}; }
+
+  const Card &operator[](size_t i) const;
+  // Writable access; unshares the card's chunk first
+  Card &edit(size_t i);
+
+  // Call f on each card matching pred, in order. Chunks are scanned
+  // read-only and only those with a match are unshared. Returns the
+  // number of cards passed to f.
+  template <typename Pred, typename F> size_t editIf(Pred &&pred, F &&f) {
+    size_t n = 0;
+    for (size_t c = 0; c < _chunks.size(); c++) {
+      const Chunk &chunk = *_chunks[c];
+      size_t first = 0;
+      while (first < chunk.size() && !pred(chunk[first]))
+        first++;
+      if (first == chunk.size())
+        continue;
+      Chunk &mine = own(c);
+      for (size_t i = first; i < mine.size(); i++) {
+        if (pred(mine[i])) {
+          f(mine[i]);
+          n++;
+        }
+      }
+    }
+    return n;
+  }
+
+  void push_back(const Card &c);
+  void push_back(Card &&c);
+  void erase(size_t i);
+  void clear();
+
+  // Replace the contents, taking the cards
+  void assign(std::vector<Card> &&cards);
+  std::vector<Card> toVector() const;
+  // Empty the store; cards are moved out of chunks nobody else holds
+  std::vector<Card> release();
+
+  // Repack into full chunks without spare capacity
+  void shrink_to_fit();
+  // Bytes of Card objects in the chunks (shared ones included)
+  size_t capacityBytes() const;
+
+private:
+  std::vector<std::shared_ptr<Chunk>> _chunks;
+  // position of the first card of each chunk
+  std::vector<size_t> _starts;
+  size_t _size = 0;
+
+  Chunk &own(size_t chunk);
+  Chunk &tail();
+  size_t chunkOf(size_t i) const;
+  void restart(size_t fromChunk);
+};
+
+#endif // TANKI_CARDSTORE_HPP
@@ -0,0 +1,271 @@
+#include "CompressedDeck.hpp"
+#include "FileManager.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+#ifdef TANKI_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+static const char MAGIC[] = "TANKIZ1\n";
+static const size_t MAGIC_LEN = 8;
+static const size_t BLOCK_BYTES = 32 * 1024;
+static const size_t DICT_BYTES = 32 * 1024; // deflate window size
+static const size_t BLOCK_ENTRY_BYTES = 4 + 4 + 8 + 4 + 4;
+
+static void putU32(std::string &out, uint32_t v) {
+  for (int i = 0; i < 4; i++)
+    out.push_back((char)((v >> (8 * i)) & 0xff));
+}
+
+static void putU64(std::string &out, uint64_t v) {
+  for (int i = 0; i < 8; i++)
+    out.push_back((char)((v >> (8 * i)) & 0xff));
+}
+
+static bool getU32(std::istream &in, uint32_t &v) {
+  unsigned char b[4];
+  if (!in.read((char *)b, 4))
+    return false;
+  v = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+  return true;
+}
+
+static bool getU64(std::istream &in, uint64_t &v) {
+  uint32_t lo, hi;
+  if (!getU32(in, lo) || !getU32(in, hi))
+    return false;
+  v = ((uint64_t)hi << 32) | lo;
+  return true;
+}
+
+bool CompressedDeck::available() {
+#ifdef TANKI_HAVE_ZLIB
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool CompressedDeck::isCompressed(const std::string &path) {
+  std::ifstream fin(path, std::ios::binary);
+  char buf[MAGIC_LEN];
+  if (!fin.read(buf, MAGIC_LEN))
+    return false;
+  return std::memcmp(buf, MAGIC, MAGIC_LEN) == 0;
+}
+
+std::string CompressedDeck::trainDictionary(const std::vector<Card> &cards,
+                                            size_t maxSize) {
+  // sample at most ~20k cards spread over the deck
+  size_t step = std::max<size_t>(1, cards.size() / 20000);
+  std::unordered_map<std::string, size_t> freq;
+  auto count = [&](std::string_view text) {
+    size_t i = 0;
+    while (i < text.size()) {
+      size_t j = text.find_first_of(" \t,.;:!?\"'()", i);
+      if (j == std::string::npos)
+        j = text.size();
+      if (j - i >= 3)
+        freq[std::string(text.substr(i, j - i + (j < text.size() ? 1 : 0)))]++;
+      i = j + 1;
+    }
+  };
+  for (size_t i = 0; i < cards.size(); i += step) {
+    count(cards[i].front());
+    count(cards[i].back());
+    count(cards[i].tagsString());
+  }
+
+  std::vector<std::pair<size_t, const std::string *>> ranked;
+  for (auto &kv : freq) {
+    if (kv.second > 1)
+      ranked.push_back({(kv.second - 1) * kv.first.size(), &kv.first});
+  }
+  std::sort(ranked.begin(), ranked.end(),
+            [](const auto &a, const auto &b) { return a.first > b.first; });
+
+  size_t used = 0, n = 0;
+  while (n < ranked.size() && used + ranked[n].second->size() <= maxSize)
+    used += ranked[n++].second->size();
+
+  std::string dict;
+  dict.reserve(used);
+  for (size_t i = n; i-- > 0;)
+    dict += *ranked[i].second;
+  return dict;
+}
+
+bool CompressedDeck::write(const Deck &deck, const std::string &path) {
+#ifdef TANKI_HAVE_ZLIB
+  auto cards = deck.cards();
+  std::string dict = trainDictionary(cards, DICT_BYTES);
+
+  std::vector<Block> blocks;
+  std::vector<std::string> packed;
+  // tombstones ride at the end of the last block, not counted as cards
+  std::string tombstones = FileManager::formatTombstones(deck.tombstones());
+  size_t i = 0;
+  while (i < cards.size() || !tombstones.empty()) {
+    Block b{(uint32_t)i, 0, 0, 0, 0};
+    std::string raw;
+    while (i < cards.size() && (raw.empty() || raw.size() < BLOCK_BYTES)) {
+      raw += FileManager::formatCardLine(cards[i++]);
+      raw += "\n";
+      b.cards++;
+    }
+    if (i == cards.size()) {
+      raw += tombstones;
+      tombstones.clear();
+    }
+
+    z_stream zs{};
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+      return false;
+    if (!dict.empty())
+      deflateSetDictionary(&zs, (const Bytef *)dict.data(), dict.size());
+    std::string out(deflateBound(&zs, raw.size()), '\0');
+    zs.next_in = (Bytef *)raw.data();
+    zs.avail_in = raw.size();
+    zs.next_out = (Bytef *)&out[0];
+    zs.avail_out = out.size();
+    int rc = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    if (rc != Z_STREAM_END)
+      return false;
+
+    b.raw = raw.size();
+    b.packed = out.size();
+    blocks.push_back(b);
+    packed.push_back(std::move(out));
+  }
+
+  std::string head(MAGIC, MAGIC_LEN);
+  head += deck.name() + "\n";
+  putU32(head, dict.size());
+  head += dict;
+  putU32(head, blocks.size());
+  uint64_t offset = head.size() + blocks.size() * BLOCK_ENTRY_BYTES;
+  for (auto &b : blocks) {
+    putU32(head, b.firstCard);
+    putU32(head, b.cards);
+    putU64(head, offset);
+    putU32(head, b.packed);
+    putU32(head, b.raw);
+    offset += b.packed;
+  }
+
+  std::string file = std::move(head);
+  for (auto &p : packed)
+    file += p;
+  return FileManager::replaceFile(path, file);
+#else
+  (void)deck;
+  (void)path;
+  return false;
+#endif
+}
+
+bool CompressedDeck::readHeader(std::istream &in, Header &h) {
+  in.seekg(0, std::ios::end);
+  uint64_t fileSize = in.tellg();
+  in.seekg(0);
+  char magic[MAGIC_LEN];
+  if (!in.read(magic, MAGIC_LEN) || std::memcmp(magic, MAGIC, MAGIC_LEN))
+    return false;
+  if (!std::getline(in, h.name))
+    return false;
+  // sizes come from the file: a damaged one must not make us allocate
+  // more than it can hold
+  uint32_t dictSize, count;
+  if (!getU32(in, dictSize) || dictSize > DICT_BYTES ||
+      dictSize > fileSize - in.tellg())
+    return false;
+  h.dict.resize(dictSize);
+  if (dictSize && !in.read(&h.dict[0], dictSize))
+    return false;
+  if (!getU32(in, count) ||
+      (uint64_t)count * BLOCK_ENTRY_BYTES > fileSize - in.tellg())
+    return false;
+  h.blocks.resize(count);
+  for (auto &b : h.blocks) {
+    if (!getU32(in, b.firstCard) || !getU32(in, b.cards) ||
+        !getU64(in, b.offset) || !getU32(in, b.packed) || !getU32(in, b.raw))
+      return false;
+    // deflate expands at most ~1032:1
+    if (b.offset > fileSize || b.packed > fileSize - b.offset ||
+        b.raw > (uint64_t)b.packed * 1032 + 64)
+      return false;
+  }
+  return true;
+}
+
+bool CompressedDeck::inflateBlock(const char *packed, const Header &h,
+                                  const Block &b, std::string &out) {
+#ifdef TANKI_HAVE_ZLIB
+  z_stream zs{};
+  if (inflateInit2(&zs, -15) != Z_OK)
+    return false;
+  if (!h.dict.empty())
+    inflateSetDictionary(&zs, (const Bytef *)h.dict.data(), h.dict.size());
+  out.resize(b.raw);
+  zs.next_in = (Bytef *)packed;
+  zs.avail_in = b.packed;
+  zs.next_out = (Bytef *)&out[0];
+  zs.avail_out = out.size();
+  int rc = inflate(&zs, Z_FINISH);
+  inflateEnd(&zs);
+  return rc == Z_STREAM_END && zs.total_out == b.raw;
+#else
+  (void)packed;
+  (void)h;
+  (void)b;
+  (void)out;
+  return false;
+#endif
+}
+
+std::shared_ptr<Deck> CompressedDeck::read(const std::string &path) {
+  std::ifstream fin(path, std::ios::binary);
+  Header h;
+  if (!readHeader(fin, h))
+    return nullptr;
+
+  // all blocks in one read, then inflate them one by one
+  uint64_t base = fin.tellg();
+  std::string data((std::istreambuf_iterator<char>(fin)),
+                   std::istreambuf_iterator<char>());
+
+  auto deck = std::make_shared<Deck>(h.name);
+  deck->setFormat(Deck::Compressed);
+  std::string raw, line, front;
+  std::vector<Card> cards;
+  Deck::Tombstones tombstones;
+  for (auto &b : h.blocks) {
+    if (b.offset < base || b.offset - base + b.packed > data.size())
+      return nullptr;
+    if (!inflateBlock(data.data() + (b.offset - base), h, b, raw))
+      return nullptr;
+    size_t start = 0;
+    while (start < raw.size()) {
+      size_t end = raw.find('\n', start);
+      if (end == std::string::npos)
+        end = raw.size();
+      line.assign(raw, start, end - start);
+      Card c;
+      time_t when;
+      if (FileManager::parseCardLine(line, c))
+        cards.push_back(std::move(c));
+      else if (FileManager::parseTombstone(line, front, when))
+        tombstones[front] = when;
+      start = end + 1;
+    }
+  }
+  deck->addCards(std::move(cards));
+  deck->setTombstones(std::move(tombstones));
+  return deck;
+}
@@ -0,0 +1,60 @@
+#ifndef TANKI_COMPRESSEDDECK_HPP
+#define TANKI_COMPRESSEDDECK_HPP
+
+#include "Deck.hpp"
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Compressed .deck encoding (needs zlib, see TANKI_HAVE_ZLIB).
+ *
+ *   "TANKIZ1\n" name "\n"
+ *   u32 dictSize, dictionary
+ *   u32 blockCount, blockCount x {u32 firstCard, u32 cards,
+ *                                 u64 offset, u32 packed, u32 raw}
+ *   blocks
+ *
+ * A block is a run of plain-format card lines deflated on its own with
+ * the deck's dictionary as preset dictionary. Decks are read whole, a
+ * block at a time; sizes in the header are checked against the file
+ * before anything is allocated for them.
+ * The dictionary is trained on the deck's own text.
+ * Integers are little-endian.
+ */
+class CompressedDeck {
+public:
+  static bool available();
+  static bool isCompressed(const std::string &path);
+
+  static std::shared_ptr<Deck> read(const std::string &path);
+  static bool write(const Deck &deck, const std::string &path);
+
+  // Frequent substrings of the card text, most useful last (zlib
+  // favours the end of a preset dictionary)
+  static std::string trainDictionary(const std::vector<Card> &cards,
+                                     size_t maxSize);
+
+private:
+  struct Block {
+    uint32_t firstCard;
+    uint32_t cards;
+    uint64_t offset;
+    uint32_t packed;
+    uint32_t raw;
+  };
+
+  struct Header {
+    std::string name;
+    std::string dict;
+    std::vector<Block> blocks;
+  };
+
+  static bool readHeader(std::istream &in, Header &h);
+  static bool inflateBlock(const char *packed, const Header &h,
+                           const Block &b, std::string &out);
+};
+
+#endif // TANKI_COMPRESSEDDECK_HPP
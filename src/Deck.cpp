@@ -1,7 +1,12 @@
 #include "Deck.hpp"
+#include <algorithm>
 #include <ctime>
+#include <deque>
+#include <limits>
+#include <unordered_map>
 
-Deck::Deck(const std::string &name) : _name(name) {}
+Deck::Deck(const std::string &name)
+    : _name(name), _format(Plain), _fileMtime(0), _fileSize(0) {}
 
 Deck::~Deck() {}
 
@@ -9,21 +14,188 @@ std::string Deck::name() const { return _name; }
 
 void Deck::setName(const std::string &n) { _name = n; }
 
-void Deck::addCard(const Card &c) { _cards.push_back(c); }
+Deck::Format Deck::format() const { return _format; }
+void Deck::setFormat(Format f) { _format = f; }
+
+void Deck::addCard(const Card &c) {
+  // ids grow monotonically, so this is nearly always an append
+  Slot slot{c.id(), (uint32_t)_cards.size()};
+  if (_slots.empty() || _slots.back().first < c.id())
+    _slots.push_back(slot);
+  else
+    _slots.insert(std::lower_bound(_slots.begin(), _slots.end(), slot), slot);
+  touchSegment(_cards.size(), 1);
+  if (!_tombstones.empty())
+    _tombstones.erase(std::string(c.front()));
+  _cards.push_back(c);
+  indexDue(c);
+  orderInsert(c);
+}
+
+void Deck::addCard(Card &&c) {
+  Slot slot{c.id(), (uint32_t)_cards.size()};
+  if (_slots.empty() || _slots.back().first < c.id())
+    _slots.push_back(slot);
+  else
+    _slots.insert(std::lower_bound(_slots.begin(), _slots.end(), slot), slot);
+  indexDue(c);
+  touchSegment(_cards.size(), 1);
+  if (!_tombstones.empty())
+    _tombstones.erase(std::string(c.front()));
+  _cards.push_back(std::move(c));
+  orderInsert(_cards[_cards.size() - 1]);
+}
+
+void Deck::addCards(std::vector<Card> &&cards) {
+  for (auto &c : cards) {
+    touchSegment(_cards.size(), 1);
+    if (!_tombstones.empty())
+      _tombstones.erase(std::string(c.front()));
+    _cards.push_back(std::move(c));
+  }
+  cards.clear();
+  reindex();
+}
 
 void Deck::updateCard(const Card &c) {
-  // find by ID
-  for (auto &ex : _cards) {
-    if (ex.id() == c.id()) {
-      ex = c;
-      return;
+  long pos = slotOf(c.id());
+  if (pos < 0)
+    return;
+  Card &ex = _cards.edit(pos);
+  orderErase(ex);
+  if (ex.isSuspended() || c.isSuspended()) {
+    unindexDue(ex);
+    ex = c;
+    indexDue(ex);
+  } else {
+    rekeyDue(ex, c);
+    ex = c;
+  }
+  orderInsert(ex);
+  touchSegment(pos, 0);
+}
+
+void Deck::updateCards(const std::vector<Card> &cards) {
+  if (cards.empty())
+    return;
+  std::vector<size_t> touched;
+  for (auto &c : cards) {
+    long pos = slotOf(c.id());
+    if (pos < 0)
+      continue;
+    _cards.edit(pos) = c;
+    touched.push_back(pos);
+  }
+  std::sort(touched.begin(), touched.end());
+  touchSegments(touched, 0);
+  reindex();
+}
+
+void Deck::setCards(const std::vector<Card> &cards) {
+  _cards.assign(std::vector<Card>(cards));
+  _segments.clear();
+  reindex();
+}
+
+void Deck::removeCard(int id) {
+  long pos = slotOf(id);
+  if (pos < 0)
+    return;
+  const Card &c = _cards[pos];
+  _removed.insert(std::string(c.front()));
+  if (inFile(id))
+    addTombstone(std::string(c.front()), std::time(nullptr));
+  unindexDue(c);
+  orderErase(c);
+  touchSegment(pos, -1);
+  // cards after it move up one place
+  _slots.erase(std::lower_bound(_slots.begin(), _slots.end(), Slot{id, 0}));
+  for (auto &s : _slots)
+    s.second -= s.second > (uint32_t)pos;
+  _cards.erase(pos);
+}
+
+const Deck::Tombstones &Deck::tombstones() const { return _tombstones; }
+
+void Deck::addTombstone(const std::string &front, time_t when) {
+  auto it = _tombstones.emplace(front, when).first;
+  it->second = std::max(it->second, when);
+}
+
+void Deck::setTombstones(Tombstones t) { _tombstones = std::move(t); }
+
+void Deck::adoptTombstones(const Deck &disk) {
+  Tombstones wanted;
+  for (auto &t : disk._tombstones) {
+    auto it = _tombstones.find(t.first);
+    if (it == _tombstones.end() || it->second < t.second)
+      wanted.insert(t);
+  }
+  if (wanted.empty())
+    return;
+  for (auto &c : _cards) {
+    if (!wanted.empty())
+      wanted.erase(std::string(c.front()));
+  }
+  for (auto &t : wanted)
+    _tombstones[t.first] = t.second;
+}
+
+std::vector<Card> Deck::cards() const { return _cards.toVector(); }
+
+size_t Deck::size() const { return _cards.size(); }
+
+const Card &Deck::at(size_t i) const { return _cards[i]; }
+
+std::vector<Card>
+Deck::extractIf(const std::function<bool(const Card &)> &pred) {
+  return extract(pred, true);
+}
+
+std::vector<Card>
+Deck::extract(const std::function<bool(const Card &)> &pred, bool remember) {
+  std::vector<Card> all = _cards.release();
+  std::vector<Card> out;
+  std::vector<size_t> taken;
+  size_t keep = 0;
+  time_t now = std::time(nullptr);
+  for (size_t i = 0; i < all.size(); i++) {
+    if (pred(all[i])) {
+      if (remember) {
+        _removed.insert(std::string(all[i].front()));
+        if (inFile(all[i].id()))
+          addTombstone(std::string(all[i].front()), now);
+      }
+      taken.push_back(i);
+      out.push_back(std::move(all[i]));
+    } else {
+      if (keep != i)
+        all[keep] = std::move(all[i]);
+      keep++;
     }
   }
+  all.erase(all.begin() + keep, all.end());
+  _cards.assign(std::move(all));
+  touchSegments(taken, -1);
+  reindex();
+  return out;
 }
 
-void Deck::setCards(const std::vector<Card> &cards) { _cards = cards; }
+std::vector<Card> Deck::releaseCards() {
+  std::vector<Card> out = _cards.release();
+  _segments.clear();
+  reindex();
+  return out;
+}
+
+int Deck::dueCount(time_t now, time_t &nextDue) const {
+  auto it = std::upper_bound(_dueIndex.begin(), _dueIndex.end(),
+                             DueKey{now, std::numeric_limits<int>::max()});
+  nextDue = it == _dueIndex.end() ? 0 : it->first;
+  return (int)(it - _dueIndex.begin());
+}
 
-std::vector<Card> Deck::cards() const { return _cards; }
+int Deck::newCount() const { return _newCount; }
 
 std::vector<Card> Deck::getDueCards() {
   std::vector<Card> due;
@@ -35,3 +207,422 @@ std::vector<Card> Deck::getDueCards() {
   }
   return due;
 }
+
+bool Deck::takeNewer(Card &local, const Card &disk) {
+  if (disk.modified() < local.modified())
+    return false;
+  const Card::Schedule &a = local.schedule(), &b = disk.schedule();
+  bool same = a.due == b.due && a.modified == b.modified &&
+              a.interval == b.interval && a.ease == b.ease &&
+              a.lastRating == b.lastRating && a.flags == b.flags &&
+              local.recallTime() == disk.recallTime() &&
+              local.back() == disk.back() &&
+              local.tagsString() == disk.tagsString();
+  if (same)
+    return false;
+  local.setBack(disk.back());
+  local.setTags(disk.tagsString());
+  local.copySchedulingFrom(disk);
+  return true;
+}
+
+bool Deck::inFile(int id) const {
+  return std::binary_search(_synced.begin(), _synced.end(), id);
+}
+
+bool Deck::deletedOnDisk(const Card &local) const {
+  return local.modified() < _syncedAt && inFile(local.id());
+}
+
+void Deck::markSynced() {
+  _synced.clear();
+  _synced.reserve(_slots.size());
+  for (auto &slot : _slots)
+    _synced.push_back(slot.first);
+  _syncedAt = std::time(nullptr);
+}
+
+void Deck::reloadFrom(const Deck &disk) {
+  // front -> local positions, in deck order (fronts need not be unique)
+  std::unordered_map<std::string, std::deque<size_t>> local;
+  for (size_t i = 0; i < _cards.size(); i++)
+    local[std::string(_cards[i].front())].push_back(i);
+
+  std::vector<Card> merged;
+  merged.reserve(disk._cards.size());
+  for (auto &d : disk._cards) {
+    if (_removed.count(std::string(d.front())))
+      continue;
+    auto it = local.find(std::string(d.front()));
+    if (it == local.end() || it->second.empty()) {
+      merged.push_back(d);
+      continue;
+    }
+    Card c = _cards[it->second.front()];
+    it->second.pop_front();
+    takeNewer(c, d);
+    merged.push_back(c);
+  }
+  size_t fromDisk = merged.size();
+  // cards not on disk yet (e.g. just imported) stay, in deck order
+  std::vector<size_t> localOnly;
+  for (auto &entry : local)
+    localOnly.insert(localOnly.end(), entry.second.begin(),
+                     entry.second.end());
+  std::sort(localOnly.begin(), localOnly.end());
+  for (size_t i : localOnly) {
+    if (!deletedOnDisk(_cards[i]))
+      merged.push_back(_cards[i]);
+  }
+  _name = disk._name;
+  _format = disk._format;
+  _fileMtime = disk._fileMtime;
+  _fileSize = disk._fileSize;
+  _synced.clear();
+  for (size_t i = 0; i < fromDisk; i++)
+    _synced.push_back(merged[i].id());
+  std::sort(_synced.begin(), _synced.end());
+  _syncedAt = std::time(nullptr);
+  _cards.assign(std::move(merged));
+  // the file was rewritten by someone else; its segments are unknown
+  _segments.clear();
+  reindex();
+  adoptTombstones(disk);
+}
+
+void Deck::mergeFrom(const Deck &disk) {
+  std::unordered_map<std::string, std::deque<size_t>> local;
+  for (size_t i = 0; i < _cards.size(); i++)
+    local[std::string(_cards[i].front())].push_back(i);
+
+  std::vector<Card> added, updated;
+  for (auto &d : disk._cards) {
+    if (_removed.count(std::string(d.front())))
+      continue;
+    auto it = local.find(std::string(d.front()));
+    if (it == local.end() || it->second.empty()) {
+      added.push_back(d);
+      continue;
+    }
+    Card c = _cards[it->second.front()];
+    it->second.pop_front();
+    if (takeNewer(c, d))
+      updated.push_back(std::move(c));
+  }
+  std::vector<int> gone;
+  for (auto &entry : local) {
+    for (size_t i : entry.second) {
+      if (deletedOnDisk(_cards[i]))
+        gone.push_back(_cards[i].id());
+    }
+  }
+  updateCards(updated);
+  if (!gone.empty()) {
+    std::sort(gone.begin(), gone.end());
+    extract(
+        [&](const Card &c) {
+          return std::binary_search(gone.begin(), gone.end(), c.id());
+        },
+        false);
+  }
+  if (!added.empty())
+    addCards(std::move(added));
+  adoptTombstones(disk);
+}
+
+Deck::Snapshot Deck::snapshot() const {
+  return {_cards, _removed, _tombstones, _name, _format};
+}
+
+void Deck::restore(const Snapshot &s) {
+  std::vector<Slot> before;
+  before.swap(_slots);
+  CardStore current = std::move(_cards);
+
+  _cards = s.cards;
+  _removed = s.removed;
+  _tombstones = s.tombstones;
+  _name = s.name;
+  _format = s.format;
+  _segments.clear();
+  reindex();
+
+  // cards that only exist now must not come back from the file on save
+  time_t now = std::time(nullptr);
+  for (auto &slot : before) {
+    if (slotOf(slot.first) < 0) {
+      std::string front(current[slot.second].front());
+      _removed.insert(front);
+      if (inFile(slot.first))
+        addTombstone(front, now);
+    }
+  }
+}
+
+void Deck::setFileStamp(int64_t mtime, uintmax_t size) {
+  _fileMtime = mtime;
+  _fileSize = size;
+}
+
+bool Deck::matchesFileStamp(int64_t mtime, uintmax_t size) const {
+  return _fileMtime == mtime && _fileSize == size;
+}
+
+void Deck::clearRemoved() { _removed.clear(); }
+
+Deck::MemoryUsage Deck::memoryUsage() const {
+  MemoryUsage m;
+  m.cards = _cards.size();
+  m.scheduling = _cards.capacityBytes();
+  for (auto &c : _cards) {
+    m.text += c.textBytes();
+    m.tags += c.heapBytes() - c.textBytes();
+  }
+  m.indexes = _slots.capacity() * sizeof(Slot) +
+              _dueIndex.capacity() * sizeof(DueKey);
+  for (auto &ids : _orders)
+    m.indexes += ids.capacity() * sizeof(int);
+  return m;
+}
+
+const Card &Deck::at(Order order, size_t i) const {
+  if (order == DeckOrder)
+    return _cards[i];
+  auto &ids = _orders[order];
+  if (ids.size() != _cards.size()) {
+    std::vector<const Card *> sorted;
+    sorted.reserve(_cards.size());
+    for (auto &c : _cards)
+      sorted.push_back(&c);
+    std::sort(sorted.begin(), sorted.end(),
+              [order](const Card *a, const Card *b) {
+                return sortsBefore(order, *a, *b);
+              });
+    ids.clear();
+    ids.reserve(sorted.size());
+    for (auto *c : sorted)
+      ids.push_back(c->id());
+  }
+  return *findCard(ids[i]);
+}
+
+bool Deck::sortsBefore(Order order, const Card &a, const Card &b) {
+  const Card::Schedule &x = a.schedule(), &y = b.schedule();
+  switch (order) {
+  case ByDue:
+    if (x.due != y.due)
+      return x.due < y.due;
+    break;
+  case ByEase:
+    if (x.ease != y.ease)
+      return x.ease < y.ease;
+    break;
+  case ByInterval:
+    if (x.interval != y.interval)
+      return x.interval < y.interval;
+    break;
+  case ByLastRating:
+    if (x.lastRating != y.lastRating)
+      return x.lastRating < y.lastRating;
+    break;
+  case ByFront:
+    if (int cmp = a.front().compare(b.front()))
+      return cmp < 0;
+    break;
+  case DeckOrder:
+    break;
+  }
+  return a.id() < b.id();
+}
+
+std::vector<Deck::Segment> &Deck::segments() { return _segments; }
+
+const Card *Deck::findCard(int id) const {
+  long pos = slotOf(id);
+  if (pos < 0)
+    return nullptr;
+  return &_cards[pos];
+}
+
+bool Deck::nextDue(const DueKey &after, DueKey &out) const {
+  auto it = std::upper_bound(_dueIndex.begin(), _dueIndex.end(), after);
+  if (it == _dueIndex.end())
+    return false;
+  out = *it;
+  return true;
+}
+
+void Deck::compact() {
+  _cards.shrink_to_fit();
+  _slots.shrink_to_fit();
+  _dueIndex.shrink_to_fit();
+}
+
+long Deck::slotOf(int id) const {
+  auto it = std::lower_bound(_slots.begin(), _slots.end(), Slot{id, 0});
+  if (it == _slots.end() || it->first != id)
+    return -1;
+  return it->second;
+}
+
+void Deck::indexDue(const Card &c) {
+  if (c.isSuspended())
+    return;
+  _newCount += isNew(c);
+  DueKey key{c.dueDate(), c.id()};
+  _dueIndex.insert(std::upper_bound(_dueIndex.begin(), _dueIndex.end(), key),
+                   key);
+}
+
+void Deck::unindexDue(const Card &c) {
+  if (c.isSuspended())
+    return;
+  _newCount -= isNew(c);
+  DueKey key{c.dueDate(), c.id()};
+  auto it = std::lower_bound(_dueIndex.begin(), _dueIndex.end(), key);
+  if (it != _dueIndex.end() && *it == key)
+    _dueIndex.erase(it);
+}
+
+void Deck::rekeyDue(const Card &before, const Card &after) {
+  _newCount += isNew(after) - isNew(before);
+  DueKey from{before.dueDate(), before.id()}, to{after.dueDate(), after.id()};
+  if (from == to)
+    return;
+  auto old = std::lower_bound(_dueIndex.begin(), _dueIndex.end(), from);
+  if (old == _dueIndex.end() || *old != from) {
+    _dueIndex.insert(std::upper_bound(_dueIndex.begin(), _dueIndex.end(), to),
+                     to);
+    return;
+  }
+  // shift only the keys between the old and the new place
+  auto pos = std::upper_bound(_dueIndex.begin(), _dueIndex.end(), to);
+  if (pos > old) {
+    std::rotate(old, old + 1, pos);
+    *(pos - 1) = to;
+  } else {
+    std::rotate(pos, old, old + 1);
+    *pos = to;
+  }
+}
+
+void Deck::reindex() {
+  _slots.clear();
+  _slots.reserve(_cards.size());
+  uint32_t i = 0;
+  _newCount = 0;
+  for (auto &c : _cards) {
+    _slots.push_back({c.id(), i++});
+    _newCount += isNew(c);
+  }
+  if (!std::is_sorted(_slots.begin(), _slots.end()))
+    std::sort(_slots.begin(), _slots.end());
+  reindexDue();
+  dropOrders();
+}
+
+void Deck::orderInsert(const Card &c) {
+  for (int o = ByDue; o < OrderCount; o++) {
+    auto &ids = _orders[o];
+    if (ids.empty())
+      continue;
+    auto it = std::lower_bound(ids.begin(), ids.end(), c, [&](int id,
+                                                              const Card &v) {
+      return sortsBefore((Order)o, *findCard(id), v);
+    });
+    ids.insert(it, c.id());
+  }
+}
+
+void Deck::orderErase(const Card &c) {
+  for (int o = ByDue; o < OrderCount; o++) {
+    auto &ids = _orders[o];
+    auto it = std::lower_bound(ids.begin(), ids.end(), c, [&](int id,
+                                                              const Card &v) {
+      return sortsBefore((Order)o, *findCard(id), v);
+    });
+    if (it != ids.end() && *it == c.id())
+      ids.erase(it);
+    else
+      ids.clear(); // out of step; sort again when next used
+  }
+}
+
+void Deck::dropOrders() {
+  for (auto &ids : _orders)
+    ids = std::vector<int>();
+}
+
+void Deck::reindexDue() {
+  _dueIndex.clear();
+  for (auto &c : _cards) {
+    if (!c.isSuspended())
+      _dueIndex.push_back({c.dueDate(), c.id()});
+  }
+  std::sort(_dueIndex.begin(), _dueIndex.end());
+}
+
+void Deck::reindexDue(std::vector<int> &ids) {
+  if (ids.size() * 4 > _dueIndex.size())
+    return reindexDue();
+  // ids come from one counter, so the id range stays near the card count
+  int first = _slots.front().first;
+  std::vector<char> flags(_slots.back().first - first + 1);
+  for (int id : ids)
+    flags[id - first] = 1;
+  auto moved = [&](const DueKey &k) { return flags[k.second - first]; };
+  _dueIndex.erase(std::remove_if(_dueIndex.begin(), _dueIndex.end(), moved),
+                  _dueIndex.end());
+  size_t mid = _dueIndex.size();
+  for (int id : ids) {
+    const Card *c = findCard(id);
+    if (c && !c->isSuspended())
+      _dueIndex.push_back({c->dueDate(), id});
+  }
+  std::sort(_dueIndex.begin() + mid, _dueIndex.end());
+  std::inplace_merge(_dueIndex.begin(), _dueIndex.begin() + mid,
+                     _dueIndex.end());
+}
+
+void Deck::touchSegment(size_t pos, int delta) {
+  if (_segments.empty())
+    return;
+  if (delta > 0) {
+    // appended; a full last segment starts a new one
+    if (_segments.back().count >= Segment::Capacity)
+      _segments.push_back(Segment());
+    _segments.back().count++;
+    _segments.back().dirty = true;
+    return;
+  }
+  for (auto &seg : _segments) {
+    if (pos < seg.count) {
+      seg.count += delta;
+      seg.dirty = true;
+      return;
+    }
+    pos -= seg.count;
+  }
+}
+
+void Deck::touchSegments(const std::vector<size_t> &positions, int delta) {
+  if (_segments.empty() || positions.empty())
+    return;
+  // one walk; a segment's count drops once it has been passed
+  auto seg = _segments.begin();
+  size_t start = 0;
+  uint32_t gone = 0;
+  for (size_t pos : positions) {
+    while (seg != _segments.end() && pos >= start + seg->count) {
+      start += seg->count;
+      seg->count -= gone;
+      gone = 0;
+      ++seg;
+    }
+    if (seg == _segments.end())
+      return;
+    seg->dirty = true;
+    gone += delta < 0;
+  }
+  seg->count -= gone;
+}
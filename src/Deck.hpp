@@ -2,29 +2,244 @@
 #define TANKI_DECK_HPP
 
 #include "Card.hpp"
+#include "CardStore.hpp"
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 class Deck {
 public:
+  // (dueDate, card id) - ordering key of the due index
+  using DueKey = std::pair<time_t, int>;
+  // Fronts of deleted cards and when they were deleted. Saved with the
+  // deck, so DeckSync can tell a deletion from a card the other side
+  // never had; ids are not kept on disk, fronts are how cards match.
+  using Tombstones = std::unordered_map<std::string, time_t>;
+
+  // Approximate heap + object bytes held by a loaded deck
+  struct MemoryUsage {
+    size_t cards = 0;
+    size_t text = 0;       // front/back bytes
+    size_t tags = 0;       // per-card tag ids
+    size_t scheduling = 0; // the Card objects themselves
+    size_t indexes = 0;    // id lookup + due index
+    size_t total() const { return text + tags + scheduling + indexes; }
+  };
+
+  // How FileManager stores the deck
+  enum Format { Plain, Compressed, Segmented };
+
+  // Card orders for browsing; ties go by card id
+  enum Order { DeckOrder, ByDue, ByEase, ByInterval, ByLastRating, ByFront };
+  static constexpr int OrderCount = ByFront + 1;
+
+  // One segment file of a Segmented deck (see SegmentedDeck). It holds
+  // the next `count` cards in deck order after those of the segments
+  // before it; cards added later join the last segment.
+  struct Segment {
+    // cards per segment when a deck is laid out
+    static constexpr uint32_t Capacity = 1024;
+    uint32_t file = 0; // segment file number, 0 = not written yet
+    uint32_t count = 0;
+    uint64_t hash = 0; // of the segment file's bytes, 0 = unknown
+    bool dirty = true;
+  };
+
+  // State of the deck at one point, for undo. Unchanged cards are
+  // shared with the deck, so taking one is cheap.
+  struct Snapshot {
+    CardStore cards;
+    std::unordered_set<std::string> removed;
+    Tombstones tombstones;
+    std::string name;
+    Format format;
+  };
+
   Deck(const std::string &name);
   ~Deck();
 
   std::string name() const;
   void setName(const std::string &n);
 
+  Format format() const;
+  void setFormat(Format f);
+
   void addCard(const Card &c);
+  void addCard(Card &&c);
+  // Append many cards, rebuilding the indexes once (bulk imports)
+  void addCards(std::vector<Card> &&cards);
   void updateCard(const Card &c);
+  // Replace many cards by id, rebuilding the indexes once
+  void updateCards(const std::vector<Card> &cards);
 
   // For "delete" we might want direct setCards
   void setCards(const std::vector<Card> &cards);
+  // Delete one card and remember it, so a merge on save does not
+  // bring it back from the file. Many cards go through extractIf.
+  // Both leave a tombstone for cards that were in the file; adding a
+  // card with that front clears it.
+  void removeCard(int id);
+
+  const Tombstones &tombstones() const;
+  // Keeps the later stamp when the front already has one
+  void addTombstone(const std::string &front, time_t when);
+  void setTombstones(Tombstones t);
 
   std::vector<Card> cards() const;
+  size_t size() const;
+  // i-th card in deck order, without copying
+  const Card &at(size_t i) const;
+
+  // Move out the cards matching pred (deck order kept on both sides);
+  // they are remembered as removed, like removeCard
+  std::vector<Card> extractIf(const std::function<bool(const Card &)> &pred);
+  // Move out every card, leaving the deck empty
+  std::vector<Card> releaseCards();
   std::vector<Card> getDueCards();
+  // Non-suspended cards due at `now` (a search of the due index), and
+  // the first due date after it (0 if none)
+  int dueCount(time_t now, time_t &nextDue) const;
+  // Non-suspended cards never reviewed (interval 0), kept as cards change
+  int newCount() const;
+
+  // reloadFrom and mergeFrom match cards by front text. A matched card
+  // keeps its id and takes back, tags and scheduling from whichever side
+  // has the newer Card::modified() (the disk on a tie). Cards removed
+  // here stay removed. A card missing from disk is kept if it is new or
+  // changed here since markSynced, and dropped (deleted on disk) if not.
+
+  // Replace the cards with those of a newer copy of this deck read from
+  // disk, in the disk's order; cards kept from here follow
+  void reloadFrom(const Deck &disk);
+  // Fold in cards another process saved to our file since we read it,
+  // keeping this deck's order; cards only on disk are appended
+  void mergeFrom(const Deck &disk);
+  // The cards now in the deck are those in its file (after a load or a
+  // save); see reloadFrom
+  void markSynced();
+
+  // Apply a BatchScheduler policy to the scheduling fields of every card
+  // matching filter, in one pass. Cards the policy would leave as they
+  // are keep their modified() stamp. Returns the number of cards changed.
+  template <typename Policy, typename Filter>
+  size_t reschedule(const Policy &policy, const Filter &filter) {
+    std::vector<int> moved;
+    std::vector<size_t> touched;
+    auto affected = [&](const Card &c) {
+      return filter(c) && policy.changes(c.schedule());
+    };
+    size_t n = _cards.editIf(affected, [&](Card &c) {
+      _newCount -= isNew(c);
+      policy(c.schedule());
+      _newCount += isNew(c);
+      if (!_segments.empty())
+        touched.push_back(slotOf(c.id()));
+      if (Policy::movesDue)
+        moved.push_back(c.id());
+    });
+    if (!moved.empty())
+      reindexDue(moved);
+    touchSegments(touched, 0);
+    if (n)
+      dropOrders();
+    return n;
+  }
+
+  Snapshot snapshot() const;
+  // Go back to a snapshot. Cards added since it was taken are
+  // remembered as removed, so a save does not bring them back.
+  void restore(const Snapshot &s);
+
+  // Identity (mtime, size) of the file this deck was last read from or
+  // written to; used to notice writes by other processes
+  void setFileStamp(int64_t mtime, uintmax_t size);
+  bool matchesFileStamp(int64_t mtime, uintmax_t size) const;
+  void clearRemoved();
+
+  MemoryUsage memoryUsage() const;
+  // Release spare capacity once loading is done
+  void compact();
+
+  // Segment table of a Segmented deck; empty means "lay out afresh"
+  std::vector<Segment> &segments();
+
+  // Lookup by Card::id(), nullptr if the card is not in this deck
+  const Card *findCard(int id) const;
+
+  // i-th card in the given order. Each order other than DeckOrder is a
+  // cached list of ids, sorted the first time it is asked for and then
+  // kept current by addCard/updateCard/removeCard; bulk edits drop it.
+  const Card &at(Order order, size_t i) const;
+  static bool sortsBefore(Order order, const Card &a, const Card &b);
+
+  // First non-suspended card strictly after `after` in due-date order.
+  // Returns false when there is none.
+  bool nextDue(const DueKey &after, DueKey &out) const;
 
 private:
   std::string _name;
-  std::vector<Card> _cards;
+  Format _format;
+  CardStore _cards;
+
+  // (id, position in _cards), sorted by id
+  using Slot = std::pair<int, uint32_t>;
+  std::vector<Slot> _slots;
+  // non-suspended cards ordered by due date (flat, sorted)
+  std::vector<DueKey> _dueIndex;
+  int _newCount = 0;
+  // fronts of cards removed since the last save
+  std::unordered_set<std::string> _removed;
+  Tombstones _tombstones;
+  std::vector<Segment> _segments;
+  // card ids per Order, empty until used (see at(Order, i))
+  mutable std::vector<int> _orders[OrderCount];
+
+  int64_t _fileMtime;
+  uintmax_t _fileSize;
+  // ids of the cards in the file at markSynced (sorted), and when
+  std::vector<int> _synced;
+  time_t _syncedAt = 0;
+
+  long slotOf(int id) const;
+  static bool isNew(const Card &c) {
+    return !c.isSuspended() && c.interval() == 0;
+  }
+  // The shared merge rule: when `disk` is at least as new as `local`,
+  // local takes its back, tags and scheduling. True if that changed it.
+  static bool takeNewer(Card &local, const Card &disk);
+  // Card `id` was in the file at markSynced
+  bool inFile(int id) const;
+  // Was in the file at markSynced and is unchanged here since
+  bool deletedOnDisk(const Card &local) const;
+  // extractIf; `remember` adds the fronts to the removed set and
+  // leaves tombstones
+  std::vector<Card> extract(const std::function<bool(const Card &)> &pred,
+                            bool remember);
+  // Take the disk's tombstones for fronts no card here has any more
+  void adoptTombstones(const Deck &disk);
+  void indexDue(const Card &c);
+  void unindexDue(const Card &c);
+  // Move a non-suspended card's due key, shifting only the keys between
+  // its old and new place
+  void rekeyDue(const Card &before, const Card &after);
+  void reindex();
+  void reindexDue();
+  // Keep built orders current across a change of one card
+  void orderInsert(const Card &c);
+  void orderErase(const Card &c);
+  void dropOrders();
+  // Re-key just these cards, or rebuild when they are many
+  void reindexDue(std::vector<int> &ids);
+  // Mark the segment holding deck position `pos` dirty; `delta` is +1
+  // for a card appended at pos, -1 for one removed from it
+  void touchSegment(size_t pos, int delta);
+  // The same for ascending positions, counted before any of them is
+  // removed; delta is 0 or -1
+  void touchSegments(const std::vector<size_t> &positions, int delta);
 };
 
 #endif // TANKI_DECK_HPP
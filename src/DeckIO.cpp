@@ -0,0 +1,77 @@
+#include "DeckIO.hpp"
+#include "FileManager.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Deck files are read and written whole, so a few workers are enough to
+// keep the disk busy
+static const size_t maxWorkers = 8;
+
+std::vector<std::shared_ptr<Deck>>
+DeckIO::loadAll(const std::vector<std::string> &paths,
+                const Progress &progress) {
+  std::vector<std::shared_ptr<Deck>> decks(paths.size());
+  runBatch(
+      paths.size(),
+      [&](size_t i) { decks[i] = FileManager::loadDeck(paths[i]); },
+      progress);
+  return decks;
+}
+
+std::vector<bool>
+DeckIO::saveAll(const std::vector<std::shared_ptr<Deck>> &decks,
+                const std::string &directory, const Progress &progress) {
+  // not vector<bool>: workers write neighbouring elements
+  std::vector<char> ok(decks.size(), 0);
+  runBatch(
+      decks.size(),
+      [&](size_t i) { ok[i] = FileManager::saveDeck(decks[i], directory); },
+      progress);
+  return std::vector<bool>(ok.begin(), ok.end());
+}
+
+void DeckIO::runBatch(size_t count, const std::function<void(size_t)> &job,
+                      const Progress &progress) {
+  if (count == 0)
+    return;
+  size_t workers = std::min<size_t>(
+      {count, maxWorkers, std::max(2u, std::thread::hardware_concurrency())});
+
+  std::atomic<size_t> next(0);
+  size_t done = 0;
+  std::mutex mutex;
+  std::condition_variable cv;
+
+  std::vector<std::thread> threads;
+  for (size_t w = 0; w < workers; w++) {
+    threads.emplace_back([&] {
+      size_t i;
+      while ((i = next++) < count) {
+        job(i);
+        std::lock_guard<std::mutex> lock(mutex);
+        done++;
+        cv.notify_one();
+      }
+    });
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (done < count) {
+      cv.wait_for(lock, std::chrono::milliseconds(50),
+                  [&] { return done == count; });
+      if (progress) {
+        size_t now = done;
+        lock.unlock();
+        progress(now, count);
+        lock.lock();
+      }
+    }
+  }
+  for (auto &t : threads)
+    t.join();
+}
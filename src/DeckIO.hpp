@@ -0,0 +1,34 @@
+#ifndef TANKI_DECKIO_HPP
+#define TANKI_DECKIO_HPP
+
+#include "Deck.hpp"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Loads and saves batches of deck files on worker threads.
+ * The calling thread only waits, and is handed (done, total) every few
+ * milliseconds until the batch is finished, so a UI can keep drawing.
+ */
+class DeckIO {
+public:
+  using Progress = std::function<void(size_t done, size_t total)>;
+
+  // One deck per path, nullptr where a file could not be read
+  static std::vector<std::shared_ptr<Deck>>
+  loadAll(const std::vector<std::string> &paths,
+          const Progress &progress = nullptr);
+
+  // Per deck, whether FileManager::saveDeck succeeded
+  static std::vector<bool>
+  saveAll(const std::vector<std::shared_ptr<Deck>> &decks,
+          const std::string &directory, const Progress &progress = nullptr);
+
+  // Run job(0..count-1) on worker threads
+  static void runBatch(size_t count, const std::function<void(size_t)> &job,
+                       const Progress &progress = nullptr);
+};
+
+#endif // TANKI_DECKIO_HPP
@@ -0,0 +1,47 @@
+#include "DeckLock.hpp"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+DeckLock::DeckLock(const std::string &deckPath, Mode mode) : _fd(-1) {
+  std::string path = lockPath(deckPath);
+  int op = mode == Exclusive ? LOCK_EX : LOCK_SH;
+  while (true) {
+    _fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (_fd < 0)
+      return;
+    while (flock(_fd, op) < 0) {
+      if (errno != EINTR) {
+        close(_fd);
+        _fd = -1;
+        return;
+      }
+    }
+    // deleteDeck unlinks the lock file while holding it; a lock taken
+    // on that unlinked file guards nothing, so open the new one
+    struct stat held, named;
+    if (fstat(_fd, &held) == 0 && stat(path.c_str(), &named) == 0 &&
+        held.st_dev == named.st_dev && held.st_ino == named.st_ino)
+      return;
+    close(_fd);
+  }
+}
+
+DeckLock::~DeckLock() {
+  if (_fd >= 0) {
+    flock(_fd, LOCK_UN);
+    close(_fd);
+  }
+}
+
+bool DeckLock::locked() const { return _fd >= 0; }
+
+std::string DeckLock::lockPath(const std::string &deckPath) {
+  size_t slash = deckPath.find_last_of('/');
+  if (slash == std::string::npos)
+    return "." + deckPath + ".lock";
+  return deckPath.substr(0, slash + 1) + "." + deckPath.substr(slash + 1) +
+         ".lock";
+}
@@ -0,0 +1,33 @@
+#ifndef TANKI_DECKLOCK_HPP
+#define TANKI_DECKLOCK_HPP
+
+#include <string>
+
+/**
+ * Advisory lock on one deck file (flock on a hidden ".<file>.lock"
+ * next to it), held for the lifetime of the object.
+ * - Shared while reading, exclusive while writing
+ * - One lock per deck, so work on other decks is never blocked
+ * The lock lives in a side file so replacing the deck file itself
+ * does not drop it. If the side file was removed (deleteDeck) while
+ * waiting for it, the lock is taken again on the current one.
+ */
+class DeckLock {
+public:
+  enum Mode { Shared, Exclusive };
+
+  DeckLock(const std::string &deckPath, Mode mode);
+  ~DeckLock();
+
+  DeckLock(const DeckLock &) = delete;
+  DeckLock &operator=(const DeckLock &) = delete;
+
+  bool locked() const;
+
+  static std::string lockPath(const std::string &deckPath);
+
+private:
+  int _fd;
+};
+
+#endif // TANKI_DECKLOCK_HPP
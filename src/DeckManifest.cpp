@@ -0,0 +1,125 @@
+#include "DeckManifest.hpp"
+#include "FileManager.hpp"
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+static const char *MANIFEST_FILE = "/.manifest";
+static const char *MANIFEST_MAGIC = "TANKI-MANIFEST 2";
+
+bool DeckSummary::dueExact(time_t now) const {
+  return nextDue == 0 || now < nextDue;
+}
+
+bool DeckSummary::mayHaveDue(time_t now) const {
+  return dueCount > 0 || !dueExact(now);
+}
+
+std::vector<DeckSummary> DeckManifest::load(const std::string &directory) {
+  std::vector<DeckSummary> result;
+  std::ifstream fin(directory + MANIFEST_FILE);
+  std::string line;
+  if (!std::getline(fin, line) || line != MANIFEST_MAGIC)
+    return result;
+
+  // Each line: path|name|cards|due|new|nextDue|stamped|mtime|size
+  while (std::getline(fin, line)) {
+    if (line.empty())
+      continue;
+    std::stringstream ss(line);
+    std::string f[9];
+    int n = 0;
+    while (n < 9 && std::getline(ss, f[n], '|'))
+      n++;
+    if (n < 9)
+      continue;
+    try {
+      DeckSummary s;
+      s.path = f[0];
+      s.name = f[1];
+      s.cardCount = std::stoi(f[2]);
+      s.dueCount = std::stoi(f[3]);
+      s.newCount = std::stoi(f[4]);
+      s.nextDue = std::stol(f[5]);
+      s.stamped = std::stol(f[6]);
+      s.mtime = std::stoll(f[7]);
+      s.size = std::stoull(f[8]);
+      result.push_back(s);
+    } catch (...) {
+      continue;
+    }
+  }
+  return result;
+}
+
+bool DeckManifest::save(const std::string &directory,
+                        const std::vector<DeckSummary> &entries) {
+  std::ostringstream out;
+  out << MANIFEST_MAGIC << "\n";
+  for (auto &s : entries) {
+    out << s.path << "|" << s.name << "|" << s.cardCount << "|"
+        << s.dueCount << "|" << s.newCount << "|" << s.nextDue << "|"
+        << s.stamped << "|" << s.mtime << "|" << s.size << "\n";
+  }
+  // a crash leaves the old manifest or the new one, never half of it
+  return FileManager::replaceFile(directory + MANIFEST_FILE, out.str());
+}
+
+std::vector<DeckSummary>
+DeckManifest::scan(const std::string &directory, bool &changed,
+                   const DeckIO::Progress &progress,
+                   std::vector<std::shared_ptr<Deck>> *loaded) {
+  changed = false;
+  std::unordered_map<std::string, DeckSummary> cached;
+  for (auto &s : load(directory))
+    cached[s.path] = s;
+
+  std::vector<DeckSummary> result;
+  std::vector<std::string> stale;
+  for (auto &path : FileManager::listDeckFiles(directory)) {
+    auto it = cached.find(path);
+    if (it != cached.end() && isCurrent(it->second))
+      result.push_back(it->second);
+    else
+      stale.push_back(path);
+  }
+  if (loaded)
+    loaded->assign(result.size(), nullptr);
+  auto decks = DeckIO::loadAll(stale, progress);
+  for (size_t i = 0; i < stale.size(); i++) {
+    if (!decks[i])
+      continue;
+    result.push_back(summarize(*decks[i], stale[i]));
+    if (loaded)
+      loaded->push_back(decks[i]);
+    changed = true;
+  }
+  if (result.size() != cached.size())
+    changed = true;
+  return result;
+}
+
+DeckSummary DeckManifest::summarize(const Deck &deck,
+                                    const std::string &path) {
+  DeckSummary s;
+  s.path = path;
+  FileManager::fileIdentity(path, s.mtime, s.size);
+  refreshCounts(s, deck);
+  return s;
+}
+
+void DeckManifest::refreshCounts(DeckSummary &s, const Deck &deck) {
+  s.name = deck.name();
+  s.cardCount = (int)deck.size();
+  s.stamped = std::time(nullptr);
+  s.dueCount = deck.dueCount(s.stamped, s.nextDue);
+  s.newCount = deck.newCount();
+}
+
+bool DeckManifest::isCurrent(const DeckSummary &s) {
+  int64_t mtime;
+  uintmax_t size;
+  if (!FileManager::fileIdentity(s.path, mtime, size))
+    return false;
+  return mtime == s.mtime && size == s.size;
+}
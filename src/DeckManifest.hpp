@@ -0,0 +1,62 @@
+#ifndef TANKI_DECKMANIFEST_HPP
+#define TANKI_DECKMANIFEST_HPP
+
+#include "Deck.hpp"
+#include "DeckIO.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * What the deck lists need to know about a deck without parsing it.
+ * Counts are taken at `stamped`; mtime/size identify the file version
+ * they were computed from.
+ */
+struct DeckSummary {
+  std::string path;
+  std::string name;
+  int cardCount = 0;
+  int dueCount = 0;
+  int newCount = 0;
+  time_t nextDue = 0; // earliest due date after `stamped`, 0 if none
+  time_t stamped = 0;
+  int64_t mtime = 0;
+  uintmax_t size = 0;
+
+  // True when dueCount is still exact at `now`
+  bool dueExact(time_t now) const;
+  // Whether the deck may have anything to review at `now`
+  bool mayHaveDue(time_t now) const;
+};
+
+/**
+ * Small index file (.manifest) in the deck directory.
+ * Entries are trusted only while the deck file's mtime and size match,
+ * so startup parses just the decks that changed since the last run.
+ */
+class DeckManifest {
+public:
+  static std::vector<DeckSummary> load(const std::string &directory);
+  static bool save(const std::string &directory,
+                   const std::vector<DeckSummary> &entries);
+
+  // Summaries for every deck file; stale or missing entries are rebuilt
+  // (in parallel, see DeckIO). `changed` is set when anything had to be
+  // re-parsed. With `loaded`, the decks parsed on the way are handed
+  // back so they need not be read again: (*loaded)[i] belongs to
+  // result[i], null when the entry came from the manifest.
+  static std::vector<DeckSummary>
+  scan(const std::string &directory, bool &changed,
+       const DeckIO::Progress &progress = nullptr,
+       std::vector<std::shared_ptr<Deck>> *loaded = nullptr);
+
+  // Fresh summary of a loaded deck, with the file identity of `path`
+  static DeckSummary summarize(const Deck &deck, const std::string &path);
+  // Recompute only the counts (cheap: no stat, no pass over the cards)
+  static void refreshCounts(DeckSummary &s, const Deck &deck);
+
+  static bool isCurrent(const DeckSummary &s);
+};
+
+#endif // TANKI_DECKMANIFEST_HPP
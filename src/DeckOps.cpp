@@ -0,0 +1,117 @@
+#include "DeckOps.hpp"
+#include <functional>
+#include <unordered_map>
+
+static bool containsText(std::string_view hay, const std::string &needle) {
+  return hay.find(needle) != std::string_view::npos;
+}
+
+DeckOps::MergeResult DeckOps::merge(Deck &target, Deck &source) {
+  MergeResult result;
+
+  // hash of front -> target card ids; text is compared on a hit
+  std::hash<std::string_view> hasher;
+  std::unordered_multimap<size_t, int> byFront;
+  byFront.reserve(target.size());
+  for (size_t i = 0; i < target.size(); i++)
+    byFront.emplace(hasher(target.at(i).front()), target.at(i).id());
+
+  // New cards and edited copies of matched target cards are handed to
+  // the target once at the end, so its indexes are rebuilt once rather
+  // than per card
+  std::vector<Card> added, updated;
+  std::unordered_map<int, size_t> edited; // target id -> index in updated
+
+  std::vector<Card> incoming = source.releaseCards();
+  for (auto &c : incoming) {
+    const Card *match = nullptr;
+    auto range = byFront.equal_range(hasher(c.front()));
+    for (auto it = range.first; it != range.second && !match; ++it) {
+      const Card *t = target.findCard(it->second);
+      if (t && t->front() == c.front())
+        match = t;
+    }
+
+    if (!match) {
+      added.push_back(std::move(c));
+      result.added++;
+      continue;
+    }
+
+    auto slot = edited.emplace(match->id(), updated.size());
+    if (slot.second)
+      updated.push_back(*match);
+    Card &merged = updated[slot.first->second];
+    result.duplicates++;
+    if (c.modified() > merged.modified()) {
+      merged.copySchedulingFrom(c);
+      result.newerTaken++;
+    }
+    if (c.tagCount() > 0)
+      merged.setTags(merged.tagsString() + "," + c.tagsString());
+  }
+  target.updateCards(updated);
+  target.addCards(std::move(added));
+  return result;
+}
+
+std::shared_ptr<Deck> DeckOps::split(Deck &source, const std::string &name,
+                                     const SplitRule &rule) {
+  std::function<bool(const Card &)> pred;
+  size_t index = 0;
+  switch (rule.kind) {
+  case SplitRule::ByTag:
+    pred = [&](const Card &c) { return c.hasTag(rule.text); };
+    break;
+  case SplitRule::BySearch:
+    pred = [&](const Card &c) {
+      return containsText(c.front(), rule.text) ||
+             containsText(c.back(), rule.text);
+    };
+    break;
+  case SplitRule::ByRange:
+    // extractIf visits cards in deck order
+    pred = [&](const Card &) {
+      size_t i = index++;
+      return i >= rule.from && i <= rule.to;
+    };
+    break;
+  }
+
+  auto deck = std::make_shared<Deck>(name);
+  deck->setFormat(source.format());
+  deck->addCards(source.extractIf(pred));
+  return deck;
+}
+
+bool DeckOps::parseSplitRule(const std::string &spec, SplitRule &rule) {
+  size_t colon = spec.find(':');
+  if (colon == std::string::npos || colon + 1 >= spec.size())
+    return false;
+  std::string kind = spec.substr(0, colon);
+  std::string value = spec.substr(colon + 1);
+
+  if (kind == "tag") {
+    rule.kind = SplitRule::ByTag;
+    rule.text = value;
+  } else if (kind == "search") {
+    rule.kind = SplitRule::BySearch;
+    rule.text = value;
+  } else if (kind == "range") {
+    size_t dash = value.find('-');
+    if (dash == std::string::npos)
+      return false;
+    try {
+      rule.kind = SplitRule::ByRange;
+      rule.from = std::stoul(value.substr(0, dash));
+      rule.to = std::stoul(value.substr(dash + 1));
+    } catch (...) {
+      return false;
+    }
+    if (rule.to < rule.from)
+      return false;
+  } else {
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,42 @@
+#ifndef TANKI_DECKOPS_HPP
+#define TANKI_DECKOPS_HPP
+
+#include "Deck.hpp"
+#include <memory>
+#include <string>
+
+/**
+ * Moving cards between decks (merge / split).
+ * Cards are moved, never copied through Deck::cards(), and each
+ * operation is a single pass over the decks involved.
+ */
+class DeckOps {
+public:
+  struct MergeResult {
+    size_t added = 0;      // cards moved over as new
+    size_t duplicates = 0; // same front text as a target card
+    size_t newerTaken = 0; // duplicates whose scheduling replaced ours
+  };
+
+  struct SplitRule {
+    enum Kind { ByTag, BySearch, ByRange };
+    Kind kind = ByTag;
+    std::string text; // tag or search text
+    size_t from = 0;  // range, inclusive, in deck order
+    size_t to = 0;
+  };
+
+  // Move every card of `source` into `target`. A card whose front
+  // matches a target card is a duplicate: tags are combined and the
+  // more recently reviewed scheduling state wins. `source` ends empty.
+  static MergeResult merge(Deck &target, Deck &source);
+
+  // Move the cards matching `rule` out of `source` into a new deck
+  static std::shared_ptr<Deck> split(Deck &source, const std::string &name,
+                                     const SplitRule &rule);
+
+  // "tag:T", "search:S" or "range:A-B"; false if not understood
+  static bool parseSplitRule(const std::string &spec, SplitRule &rule);
+};
+
+#endif // TANKI_DECKOPS_HPP
@@ -0,0 +1,469 @@
+#include "DeckSync.hpp"
+#include "Deck.hpp"
+#include "DeckLock.hpp"
+#include "FileManager.hpp"
+#include "SegmentedDeck.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <set>
+#include <string_view>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+// One card (or tombstone) of a side: its line, and the fields sync
+// looks at
+struct Entry {
+  std::string line;
+  size_t frontLength = 0;
+  time_t modified = 0; // the deletion stamp of a tombstone
+  bool deleted = false;
+  const Card *card = nullptr; // of a loaded deck
+
+  std::string_view front() const {
+    return std::string_view(line).substr(0, frontLength);
+  }
+};
+using Run = std::vector<Entry>; // the cards of one segment, or a deck
+
+struct Side {
+  std::string path;
+  std::string dir; // of the segment files
+  std::string name;
+  std::vector<Deck::Segment> segments;
+  Deck::Tombstones tombstones;
+  bool rehashed = false; // the index lacked hashes
+
+  // while merging: segments that differ from the other side, by hash
+  std::unordered_map<uint64_t, Deck::Segment> differing;
+  uint32_t next = 0; // for new segment files
+  std::vector<Deck::Segment> out;
+};
+} // namespace
+
+// A deletion is weighed against an edit by stamp like any two versions;
+// on equal stamps the deletion stands
+static const Entry &winner(const Entry &a, const Entry &b) {
+  if (a.modified != b.modified)
+    return a.modified > b.modified ? a : b;
+  if (a.deleted != b.deleted)
+    return a.deleted ? a : b;
+  return a.line >= b.line ? a : b;
+}
+
+// Front and stamp of a card line (see FileManager::parseCardLine)
+// without building the Card, or of a tombstone; false for lines it
+// would skip
+static bool toEntry(std::string &&line, Entry &e) {
+  std::string front;
+  if (FileManager::parseTombstone(line, front, e.modified)) {
+    e.frontLength = front.size();
+    e.deleted = true;
+    e.line = std::move(line);
+    return true;
+  }
+  // front|back|interval|EF|dueDate|suspended|tags[|modified|...]
+  size_t bars[7];
+  int found = 0;
+  for (size_t at = line.find('|'); at != std::string::npos && found < 7;
+       at = line.find('|', at + 1))
+    bars[found++] = at;
+  if (found < 6)
+    return false;
+  e.frontLength = bars[0];
+  e.modified =
+      found < 7 ? 0 : (time_t)std::strtoll(&line[bars[6] + 1], nullptr, 10);
+  e.line = std::move(line);
+  return true;
+}
+
+static bool hasCheckpoint(const std::string &path) {
+  return access(FileManager::checkpointPath(path).c_str(), F_OK) == 0;
+}
+
+static std::string directoryOf(const std::string &path) {
+  return std::filesystem::path(path).parent_path().string();
+}
+
+static void parseRun(const std::string &data, Run &out) {
+  for (size_t pos = 0; pos < data.size();) {
+    size_t end = data.find('\n', pos);
+    if (end == std::string::npos)
+      end = data.size();
+    Entry e;
+    if (toEntry(data.substr(pos, end - pos), e))
+      out.push_back(std::move(e));
+    pos = end + 1;
+  }
+}
+
+static Run tombstoneRun(const Deck::Tombstones &tombstones) {
+  Run run;
+  for (auto &t : tombstones) {
+    Entry e;
+    e.line = FileManager::formatTombstone(t.first, t.second);
+    e.frontLength = t.first.size();
+    e.modified = t.second;
+    e.deleted = true;
+    run.push_back(std::move(e));
+  }
+  return run;
+}
+
+// Move the tombstones out of merged runs, leaving only cards
+static Deck::Tombstones
+takeTombstones(std::vector<std::vector<const Entry *>> &runs) {
+  Deck::Tombstones out;
+  for (auto &run : runs) {
+    auto cards = std::stable_partition(
+        run.begin(), run.end(), [](const Entry *e) { return !e->deleted; });
+    for (auto it = cards; it != run.end(); ++it)
+      out[std::string((*it)->front())] = (*it)->modified;
+    run.erase(cards, run.end());
+  }
+  return out;
+}
+
+static std::string runData(const std::vector<const Entry *> &run) {
+  std::string data;
+  for (auto *e : run) {
+    data += e->line;
+    data += '\n';
+  }
+  return data;
+}
+
+/**
+ * The runs both sides keep in place of those that differ: each of a's
+ * runs with every card replaced by the winning version of its match in
+ * b, then the cards only b has, in runs of Segment::Capacity.
+ */
+static std::vector<std::vector<const Entry *>>
+mergeRuns(const std::vector<Run> &a, const std::vector<Run> &b,
+          DeckSync::Result &r) {
+  std::unordered_map<std::string_view, std::deque<const Entry *>> inB;
+  for (auto &run : b) {
+    for (auto &e : run)
+      inB[e.front()].push_back(&e);
+  }
+
+  std::vector<std::vector<const Entry *>> out;
+  std::unordered_set<const Entry *> matched;
+  for (auto &run : a) {
+    out.emplace_back();
+    for (auto &e : run) {
+      auto it = inB.find(e.front());
+      if (it == inB.end() || it->second.empty()) {
+        out.back().push_back(&e);
+        r.toB++;
+        continue;
+      }
+      const Entry &f = *it->second.front();
+      it->second.pop_front();
+      matched.insert(&f);
+      const Entry &w = winner(e, f);
+      r.toA += w.line != e.line;
+      r.toB += w.line != f.line;
+      r.ties += e.line != f.line && e.modified == f.modified;
+      out.back().push_back(&w);
+    }
+  }
+
+  std::vector<const Entry *> rest;
+  for (auto &run : b) {
+    for (auto &e : run) {
+      if (!matched.count(&e))
+        rest.push_back(&e);
+    }
+  }
+  r.toA += rest.size();
+  for (size_t i = 0; i < rest.size(); i += Deck::Segment::Capacity) {
+    size_t end = std::min(rest.size(), i + Deck::Segment::Capacity);
+    out.emplace_back(rest.begin() + i, rest.begin() + end);
+  }
+  return out;
+}
+
+static bool readSide(const std::string &path, Side &s) {
+  s.path = path;
+  s.dir = SegmentedDeck::segmentDirectory(path);
+  if (!SegmentedDeck::readIndex(path, s.name, s.segments, s.tombstones))
+    return false;
+  // older indexes have no hashes; work them out once
+  std::string data;
+  for (auto &seg : s.segments) {
+    if (seg.hash)
+      continue;
+    if (!FileManager::readFile(SegmentedDeck::segmentFile(s.dir, seg.file),
+                               data))
+      return false;
+    seg.hash = SegmentedDeck::hash(data);
+    s.rehashed = true;
+  }
+  return true;
+}
+
+static bool readRun(const Side &s, const Deck::Segment &seg, Run &out) {
+  std::string data;
+  if (!FileManager::readFile(SegmentedDeck::segmentFile(s.dir, seg.file),
+                             data))
+    return false;
+  parseRun(data, out);
+  return true;
+}
+
+// Give side s the next merged segment: one it has with the same bytes,
+// or a new file
+static bool place(Side &s, size_t count, const std::string &data,
+                  uint64_t hash, DeckSync::Result &r) {
+  auto it = s.differing.find(hash);
+  if (it != s.differing.end()) {
+    s.out.push_back(it->second);
+    s.differing.erase(it);
+    return true;
+  }
+  Deck::Segment seg;
+  seg.file = s.next++;
+  seg.count = (uint32_t)count;
+  seg.hash = hash;
+  seg.dirty = false;
+  s.out.push_back(seg);
+  r.cardsWritten += count;
+  return FileManager::writeFile(SegmentedDeck::segmentFile(s.dir, seg.file),
+                                data, true);
+}
+
+static bool sameFiles(const std::vector<Deck::Segment> &x,
+                      const std::vector<Deck::Segment> &y) {
+  return std::equal(x.begin(), x.end(), y.begin(), y.end(),
+                    [](const Deck::Segment &p, const Deck::Segment &q) {
+                      return p.file == q.file;
+                    });
+}
+
+/**
+ * Segments with the same hash on both sides are left alone. The cards of
+ * the others are merged, and both sides end up with the same segments in
+ * a's order, so the next sync finds them equal again.
+ */
+static bool syncSegmented(const std::string &pathA, const std::string &pathB,
+                          DeckSync::Result &r) {
+  Side a, b;
+  if (!readSide(pathA, a) || !readSide(pathB, b))
+    return false;
+
+  std::unordered_map<uint64_t, std::vector<size_t>> bByHash;
+  for (size_t j = b.segments.size(); j-- > 0;)
+    bByHash[b.segments[j].hash].push_back(j);
+  std::vector<long> same(a.segments.size(), -1);
+  std::vector<bool> bShared(b.segments.size());
+  for (size_t i = 0; i < a.segments.size(); i++) {
+    auto it = bByHash.find(a.segments[i].hash);
+    if (it == bByHash.end() || it->second.empty())
+      continue;
+    same[i] = (long)it->second.back();
+    it->second.pop_back();
+    bShared[same[i]] = true;
+    r.segmentsSkipped++;
+  }
+
+  // differing segments by hash, kept if their merged cards come out equal
+  std::vector<Run> runsA, runsB;
+  for (size_t i = 0; i < a.segments.size(); i++) {
+    if (same[i] >= 0)
+      continue;
+    runsA.emplace_back();
+    if (!readRun(a, a.segments[i], runsA.back()))
+      return false;
+    a.differing.emplace(a.segments[i].hash, a.segments[i]);
+    r.segmentsRead++;
+  }
+  for (size_t j = 0; j < b.segments.size(); j++) {
+    if (bShared[j])
+      continue;
+    runsB.emplace_back();
+    if (!readRun(b, b.segments[j], runsB.back()))
+      return false;
+    b.differing.emplace(b.segments[j].hash, b.segments[j]);
+    r.segmentsRead++;
+  }
+
+  // tombstones are in the indexes, so always compared; they go last so
+  // cards with a repeated front are matched first
+  runsA.push_back(tombstoneRun(a.tombstones));
+  runsB.push_back(tombstoneRun(b.tombstones));
+  auto merged = mergeRuns(runsA, runsB, r);
+  Deck::Tombstones tombstones = takeTombstones(merged);
+  std::error_code ec;
+  std::filesystem::create_directories(b.dir, ec);
+  a.next = SegmentedDeck::nextFile(a.dir);
+  b.next = SegmentedDeck::nextFile(b.dir);
+  size_t k = 0;
+  for (size_t i = 0; i < a.segments.size() || k < merged.size(); i++) {
+    if (i < a.segments.size() && same[i] >= 0) {
+      a.out.push_back(a.segments[i]);
+      b.out.push_back(b.segments[same[i]]);
+      continue;
+    }
+    if (merged[k].empty()) {
+      k++;
+      continue;
+    }
+    std::string data = runData(merged[k]);
+    uint64_t hash = SegmentedDeck::hash(data);
+    if (!place(a, merged[k].size(), data, hash, r) ||
+        !place(b, merged[k].size(), data, hash, r))
+      return false;
+    k++;
+  }
+
+  if ((a.rehashed || !sameFiles(a.out, a.segments) ||
+       a.tombstones != tombstones) &&
+      !SegmentedDeck::writeIndex(pathA, a.name, a.out, tombstones))
+    return false;
+  if ((b.rehashed || !sameFiles(b.out, b.segments) ||
+       b.tombstones != tombstones) &&
+      !SegmentedDeck::writeIndex(pathB, b.name, b.out, tombstones))
+    return false;
+  return true;
+}
+
+// Load both decks (with any checkpoints) and save the sides that change
+static bool syncLoaded(const std::string &pathA, const std::string &pathB,
+                       DeckSync::Result &r) {
+  auto a = FileManager::loadDeck(pathA);
+  auto b = FileManager::loadDeck(pathB);
+  if (!a || !b)
+    return false;
+  std::vector<Run> runsA(1), runsB(1);
+  for (auto [deck, run] : {std::make_pair(a.get(), &runsA[0]),
+                           std::make_pair(b.get(), &runsB[0])}) {
+    for (size_t i = 0; i < deck->size(); i++) {
+      const Card &c = deck->at(i);
+      Entry e;
+      e.line = FileManager::formatCardLine(c);
+      e.frontLength = c.front().size();
+      e.modified = c.modified();
+      e.card = &c;
+      run->push_back(std::move(e));
+    }
+  }
+  runsA.push_back(tombstoneRun(a->tombstones()));
+  runsB.push_back(tombstoneRun(b->tombstones()));
+
+  size_t toA = r.toA, toB = r.toB;
+  auto merged = mergeRuns(runsA, runsB, r);
+  Deck::Tombstones tombstones = takeTombstones(merged);
+  std::vector<Card> cards;
+  for (auto &run : merged) {
+    for (auto *e : run)
+      cards.push_back(*e->card);
+  }
+  if (r.toA > toA) {
+    a->setCards(cards);
+    a->setTombstones(tombstones);
+    if (!FileManager::saveDeck(a, directoryOf(pathA)))
+      return false;
+    r.cardsWritten += cards.size();
+  }
+  if (r.toB > toB) {
+    b->setCards(cards);
+    b->setTombstones(tombstones);
+    if (!FileManager::saveDeck(b, directoryOf(pathB)))
+      return false;
+    r.cardsWritten += cards.size();
+  }
+  return true;
+}
+
+bool DeckSync::syncDirectories(const std::string &a, const std::string &b,
+                               Result &result, std::string &error) {
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  for (auto *dir : {&a, &b}) {
+    if (!fs::is_directory(*dir, ec)) {
+      error = "Not a directory: " + *dir;
+      return false;
+    }
+  }
+  if (fs::equivalent(a, b, ec)) {
+    error = "Both sides are the same directory.";
+    return false;
+  }
+
+  std::set<std::string> inA, inB, all;
+  for (auto &p : FileManager::listDeckFiles(a))
+    inA.insert(fs::path(p).filename().string());
+  for (auto &p : FileManager::listDeckFiles(b))
+    inB.insert(fs::path(p).filename().string());
+  all = inA;
+  all.insert(inB.begin(), inB.end());
+
+  for (auto &file : all) {
+    bool ok;
+    if (!inB.count(file))
+      ok = copyDeck(a + "/" + file, b, result);
+    else if (!inA.count(file))
+      ok = copyDeck(b + "/" + file, a, result);
+    else
+      ok = syncDeck(a + "/" + file, b + "/" + file, result);
+    if (!ok)
+      result.failed.push_back(fs::path(file).stem().string());
+  }
+  return true;
+}
+
+bool DeckSync::syncDeck(const std::string &pathA, const std::string &pathB,
+                        Result &result) {
+  result.decks++;
+  {
+    // always in the same order, so two syncs cannot wait on each other
+    DeckLock first(std::min(pathA, pathB), DeckLock::Exclusive);
+    DeckLock second(std::max(pathA, pathB), DeckLock::Exclusive);
+    if (SegmentedDeck::isSegmented(pathA) &&
+        SegmentedDeck::isSegmented(pathB) && !hasCheckpoint(pathA) &&
+        !hasCheckpoint(pathB))
+      return syncSegmented(pathA, pathB, result);
+  }
+  // FileManager takes the locks itself
+  return syncLoaded(pathA, pathB, result);
+}
+
+bool DeckSync::copyDeck(const std::string &path, const std::string &directory,
+                        Result &result) {
+  result.decksCopied++;
+  std::string target =
+      directory + "/" + std::filesystem::path(path).filename().string();
+  if (SegmentedDeck::isSegmented(path) && !hasCheckpoint(path)) {
+    // file for file, so the two sides' segments match from the start
+    DeckLock from(path, DeckLock::Shared);
+    DeckLock to(target, DeckLock::Exclusive);
+    Side s;
+    if (!readSide(path, s))
+      return false;
+    std::string dir = SegmentedDeck::segmentDirectory(target);
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    std::string data;
+    for (auto &seg : s.segments) {
+      if (!FileManager::readFile(SegmentedDeck::segmentFile(s.dir, seg.file),
+                                 data) ||
+          !FileManager::writeFile(SegmentedDeck::segmentFile(dir, seg.file),
+                                  data, true))
+        return false;
+      result.cardsWritten += seg.count;
+    }
+    return SegmentedDeck::writeIndex(target, s.name, s.segments,
+                                     s.tombstones);
+  }
+
+  auto deck = FileManager::loadDeck(path);
+  if (!deck)
+    return false;
+  deck->segments().clear();
+  result.cardsWritten += deck->size();
+  return FileManager::saveDeck(deck, directory);
+}
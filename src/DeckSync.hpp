@@ -0,0 +1,52 @@
+#ifndef TANKI_DECKSYNC_HPP
+#define TANKI_DECKSYNC_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * Two-way sync of two deck directories (e.g. ~/.tanki_decks and the same
+ * folder of another machine, mounted). Afterwards both hold the same
+ * cards:
+ * - a deck found on one side only is copied to the other
+ * - cards are matched by front text; a card only one side has is added
+ *   to the other, unless the other side holds a newer tombstone for it
+ *   (Deck::Tombstones), in which case it is deleted on both
+ * - of two versions of a card, the one with the newer Card::modified()
+ *   wins, and a deletion counts as a version stamped when it was made;
+ *   on equal stamps a deletion wins, then the greater card line, so the
+ *   outcome does not depend on which side is which or who syncs first
+ * Segmented decks are compared segment by segment using the hashes in
+ * their indexes: segments both sides hold are not read, and only
+ * segments whose cards change are written. Other decks are loaded and
+ * merged whole. Each deck is locked on both sides while it is synced.
+ */
+class DeckSync {
+public:
+  struct Result {
+    size_t decks = 0;       // decks found on both sides
+    size_t decksCopied = 0; // found on one side only
+    size_t toA = 0;         // cards changed, added or deleted on side a
+    size_t toB = 0;
+    size_t ties = 0; // same stamp, different content
+    size_t segmentsSkipped = 0;
+    size_t segmentsRead = 0;
+    size_t cardsWritten = 0; // cards in files that were rewritten
+    std::vector<std::string> failed; // decks that could not be synced
+  };
+
+  // False with `error` set when a directory cannot be read; decks that
+  // fail are listed in result.failed and the rest are still synced
+  static bool syncDirectories(const std::string &a, const std::string &b,
+                              Result &result, std::string &error);
+
+  // One deck both directories have
+  static bool syncDeck(const std::string &pathA, const std::string &pathB,
+                       Result &result);
+  // Copy a deck to a directory that lacks it
+  static bool copyDeck(const std::string &path, const std::string &directory,
+                       Result &result);
+};
+
+#endif // TANKI_DECKSYNC_HPP
@@ -0,0 +1,152 @@
+#include "DeckTree.hpp"
+#include <algorithm>
+#include <map>
+#include <unordered_set>
+
+static const std::string SEPARATOR = "::";
+
+void DeckTree::build(const std::vector<DeckSummary> &decks, time_t now) {
+  std::unordered_set<std::string> folded;
+  for (auto &n : _nodes) {
+    if (n.collapsed)
+      folded.insert(n.name);
+  }
+  _nodes.clear();
+  _roots.clear();
+  _deckNode.assign(decks.size(), -1);
+
+  // one node per distinct prefix of the deck names
+  std::map<std::string, int> byName;
+  for (size_t d = 0; d < decks.size(); d++) {
+    const std::string &name = decks[d].name;
+    int parent = -1;
+    size_t start = 0;
+    while (true) {
+      size_t end = name.find(SEPARATOR, start);
+      std::string prefix = name.substr(0, end);
+      auto it = byName.find(prefix);
+      if (it == byName.end()) {
+        Node n;
+        n.name = prefix;
+        n.label = name.substr(start, end - start); // to the end at npos
+        n.parent = parent;
+        n.depth = parent < 0 ? 0 : _nodes[parent].depth + 1;
+        n.collapsed = folded.count(prefix) > 0;
+        it = byName.emplace(prefix, (int)_nodes.size()).first;
+        _nodes.push_back(n);
+        if (parent < 0)
+          _roots.push_back(it->second);
+        else
+          _nodes[parent].children.push_back(it->second);
+      }
+      parent = it->second;
+      if (end == std::string::npos)
+        break;
+      start = end + SEPARATOR.size();
+    }
+    _nodes[parent].deck = (int)d;
+    _deckNode[d] = parent;
+  }
+
+  auto byLabel = [&](int a, int b) {
+    return _nodes[a].label < _nodes[b].label;
+  };
+  std::sort(_roots.begin(), _roots.end(), byLabel);
+  for (auto &n : _nodes)
+    std::sort(n.children.begin(), n.children.end(), byLabel);
+
+  // parents are created before their children, so summing backwards
+  // finishes each subtree before it is added to its parent
+  for (size_t d = 0; d < decks.size(); d++)
+    _nodes[_deckNode[d]].own = countsOf(decks[d], now);
+  for (int i = (int)_nodes.size() - 1; i >= 0; i--) {
+    Counts &t = _nodes[i].total;
+    t = _nodes[i].own;
+    for (int c : _nodes[i].children) {
+      t.cards += _nodes[c].total.cards;
+      t.due += _nodes[c].total.due;
+      t.newCards += _nodes[c].total.newCards;
+      t.inexact += _nodes[c].total.inexact;
+    }
+  }
+}
+
+void DeckTree::update(int deck, const DeckSummary &s, time_t now) {
+  int i = nodeOf(deck);
+  if (i < 0)
+    return;
+  Counts fresh = countsOf(s, now);
+  Counts &own = _nodes[i].own;
+  Counts delta;
+  delta.cards = fresh.cards - own.cards;
+  delta.due = fresh.due - own.due;
+  delta.newCards = fresh.newCards - own.newCards;
+  delta.inexact = fresh.inexact - own.inexact;
+  own = fresh;
+  addTo(i, delta);
+}
+
+void DeckTree::addTo(int i, const Counts &delta) {
+  if (!delta.cards && !delta.due && !delta.newCards && !delta.inexact)
+    return;
+  for (; i >= 0; i = _nodes[i].parent) {
+    Counts &t = _nodes[i].total;
+    t.cards += delta.cards;
+    t.due += delta.due;
+    t.newCards += delta.newCards;
+    t.inexact += delta.inexact;
+  }
+}
+
+size_t DeckTree::size() const { return _nodes.size(); }
+
+const DeckTree::Node &DeckTree::node(int i) const { return _nodes[i]; }
+
+int DeckTree::nodeOf(int deck) const {
+  if (deck < 0 || deck >= (int)_deckNode.size())
+    return -1;
+  return _deckNode[deck];
+}
+
+std::vector<int> DeckTree::visible() const {
+  std::vector<int> out;
+  std::vector<int> stack(_roots.rbegin(), _roots.rend());
+  while (!stack.empty()) {
+    int i = stack.back();
+    stack.pop_back();
+    out.push_back(i);
+    if (!_nodes[i].collapsed)
+      stack.insert(stack.end(), _nodes[i].children.rbegin(),
+                   _nodes[i].children.rend());
+  }
+  return out;
+}
+
+void DeckTree::toggle(int i) {
+  if (!_nodes[i].children.empty())
+    _nodes[i].collapsed = !_nodes[i].collapsed;
+}
+
+std::vector<int> DeckTree::decksUnder(int i) const {
+  std::vector<int> out;
+  if (i < 0)
+    return out;
+  std::vector<int> stack{i};
+  while (!stack.empty()) {
+    const Node &n = _nodes[stack.back()];
+    stack.pop_back();
+    if (n.deck >= 0)
+      out.push_back(n.deck);
+    stack.insert(stack.end(), n.children.begin(), n.children.end());
+  }
+  return out;
+}
+
+DeckTree::Counts DeckTree::countsOf(const DeckSummary &s, time_t now) {
+  Counts c;
+  c.cards = s.cardCount;
+  c.due = s.dueCount;
+  c.newCards = s.newCount;
+  c.inexact = s.dueExact(now) ? 0 : 1;
+  return c;
+}
@@ -0,0 +1,62 @@
+#ifndef TANKI_DECKTREE_HPP
+#define TANKI_DECKTREE_HPP
+
+#include "DeckManifest.hpp"
+#include <ctime>
+#include <string>
+#include <vector>
+
+/**
+ * Decks named `Parent::Child` arranged as a tree, with card, due and new
+ * counts rolled up per subtree. A parent need not be a deck itself.
+ * When one deck's counts change only the difference is pushed up its
+ * ancestors, so an update costs the deck's depth, not a pass over the
+ * tree or the cards.
+ */
+class DeckTree {
+public:
+  struct Counts {
+    int cards = 0;
+    int due = 0;
+    int newCards = 0;
+    int inexact = 0; // decks whose due count may have grown since taken
+  };
+
+  struct Node {
+    std::string name;  // full name, "Lang::French"
+    std::string label; // last part, "French"
+    int parent = -1;
+    int depth = 0;
+    std::vector<int> children; // ordered by label
+    int deck = -1;             // index in the deck list, -1 if not a deck
+    Counts own;
+    Counts total; // own + every descendant
+    bool collapsed = false;
+  };
+
+  // Rebuild from the deck list; node.deck indexes `decks`. Parents that
+  // were collapsed stay collapsed.
+  void build(const std::vector<DeckSummary> &decks, time_t now);
+  // Deck `deck` (an index given to build) has new counts
+  void update(int deck, const DeckSummary &s, time_t now);
+
+  size_t size() const;
+  const Node &node(int i) const;
+  // Node of a deck index, -1 if unknown
+  int nodeOf(int deck) const;
+  // Nodes to show, parents before children, skipping folded subtrees
+  std::vector<int> visible() const;
+  void toggle(int i);
+  // Deck indexes in node i's subtree, its own deck first
+  std::vector<int> decksUnder(int i) const;
+
+private:
+  std::vector<Node> _nodes;
+  std::vector<int> _roots; // ordered by label
+  std::vector<int> _deckNode;
+
+  static Counts countsOf(const DeckSummary &s, time_t now);
+  void addTo(int i, const Counts &delta);
+};
+
+#endif // TANKI_DECKTREE_HPP
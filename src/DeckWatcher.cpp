@@ -0,0 +1,88 @@
+#include "DeckWatcher.hpp"
+#include <unistd.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+DeckWatcher::DeckWatcher() : _running(false), _inotifyFd(-1) {
+  _wakeFd[0] = _wakeFd[1] = -1;
+}
+
+DeckWatcher::~DeckWatcher() { stop(); }
+
+bool DeckWatcher::start(const std::string &directory) {
+#ifdef __linux__
+  if (_running)
+    return true;
+  _directory = directory;
+  _inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (_inotifyFd < 0)
+    return false;
+  uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE;
+  if (inotify_add_watch(_inotifyFd, directory.c_str(), mask) < 0 ||
+      pipe2(_wakeFd, O_CLOEXEC) < 0) {
+    close(_inotifyFd);
+    _inotifyFd = -1;
+    return false;
+  }
+  _running = true;
+  _thread = std::thread(&DeckWatcher::loop, this);
+  return true;
+#else
+  (void)directory;
+  return false;
+#endif
+}
+
+void DeckWatcher::stop() {
+  if (!_running)
+    return;
+  _running = false;
+  // wake the poll() so the thread sees _running == false
+  char b = 0;
+  if (write(_wakeFd[1], &b, 1) < 0) {
+    // thread still exits on its poll timeout
+  }
+  if (_thread.joinable())
+    _thread.join();
+  close(_inotifyFd);
+  close(_wakeFd[0]);
+  close(_wakeFd[1]);
+  _inotifyFd = -1;
+  _wakeFd[0] = _wakeFd[1] = -1;
+}
+
+std::set<std::string> DeckWatcher::takeChanges() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::set<std::string> out;
+  out.swap(_changed);
+  return out;
+}
+
+void DeckWatcher::loop() {
+#ifdef __linux__
+  alignas(struct inotify_event) char buf[4096];
+  while (_running) {
+    struct pollfd fds[2] = {{_inotifyFd, POLLIN, 0}, {_wakeFd[0], POLLIN, 0}};
+    if (poll(fds, 2, 1000) <= 0 || !(fds[0].revents & POLLIN))
+      continue;
+
+    ssize_t len;
+    while ((len = read(_inotifyFd, buf, sizeof(buf))) > 0) {
+      std::lock_guard<std::mutex> lock(_mutex);
+      for (char *p = buf; p < buf + len;) {
+        auto *ev = reinterpret_cast<struct inotify_event *>(p);
+        p += sizeof(struct inotify_event) + ev->len;
+        if (ev->len == 0)
+          continue;
+        std::string name(ev->name);
+        if (name.size() > 5 && name.compare(name.size() - 5, 5, ".deck") == 0)
+          _changed.insert(_directory + "/" + name);
+      }
+    }
+  }
+#endif
+}
@@ -0,0 +1,40 @@
+#ifndef TANKI_DECKWATCHER_HPP
+#define TANKI_DECKWATCHER_HPP
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+/**
+ * Watches the deck directory for .deck files written, moved or deleted
+ * by other programs (inotify, Linux only; a no-op elsewhere).
+ * Events are coalesced per file on a background thread; the UI thread
+ * picks them up with takeChanges() whenever it is idle.
+ */
+class DeckWatcher {
+public:
+  DeckWatcher();
+  ~DeckWatcher();
+
+  bool start(const std::string &directory);
+  void stop();
+
+  // Paths of deck files that changed since the last call
+  std::set<std::string> takeChanges();
+
+private:
+  std::string _directory;
+  std::thread _thread;
+  std::atomic<bool> _running;
+  int _inotifyFd;
+  int _wakeFd[2];
+
+  std::mutex _mutex;
+  std::set<std::string> _changed;
+
+  void loop();
+};
+
+#endif // TANKI_DECKWATCHER_HPP
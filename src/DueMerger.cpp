@@ -0,0 +1,55 @@
+#include "DueMerger.hpp"
+#include <climits>
+#include <limits>
+
+DueMerger::DueMerger(const std::vector<std::shared_ptr<Deck>> &decks,
+                     int perDeckLimit)
+    : _perDeckLimit(perDeckLimit) {
+  const Deck::DueKey start{std::numeric_limits<time_t>::min(), INT_MIN};
+  for (auto &d : decks) {
+    if (!d)
+      continue;
+    _sources.push_back({d, start, 0});
+    advance(_sources.size() - 1);
+  }
+}
+
+DueMerger::~DueMerger() {}
+
+bool DueMerger::next(time_t now, std::shared_ptr<Deck> &deck, int &cardId) {
+  while (!_heap.empty()) {
+    Head top = _heap.top();
+    Source &src = _sources[top.source];
+
+    // The deck may have changed since this head was peeked
+    // (card rescheduled, suspended or deleted) - re-read from the cursor.
+    const Card *c = src.deck->findCard(top.key.second);
+    if (!c || c->isSuspended() || c->dueDate() != top.key.first) {
+      _heap.pop();
+      advance(top.source);
+      continue;
+    }
+
+    if (top.key.first > now)
+      return false;
+
+    _heap.pop();
+    src.cursor = top.key;
+    src.taken++;
+    advance(top.source);
+
+    deck = src.deck;
+    cardId = top.key.second;
+    return true;
+  }
+  return false;
+}
+
+void DueMerger::advance(size_t source) {
+  Source &src = _sources[source];
+  if (_perDeckLimit > 0 && src.taken >= _perDeckLimit)
+    return;
+  Deck::DueKey key;
+  if (src.deck->nextDue(src.cursor, key))
+    _heap.push({key, source});
+}
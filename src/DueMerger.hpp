@@ -0,0 +1,51 @@
+#ifndef TANKI_DUEMERGER_HPP
+#define TANKI_DUEMERGER_HPP
+
+#include "Deck.hpp"
+#include <memory>
+#include <queue>
+#include <vector>
+
+/**
+ * K-way merge of the due cards of several decks.
+ * - Each deck is walked through its due index with a cursor
+ * - Only the head of every deck sits in the heap, so setup is O(k log k)
+ * - Cards are pulled one at a time in due-date order across all decks
+ */
+class DueMerger {
+public:
+  // perDeckLimit <= 0 means no limit
+  DueMerger(const std::vector<std::shared_ptr<Deck>> &decks,
+            int perDeckLimit = 0);
+  ~DueMerger();
+
+  // Pops the earliest card due at or before `now`.
+  // Returns false when no deck has a card due by then.
+  bool next(time_t now, std::shared_ptr<Deck> &deck, int &cardId);
+
+private:
+  struct Source {
+    std::shared_ptr<Deck> deck;
+    Deck::DueKey cursor;
+    int taken;
+  };
+
+  struct Head {
+    Deck::DueKey key;
+    size_t source;
+  };
+
+  struct Later {
+    bool operator()(const Head &a, const Head &b) const {
+      return a.key > b.key;
+    }
+  };
+
+  std::vector<Source> _sources;
+  std::priority_queue<Head, std::vector<Head>, Later> _heap;
+  int _perDeckLimit;
+
+  void advance(size_t source);
+};
+
+#endif // TANKI_DUEMERGER_HPP
@@ -1,10 +1,51 @@
 #include "FileManager.hpp"
+#include "CompressedDeck.hpp"
+#include "DeckLock.hpp"
+#include "Metrics.hpp"
+#include "NearDuplicates.hpp"
+#include "SegmentedDeck.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <pwd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
 #include <unordered_set>
 
+static Metrics::Counter &bytesRead() {
+  static auto &c = Metrics::counter("tanki_deck_read_bytes_total",
+                                    "Bytes of deck and segment files read");
+  return c;
+}
+
+static Metrics::Counter &bytesWritten() {
+  static auto &c = Metrics::counter("tanki_deck_written_bytes_total",
+                                    "Bytes of deck and segment files written");
+  return c;
+}
+
+static std::string getHomeDirectory() {
+  const char *home = getenv("HOME");
+  if (!home) {
+    struct passwd *pw = getpwuid(getuid());
+    home = pw->pw_dir;
+  }
+  return std::string(home);
+}
+
+std::string FileManager::deckDirectory() {
+  return getHomeDirectory() + "/.tanki_decks";
+}
+
 std::vector<std::string>
 FileManager::listDeckFiles(const std::string &directory) {
   std::vector<std::string> result;
@@ -17,67 +58,320 @@ FileManager::listDeckFiles(const std::string &directory) {
 }
 
 std::shared_ptr<Deck> FileManager::loadDeck(const std::string &path) {
-  std::ifstream fin(path);
-  if (!fin.good())
-    return nullptr;
+  static auto &seconds = Metrics::histogram(
+      "tanki_deck_load_seconds", "Time to read and parse one deck file");
+  Metrics::Timer timer(seconds);
+  DeckLock lock(path, DeckLock::Shared);
+  auto deck = readDeck(path);
+  if (deck)
+    deck->markSynced();
+  std::string checkpoint = checkpointPath(path);
+  if (deck && access(checkpoint.c_str(), F_OK) == 0) {
+    // progress (and deletions) of a session that ended without saving;
+    // cards only in the checkpoint are not in the file, so stay unsynced
+    if (auto saved = readDeck(checkpoint))
+      deck->mergeFrom(*saved);
+  }
+  return deck;
+}
 
-  std::string deckName;
-  if (!std::getline(fin, deckName)) {
-    return nullptr;
+std::shared_ptr<Deck> FileManager::readDeck(const std::string &path) {
+  std::shared_ptr<Deck> deck;
+  if (CompressedDeck::isCompressed(path)) {
+    deck = CompressedDeck::read(path);
+    std::error_code ec;
+    bytesRead().add(std::filesystem::file_size(path, ec));
+  } else if (SegmentedDeck::isSegmented(path)) {
+    deck = SegmentedDeck::read(path);
+  } else {
+    std::string data;
+    if (!readFile(path, data))
+      return nullptr;
+
+    size_t nl = data.find('\n');
+    if (data.empty() || nl == 0)
+      return nullptr;
+    deck = std::make_shared<Deck>(data.substr(0, nl));
+
+    std::string line, front;
+    std::vector<Card> cards;
+    Deck::Tombstones tombstones;
+    for (size_t pos = nl; pos != std::string::npos && pos < data.size();) {
+      size_t start = pos + 1;
+      pos = data.find('\n', start);
+      line.assign(data, start,
+                  (pos == std::string::npos ? data.size() : pos) - start);
+      Card c;
+      time_t when;
+      if (parseCardLine(line, c))
+        cards.push_back(std::move(c));
+      else if (parseTombstone(line, front, when))
+        tombstones[front] = when;
+    }
+    deck->addCards(std::move(cards));
+    deck->setTombstones(std::move(tombstones));
   }
-  auto deck = std::make_shared<Deck>(deckName);
+  if (!deck)
+    return nullptr;
+  deck->compact();
 
-  // Each line: front|back|interval|EF|dueDate|suspended|tags
-  std::string line;
-  while (std::getline(fin, line)) {
-    if (line.empty())
-      continue;
-    std::stringstream ss(line);
+  int64_t mtime;
+  uintmax_t size;
+  if (fileIdentity(path, mtime, size))
+    deck->setFileStamp(mtime, size);
+  return deck;
+}
 
-    std::string front, back, iStr, efStr, dueStr, suspStr, tags;
-    if (!std::getline(ss, front, '|'))
-      continue;
-    if (!std::getline(ss, back, '|'))
-      continue;
-    if (!std::getline(ss, iStr, '|'))
-      continue;
-    if (!std::getline(ss, efStr, '|'))
-      continue;
-    if (!std::getline(ss, dueStr, '|'))
-      continue;
-    if (!std::getline(ss, suspStr, '|'))
-      continue;
-    if (!std::getline(ss, tags, '|'))
-      continue;
+// Each line: front|back|interval|EF|dueDate|suspended|tags|modified|recall
+// (modified and recall are optional; older files stop after tags, and
+// recall, in tenths of a second, is only written for timed cards)
+bool FileManager::parseCardLine(const std::string &line, Card &out) {
+  if (line.empty())
+    return false;
+  std::stringstream ss(line);
 
-    Card c(front, back);
+  std::string front, back, iStr, efStr, dueStr, suspStr, tags;
+  if (!std::getline(ss, front, '|'))
+    return false;
+  if (!std::getline(ss, back, '|'))
+    return false;
+  if (!std::getline(ss, iStr, '|'))
+    return false;
+  if (!std::getline(ss, efStr, '|'))
+    return false;
+  if (!std::getline(ss, dueStr, '|'))
+    return false;
+  if (!std::getline(ss, suspStr, '|'))
+    return false;
+  if (!std::getline(ss, tags, '|'))
+    return false;
+  std::string modStr, recallStr;
+  std::getline(ss, modStr, '|');
+  std::getline(ss, recallStr, '|');
+
+  Card c(front, back);
+  // a damaged line is skipped, not thrown out of loadDeck
+  try {
     c.setInterval(std::stoi(iStr));
     c.setEaseFactor(std::stod(efStr));
     c.setDueDate(std::stol(dueStr));
-    c.setSuspended(suspStr == "1");
-    c.setTags(tags);
+    if (!modStr.empty())
+      c.setModified(std::stol(modStr));
+    if (!recallStr.empty())
+      c.setRecallTime(std::stoi(recallStr) / 10.0);
+  } catch (...) {
+    return false;
+  }
+  c.setSuspended(suspStr == "1");
+  c.setTags(tags);
+  out = c;
+  return true;
+}
 
-    deck->addCard(c);
+bool FileManager::parseTombstone(const std::string &line, std::string &front,
+                                 time_t &when) {
+  static const std::string mark = "|deleted|";
+  size_t bar = line.find('|');
+  if (bar == std::string::npos || line.compare(bar, mark.size(), mark) != 0)
+    return false;
+  const char *stamp = line.c_str() + bar + mark.size();
+  char *end = nullptr;
+  when = (time_t)std::strtoll(stamp, &end, 10);
+  if (end == stamp || std::string(end) != "|")
+    return false;
+  front = line.substr(0, bar);
+  return true;
+}
+
+std::string FileManager::formatTombstone(const std::string &front,
+                                         time_t when) {
+  return front + "|deleted|" + std::to_string((long long)when) + "|";
+}
+
+std::string
+FileManager::formatTombstones(const Deck::Tombstones &tombstones) {
+  std::vector<std::pair<std::string, time_t>> sorted(tombstones.begin(),
+                                                     tombstones.end());
+  std::sort(sorted.begin(), sorted.end());
+  std::string out;
+  for (auto &t : sorted) {
+    out += formatTombstone(t.first, t.second);
+    out += '\n';
   }
-  return deck;
+  return out;
+}
+
+std::string FileManager::formatCardLine(const Card &c) {
+  std::ostringstream oss;
+  oss << c.front() << "|" << c.back() << "|" << c.interval() << "|"
+      << c.easeFactor() << "|" << c.dueDate() << "|"
+      << (c.isSuspended() ? "1" : "0") << "|" << c.tagsString() << "|"
+      << c.modified() << "|";
+  if (c.recallTime() > 0)
+    oss << std::lround(c.recallTime() * 10.0) << "|";
+  return oss.str();
 }
 
 bool FileManager::saveDeck(std::shared_ptr<Deck> deck,
                            const std::string &directory) {
   if (!deck)
     return false;
+  static auto &seconds = Metrics::histogram(
+      "tanki_deck_save_seconds", "Time to merge and write one deck file");
+  Metrics::Timer timer(seconds);
   std::string filename = directory + "/" + deck->name() + ".deck";
-  std::ofstream fout(filename);
-  if (!fout.is_open())
+  DeckLock lock(filename, DeckLock::Exclusive);
+
+  int64_t mtime;
+  uintmax_t size;
+  if (fileIdentity(filename, mtime, size) &&
+      !deck->matchesFileStamp(mtime, size)) {
+    // written by someone else since we read it - keep their reviews too
+    if (auto disk = readDeck(filename)) {
+      deck->mergeFrom(*disk);
+      // its segment files may have been replaced as well
+      deck->segments().clear();
+    }
+  }
+
+  if (deck->format() == Deck::Plain && deck->size() > SegmentedDeck::threshold)
+    deck->setFormat(Deck::Segmented);
+
+  if (deck->format() == Deck::Segmented) {
+    if (!SegmentedDeck::write(*deck, filename))
+      return false;
+  } else if (deck->format() == Deck::Compressed &&
+             CompressedDeck::available()) {
+    if (!CompressedDeck::write(*deck, filename))
+      return false;
+    SegmentedDeck::removeSegments(filename);
+  } else {
+    std::string data = deck->name() + "\n";
+    for (size_t i = 0; i < deck->size(); i++) {
+      data += formatCardLine(deck->at(i));
+      data += '\n';
+    }
+    data += formatTombstones(deck->tombstones());
+    if (!replaceFile(filename, data))
+      return false;
+    SegmentedDeck::removeSegments(filename);
+  }
+
+  if (fileIdentity(filename, mtime, size))
+    deck->setFileStamp(mtime, size);
+  deck->markSynced();
+  deck->clearRemoved();
+  std::remove(checkpointPath(filename).c_str());
+  return true;
+}
+
+bool FileManager::readFile(const std::string &path, std::string &out) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0;
+  out.clear();
+  if (ok)
+    out.resize(st.st_size);
+  size_t got = 0;
+  while (ok) {
+    if (got == out.size())
+      out.resize(got + 65536); // grew since fstat
+    ssize_t len = read(fd, &out[got], out.size() - got);
+    if (len < 0 && errno == EINTR)
+      continue;
+    if (len <= 0) {
+      ok = len == 0;
+      break;
+    }
+    got += len;
+  }
+  close(fd);
+  out.resize(got);
+  bytesRead().add(got);
+  return ok;
+}
+
+static bool writeAll(int fd, const std::string &data) {
+  size_t put = 0;
+  while (put < data.size()) {
+    ssize_t len = write(fd, data.data() + put, data.size() - put);
+    if (len < 0 && errno == EINTR)
+      continue;
+    if (len <= 0)
+      break;
+    put += len;
+  }
+  bytesWritten().add(put);
+  return put == data.size();
+}
+
+bool FileManager::writeFile(const std::string &path, const std::string &data,
+                            bool sync) {
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return false;
+  bool ok = writeAll(fd, data) && (!sync || fsync(fd) == 0);
+  return close(fd) == 0 && ok;
+}
+
+bool FileManager::replaceFile(const std::string &path,
+                              const std::string &data) {
+  std::string tmp = path + ".tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+    return false;
+  bool ok = writeAll(fd, data) && fsync(fd) == 0;
+  ok = close(fd) == 0 && ok;
+  if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+    std::remove(tmp.c_str());
     return false;
+  }
+  // make the rename itself durable
+  size_t slash = path.find_last_of('/');
+  syncDirectory(slash == std::string::npos ? "." : path.substr(0, slash));
+  return true;
+}
 
-  fout << deck->name() << "\n";
-  for (auto &c : deck->cards()) {
-    fout << c.front() << "|" << c.back() << "|" << c.interval() << "|"
-         << c.easeFactor() << "|" << c.dueDate() << "|"
-         << (c.isSuspended() ? "1" : "0") << "|" << c.tagsString() << "|"
-         << "\n";
+void FileManager::syncDirectory(const std::string &dir) {
+  int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd >= 0) {
+    fsync(fd);
+    close(fd);
   }
+}
+
+std::string FileManager::checkpointPath(const std::string &deckPath) {
+  size_t slash = deckPath.find_last_of('/');
+  if (slash == std::string::npos)
+    return "." + deckPath + ".autosave";
+  return deckPath.substr(0, slash + 1) + "." + deckPath.substr(slash + 1) +
+         ".autosave";
+}
+
+bool FileManager::deleteDeck(const std::string &path) {
+  std::error_code ec, ignored;
+  // everything goes while the lock is held; DeckLock re-opens the lock
+  // file for anyone who was waiting on the one removed here
+  DeckLock lock(path, DeckLock::Exclusive);
+  std::filesystem::remove(path, ec);
+  SegmentedDeck::removeSegments(path);
+  std::filesystem::remove(checkpointPath(path), ignored);
+  std::filesystem::remove(DeckLock::lockPath(path), ignored);
+  return !ec;
+}
+
+bool FileManager::fileIdentity(const std::string &path, int64_t &mtime,
+                               uintmax_t &size) {
+  std::error_code ec;
+  auto t = std::filesystem::last_write_time(path, ec);
+  if (ec)
+    return false;
+  size = std::filesystem::file_size(path, ec);
+  if (ec)
+    return false;
+  mtime = (int64_t)t.time_since_epoch().count();
   return true;
 }
 
@@ -86,25 +380,37 @@ bool FileManager::saveDeck(std::shared_ptr<Deck> deck,
  * Check duplicates by storing existing "front|back" combos in a set
  */
 bool FileManager::importCSV(std::shared_ptr<Deck> deck,
-                            const std::string &csvPath) {
+                            const std::string &csvPath,
+                            size_t *nearDuplicates) {
   if (!deck)
     return false;
+  if (nearDuplicates)
+    *nearDuplicates = 0;
 
   // Build a set of existing front|back combos
   std::unordered_set<std::string> existing;
   for (auto &card : deck->cards()) {
-    existing.insert(card.front() + "|" + card.back());
+    existing.insert(std::string(card.front()) + "|" + std::string(card.back()));
   }
 
   std::ifstream fin(csvPath);
   if (!fin.is_open()) {
     return false;
   }
+  auto similar = NearDuplicates::indexDeck(*deck);
 
+  static auto &rowCount = Metrics::counter("tanki_import_rows_total",
+                                           "Rows read by CSV and Anki imports");
+  static auto &rowRate = Metrics::gauge("tanki_import_rows_per_second",
+                                        "Row rate of the last import");
+  auto start = std::chrono::steady_clock::now();
+  size_t rows = 0;
   std::string line;
+  std::vector<Card> added; // appended at the end, indexed once
   while (std::getline(fin, line)) {
     if (line.empty())
       continue;
+    rows++;
     std::stringstream ss(line);
     std::string front, back;
     if (!std::getline(ss, front, ','))
@@ -124,14 +430,26 @@ bool FileManager::importCSV(std::shared_ptr<Deck> deck,
 
     // check duplicate
     std::string combo = front + "|" + back;
-    if (existing.find(combo) == existing.end()) {
-      // new
-      Card c(front, back);
-      deck->addCard(c);
-      existing.insert(combo);
+    if (existing.find(combo) != existing.end())
+      continue;
+    auto sig = NearDuplicates::signature(front, back);
+    int match;
+    double score;
+    if (similar.find(sig, NearDuplicates::defaultThreshold, match, score)) {
+      if (nearDuplicates)
+        (*nearDuplicates)++;
+      continue;
     }
-    // else skip duplicate
+    Card c(front, back);
+    existing.insert(combo);
+    similar.add(c.id(), sig);
+    added.push_back(std::move(c));
   }
+  deck->addCards(std::move(added));
+  rowCount.add(rows);
+  std::chrono::duration<double> took =
+      std::chrono::steady_clock::now() - start;
+  rowRate.set(rows / std::max(took.count(), 1e-6));
   return true;
 }
 
@@ -2,22 +2,71 @@
 #define TANKI_FILEMANAGER_HPP
 
 #include "Deck.hpp"
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
 
 class FileManager {
 public:
+  // ~/.tanki_decks
+  static std::string deckDirectory();
+
   static std::vector<std::string> listDeckFiles(const std::string &directory);
+  // Both take the deck's advisory lock (shared / exclusive).
+  // loadDeck folds in the deck's autosave checkpoint, if a session that
+  // wrote one ended without saving; saveDeck first merges in whatever
+  // another process wrote to the file since this deck was read, and
+  // removes the checkpoint once the deck is saved.
   static std::shared_ptr<Deck> loadDeck(const std::string &path);
   static bool saveDeck(std::shared_ptr<Deck> deck,
                        const std::string &directory);
 
-  // CSV import with duplicates check
-  static bool importCSV(std::shared_ptr<Deck> deck, const std::string &csvPath);
+  // Remove a deck file (under its exclusive lock) and its lock file
+  static bool deleteDeck(const std::string &path);
+
+  // One card as a line of the plain .deck format
+  static bool parseCardLine(const std::string &line, Card &out);
+  static std::string formatCardLine(const Card &c);
+  // A tombstone (see Deck::Tombstones) as a line among the cards:
+  // front|deleted|stamp| - too few fields for parseCardLine, so readers
+  // that predate tombstones skip it
+  static bool parseTombstone(const std::string &line, std::string &front,
+                             time_t &when);
+  static std::string formatTombstone(const std::string &front, time_t when);
+  // All of them, one line each, ordered by front
+  static std::string formatTombstones(const Deck::Tombstones &tombstones);
+
+  // Whole-file read / write with a single large buffer; `sync` fsyncs
+  // the file before it is closed
+  static bool readFile(const std::string &path, std::string &out);
+  static bool writeFile(const std::string &path, const std::string &data,
+                        bool sync = false);
+  // Write a temporary file, fsync it and rename it over `path`, so a
+  // crash leaves either the old contents or the new ones
+  static bool replaceFile(const std::string &path, const std::string &data);
+  // fsync a directory, so files created or renamed in it survive a crash
+  static void syncDirectory(const std::string &dir);
+
+  // Hidden `.<deck>.deck.autosave` beside a deck file (see Autosave)
+  static std::string checkpointPath(const std::string &deckPath);
+
+  // (mtime, size) of a file; false if it cannot be stat'ed
+  static bool fileIdentity(const std::string &path, int64_t &mtime,
+                           uintmax_t &size);
+
+  // CSV import with duplicates check. Rows that nearly repeat a card
+  // already in the deck (see NearDuplicates) are skipped as well and
+  // counted in `nearDuplicates`.
+  static bool importCSV(std::shared_ptr<Deck> deck, const std::string &csvPath,
+                        size_t *nearDuplicates = nullptr);
 
   // Not implemented
   static bool exportCSV(std::shared_ptr<Deck> deck, const std::string &csvPath);
+
+private:
+  // Parse without locking; caller holds the lock
+  static std::shared_ptr<Deck> readDeck(const std::string &path);
 };
 
 #endif // TANKI_FILEMANAGER_HPP
@@ -0,0 +1,192 @@
+#include "Metrics.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<double>::is_always_lock_free,
+              "metric updates must not take a lock");
+
+const double Metrics::Histogram::bounds[Buckets] = {
+    0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01,
+    0.025,   0.05,   0.1,     0.25,   0.5,   1,      2.5,    10};
+
+static const int EXPORT_SECONDS = 15;
+
+namespace {
+struct Entry {
+  enum Type { CounterType, GaugeType, HistogramType };
+  Type type;
+  std::string name;
+  std::string help;
+  Metrics::Counter counter;
+  Metrics::Gauge gauge;
+  Metrics::Histogram histogram;
+};
+
+struct Registry {
+  std::mutex lock;
+  std::vector<std::unique_ptr<Entry>> entries;
+  std::string role = "cli";
+
+  // background export
+  std::thread thread;
+  std::mutex stopLock;
+  std::condition_variable wake;
+  bool stopping = false;
+};
+} // namespace
+
+static Registry &registry() {
+  static Registry r;
+  return r;
+}
+
+static Entry &entry(const std::string &name, const std::string &help,
+                    Entry::Type type) {
+  Registry &r = registry();
+  std::lock_guard<std::mutex> guard(r.lock);
+  for (auto &e : r.entries) {
+    if (e->name == name)
+      return *e;
+  }
+  r.entries.push_back(std::make_unique<Entry>());
+  Entry &e = *r.entries.back();
+  e.type = type;
+  e.name = name;
+  e.help = help;
+  return e;
+}
+
+void Metrics::Histogram::observe(double seconds) {
+  int i = 0;
+  while (i < Buckets && seconds > bounds[i])
+    i++;
+  _counts[i].fetch_add(1, std::memory_order_relaxed);
+  _sumNanos.fetch_add((uint64_t)(std::max(seconds, 0.0) * 1e9),
+                      std::memory_order_relaxed);
+}
+
+uint64_t Metrics::Histogram::count(int bucket) const {
+  return _counts[bucket].load(std::memory_order_relaxed);
+}
+
+double Metrics::Histogram::sum() const {
+  return _sumNanos.load(std::memory_order_relaxed) / 1e9;
+}
+
+Metrics::Counter &Metrics::counter(const std::string &name,
+                                   const std::string &help) {
+  return entry(name, help, Entry::CounterType).counter;
+}
+
+Metrics::Gauge &Metrics::gauge(const std::string &name,
+                               const std::string &help) {
+  return entry(name, help, Entry::GaugeType).gauge;
+}
+
+Metrics::Histogram &Metrics::histogram(const std::string &name,
+                                       const std::string &help) {
+  return entry(name, help, Entry::HistogramType).histogram;
+}
+
+std::string Metrics::prometheusText() {
+  Registry &r = registry();
+  std::lock_guard<std::mutex> guard(r.lock);
+  std::ostringstream out;
+  out << std::setprecision(9);
+  std::string role = "role=\"" + r.role + "\"";
+  for (auto &e : r.entries) {
+    static const char *types[] = {"counter", "gauge", "histogram"};
+    out << "# HELP " << e->name << " " << e->help << "\n"
+        << "# TYPE " << e->name << " " << types[e->type] << "\n";
+    if (e->type == Entry::CounterType) {
+      out << e->name << "{" << role << "} " << e->counter.value() << "\n";
+    } else if (e->type == Entry::GaugeType) {
+      out << e->name << "{" << role << "} " << e->gauge.value() << "\n";
+    } else {
+      // Prometheus buckets are cumulative
+      uint64_t total = 0;
+      for (int i = 0; i <= Histogram::Buckets; i++) {
+        total += e->histogram.count(i);
+        out << e->name << "_bucket{" << role << ",le=\"";
+        if (i < Histogram::Buckets)
+          out << Histogram::bounds[i];
+        else
+          out << "+Inf";
+        out << "\"} " << total << "\n";
+      }
+      out << e->name << "_sum{" << role << "} " << e->histogram.sum() << "\n"
+          << e->name << "_count{" << role << "} " << total << "\n";
+    }
+  }
+  return out.str();
+}
+
+std::string Metrics::exportDirectory(const std::string &deckDir) {
+  return deckDir + "/.metrics";
+}
+
+void Metrics::startExport(const std::string &deckDir,
+                          const std::string &role) {
+  Registry &r = registry();
+  {
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.role = role;
+  }
+  const char *env = std::getenv("TANKI_METRICS");
+  if ((env && std::string(env) == "off") || r.thread.joinable())
+    return;
+  std::error_code ec;
+  std::filesystem::create_directories(exportDirectory(deckDir), ec);
+  r.stopping = false;
+  r.thread =
+      std::thread(exportLoop, exportDirectory(deckDir) + "/" + role + ".prom");
+}
+
+void Metrics::stopExport() {
+  Registry &r = registry();
+  if (!r.thread.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> guard(r.stopLock);
+    r.stopping = true;
+  }
+  r.wake.notify_all();
+  r.thread.join();
+}
+
+void Metrics::exportLoop(std::string path) {
+  Registry &r = registry();
+  writeFile(path);
+  std::unique_lock<std::mutex> lock(r.stopLock);
+  bool last = false;
+  while (!last) {
+    last = r.wake.wait_for(lock, std::chrono::seconds(EXPORT_SECONDS),
+                           [&] { return r.stopping; });
+    lock.unlock();
+    writeFile(path);
+    lock.lock();
+  }
+}
+
+bool Metrics::writeFile(const std::string &path) {
+  // scrapers must never see a half-written file
+  std::string tmp = path + ".tmp";
+  {
+    std::ofstream fout(tmp, std::ios::trunc);
+    fout << prometheusText();
+    if (!fout)
+      return false;
+  }
+  return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
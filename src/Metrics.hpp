@@ -0,0 +1,92 @@
+#ifndef TANKI_METRICS_HPP
+#define TANKI_METRICS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/**
+ * Process-wide counters, gauges and latency histograms, exported in the
+ * Prometheus text format. Updating a metric is a relaxed atomic
+ * operation, so they stay on everywhere; only registering a metric
+ * (once, on first use) and exporting take the registry lock.
+ *
+ *   static auto &saves = Metrics::counter("tanki_x_total", "Help text");
+ *   saves.add();
+ */
+class Metrics {
+public:
+  class Counter {
+  public:
+    void add(uint64_t n = 1) { _value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return _value.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<uint64_t> _value{0};
+  };
+
+  class Gauge {
+  public:
+    void set(double v) { _value.store(v, std::memory_order_relaxed); }
+    double value() const { return _value.load(std::memory_order_relaxed); }
+
+  private:
+    std::atomic<double> _value{0};
+  };
+
+  // Durations in seconds, counted in fixed buckets from 50us to 10s
+  class Histogram {
+  public:
+    static constexpr int Buckets = 16;
+    static const double bounds[Buckets]; // upper bounds, ascending
+
+    void observe(double seconds);
+    // Observations in bucket i alone (Buckets = above the last bound)
+    uint64_t count(int bucket) const;
+    double sum() const;
+
+  private:
+    std::atomic<uint64_t> _counts[Buckets + 1] = {};
+    std::atomic<uint64_t> _sumNanos{0};
+  };
+
+  // Observes the time from construction to destruction
+  class Timer {
+  public:
+    explicit Timer(Histogram &h)
+        : _histogram(h), _start(std::chrono::steady_clock::now()) {}
+    ~Timer() { _histogram.observe(seconds()); }
+    double seconds() const {
+      return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                           _start)
+          .count();
+    }
+
+  private:
+    Histogram &_histogram;
+    std::chrono::steady_clock::time_point _start;
+  };
+
+  // The metric called `name`, registered on first use
+  static Counter &counter(const std::string &name, const std::string &help);
+  static Gauge &gauge(const std::string &name, const std::string &help);
+  static Histogram &histogram(const std::string &name,
+                              const std::string &help);
+
+  // Every metric in the Prometheus text format, labelled with the role
+  static std::string prometheusText();
+
+  // Export to <deck dir>/.metrics/<role>.prom every few seconds from a
+  // background thread, and once more on stopExport. TANKI_METRICS=off
+  // turns the file off (metrics are still collected).
+  static void startExport(const std::string &deckDir, const std::string &role);
+  static void stopExport();
+  static std::string exportDirectory(const std::string &deckDir);
+
+private:
+  static bool writeFile(const std::string &path);
+  static void exportLoop(std::string path);
+};
+
+#endif // TANKI_METRICS_HPP
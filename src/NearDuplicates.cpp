@@ -0,0 +1,212 @@
+#include "NearDuplicates.hpp"
+#include <algorithm>
+#include <thread>
+
+// characters per shingle
+static const size_t shingleSize = 4;
+// cards in one LSH bucket compared against each other, at most
+static const size_t bucketWindow = 32;
+
+static uint64_t mix64(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+static uint64_t fnv1a(const char *p, size_t n, uint64_t h) {
+  for (size_t i = 0; i < n; i++) {
+    h ^= (unsigned char)p[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+// one multiply-shift hash (h * a + b) >> 32 per signature slot
+struct SlotHashes {
+  std::array<uint64_t, NearDuplicates::Hashes> a, b;
+};
+
+static const SlotHashes &slotHashes() {
+  static const auto s = [] {
+    SlotHashes out;
+    uint64_t x = 0x9e3779b97f4a7c15ULL;
+    for (int k = 0; k < NearDuplicates::Hashes; k++) {
+      out.a[k] = mix64(x += 0x9e3779b97f4a7c15ULL) | 1;
+      out.b[k] = mix64(x += 0x9e3779b97f4a7c15ULL);
+    }
+    return out;
+  }();
+  return s;
+}
+
+std::string NearDuplicates::normalize(std::string_view text) {
+  std::string out;
+  out.reserve(text.size());
+  bool space = true; // drop leading spaces
+  for (char ch : text) {
+    unsigned char u = (unsigned char)ch;
+    bool upper = u >= 'A' && u <= 'Z';
+    if (u >= 0x80 || upper || (u >= 'a' && u <= 'z') ||
+        (u >= '0' && u <= '9')) {
+      out += upper ? (char)(u + ('a' - 'A')) : ch;
+      space = false;
+    } else if (!space) {
+      out += ' ';
+      space = true;
+    }
+  }
+  if (!out.empty() && out.back() == ' ')
+    out.pop_back();
+  return out;
+}
+
+NearDuplicates::Signature NearDuplicates::signature(std::string_view front,
+                                                    std::string_view back) {
+  std::string text = normalize(front) + " | " + normalize(back);
+  const auto &slot = slotHashes();
+  Signature sig;
+  sig.fill(UINT32_MAX);
+
+  size_t count = text.size() < shingleSize ? 1
+                                           : text.size() - shingleSize + 1;
+  for (size_t i = 0; i < count; i++) {
+    uint64_t h = mix64(fnv1a(text.data() + i,
+                             std::min(shingleSize, text.size() - i),
+                             0xcbf29ce484222325ULL));
+    for (int k = 0; k < Hashes; k++) {
+      uint32_t v = (uint32_t)((h * slot.a[k] + slot.b[k]) >> 32);
+      if (v < sig[k])
+        sig[k] = v;
+    }
+  }
+  return sig;
+}
+
+double NearDuplicates::similarity(const Signature &a, const Signature &b) {
+  int same = 0;
+  for (int k = 0; k < Hashes; k++)
+    same += a[k] == b[k];
+  return (double)same / Hashes;
+}
+
+uint64_t NearDuplicates::bandKey(const Signature &sig, int band) {
+  const int rows = Hashes / Bands;
+  return fnv1a(reinterpret_cast<const char *>(&sig[band * rows]),
+               rows * sizeof(uint32_t), 0xcbf29ce484222325ULL + band);
+}
+
+void NearDuplicates::Index::add(int id, const Signature &sig) {
+  uint32_t pos = (uint32_t)_entries.size();
+  _entries.push_back({id, sig});
+  for (int b = 0; b < Bands; b++)
+    _buckets[bandKey(sig, b)].push_back(pos);
+}
+
+bool NearDuplicates::Index::find(const Signature &sig, double threshold,
+                                 int &id, double &similarity) const {
+  bool found = false;
+  similarity = 0;
+  for (int b = 0; b < Bands; b++) {
+    auto it = _buckets.find(bandKey(sig, b));
+    if (it == _buckets.end())
+      continue;
+    for (uint32_t pos : it->second) {
+      double s = NearDuplicates::similarity(sig, _entries[pos].second);
+      if (s >= threshold && s > similarity) {
+        id = _entries[pos].first;
+        similarity = s;
+        found = true;
+      }
+    }
+  }
+  return found;
+}
+
+NearDuplicates::Index NearDuplicates::indexDeck(const Deck &deck,
+                                                unsigned threads) {
+  auto sigs = signatures(deck, threads);
+  Index index;
+  for (size_t i = 0; i < sigs.size(); i++)
+    index.add(deck.at(i).id(), sigs[i]);
+  return index;
+}
+
+std::vector<NearDuplicates::Match>
+NearDuplicates::findInDeck(const Deck &deck, double threshold,
+                           unsigned threads) {
+  auto sigs = signatures(deck, threads);
+  size_t n = sigs.size();
+
+  // per band: sort (band key, position) and compare within equal keys
+  std::vector<std::vector<std::pair<uint32_t, uint32_t>>> found(Bands);
+  parallelFor(Bands, threads, [&](size_t first, size_t last) {
+    std::vector<std::pair<uint64_t, uint32_t>> keys(n);
+    for (size_t b = first; b < last; b++) {
+      for (size_t i = 0; i < n; i++)
+        keys[i] = {bandKey(sigs[i], (int)b), (uint32_t)i};
+      std::sort(keys.begin(), keys.end());
+      for (size_t start = 0, i = 1; i < n; i++) {
+        if (keys[i].first != keys[start].first) {
+          start = i;
+          continue;
+        }
+        size_t from = std::max(start, i > bucketWindow ? i - bucketWindow : 0);
+        for (size_t j = from; j < i; j++) {
+          if (similarity(sigs[keys[j].second], sigs[keys[i].second]) >=
+              threshold)
+            found[b].push_back({keys[j].second, keys[i].second});
+        }
+      }
+    }
+  });
+
+  // best earlier card for each duplicate
+  std::vector<std::pair<double, uint32_t>> best(n, {-1.0, 0});
+  for (auto &band : found) {
+    for (auto &pair : band) {
+      double s = similarity(sigs[pair.first], sigs[pair.second]);
+      auto &cur = best[pair.second];
+      if (s > cur.first || (s == cur.first && pair.first < cur.second))
+        cur = {s, pair.first};
+    }
+  }
+
+  std::vector<Match> matches;
+  for (size_t i = 0; i < n; i++) {
+    if (best[i].first >= 0)
+      matches.push_back(
+          {deck.at(best[i].second).id(), deck.at(i).id(), best[i].first});
+  }
+  return matches;
+}
+
+std::vector<NearDuplicates::Signature>
+NearDuplicates::signatures(const Deck &deck, unsigned threads) {
+  std::vector<Signature> sigs(deck.size());
+  parallelFor(deck.size(), threads, [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; i++)
+      sigs[i] = signature(deck.at(i).front(), deck.at(i).back());
+  });
+  return sigs;
+}
+
+void NearDuplicates::parallelFor(
+    size_t count, unsigned threads,
+    const std::function<void(size_t, size_t)> &job) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = (unsigned)std::min<size_t>(threads, count);
+  if (threads <= 1) {
+    job(0, count);
+    return;
+  }
+  std::vector<std::thread> pool;
+  size_t per = (count + threads - 1) / threads;
+  for (size_t first = 0; first < count; first += per)
+    pool.emplace_back(job, first, std::min(count, first + per));
+  for (auto &t : pool)
+    t.join();
+}
@@ -0,0 +1,74 @@
+#ifndef TANKI_NEARDUPLICATES_HPP
+#define TANKI_NEARDUPLICATES_HPP
+
+#include "Deck.hpp"
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Near-duplicate cards: the same fact with different casing,
+ * punctuation or spacing, or with a word or two changed.
+ * - text is normalized (lowercase, punctuation dropped, spaces folded)
+ * - a MinHash signature over character shingles of front + back
+ *   estimates the Jaccard similarity of two cards
+ * - signatures are bucketed by bands (LSH), so only cards sharing a
+ *   band are ever compared
+ */
+class NearDuplicates {
+public:
+  static constexpr int Hashes = 32;
+  static constexpr int Bands = 8; // of Hashes / Bands rows each
+  using Signature = std::array<uint32_t, Hashes>;
+
+  static constexpr double defaultThreshold = 0.75;
+
+  // A card that repeats an earlier one in deck order
+  struct Match {
+    int keep;
+    int duplicate;
+    double similarity;
+  };
+
+  // Incremental index, for checking cards one by one (CSV import)
+  class Index {
+  public:
+    void add(int id, const Signature &sig);
+    // Most similar indexed card at or above `threshold`
+    bool find(const Signature &sig, double threshold, int &id,
+              double &similarity) const;
+
+  private:
+    std::vector<std::pair<int, Signature>> _entries;
+    // band key -> positions in _entries
+    std::unordered_map<uint64_t, std::vector<uint32_t>> _buckets;
+  };
+
+  static std::string normalize(std::string_view text);
+  static Signature signature(std::string_view front, std::string_view back);
+  // Estimated Jaccard similarity of the shingle sets
+  static double similarity(const Signature &a, const Signature &b);
+
+  // Index of every card in a deck (signatures computed in parallel)
+  static Index indexDeck(const Deck &deck, unsigned threads = 0);
+
+  // Every card that nearly repeats an earlier one, in deck order
+  static std::vector<Match> findInDeck(const Deck &deck,
+                                       double threshold = defaultThreshold,
+                                       unsigned threads = 0);
+
+private:
+  static uint64_t bandKey(const Signature &sig, int band);
+  static std::vector<Signature> signatures(const Deck &deck,
+                                           unsigned threads);
+  // Split [0, count) over worker threads
+  static void parallelFor(size_t count, unsigned threads,
+                          const std::function<void(size_t, size_t)> &job);
+};
+
+#endif // TANKI_NEARDUPLICATES_HPP
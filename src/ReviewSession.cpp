@@ -0,0 +1,140 @@
+#include "ReviewSession.hpp"
+#include "FileManager.hpp"
+#include "Metrics.hpp"
+#include <cstdio>
+#include <ctime>
+
+static int dayNumber(time_t t) {
+  std::tm tm = *std::localtime(&t);
+  return (tm.tm_year + 1900) * 1000 + tm.tm_yday;
+}
+
+std::string DailyCounts::fileIn(const std::string &deckDir) {
+  return deckDir + "/.daily-counts";
+}
+
+void DailyCounts::load() {
+  std::string data;
+  int d, n, r;
+  if (!file.empty() && FileManager::readFile(file, data) &&
+      std::sscanf(data.c_str(), "%d|%d|%d", &d, &n, &r) == 3) {
+    day = d;
+    newSeen = n;
+    reviewed = r;
+  }
+}
+
+void DailyCounts::save() const {
+  if (file.empty())
+    return;
+  char line[64];
+  std::snprintf(line, sizeof(line), "%d|%d|%d\n", day, newSeen, reviewed);
+  FileManager::replaceFile(file, line);
+}
+
+void DailyCounts::rollOver(time_t now) {
+  int today = dayNumber(now);
+  if (day != today) {
+    day = today;
+    newSeen = 0;
+    reviewed = 0;
+  }
+}
+
+ReviewSession::ReviewSession(const std::vector<std::shared_ptr<Deck>> &decks,
+                             const SessionLimits &limits, DailyCounts &counts)
+    : _merger(decks, limits.perDeck), _limits(limits), _counts(counts),
+      _seq(0) {
+  // another process may have answered cards since
+  _counts.load();
+  _counts.rollOver(std::time(nullptr));
+}
+
+ReviewSession::~ReviewSession() {}
+
+bool ReviewSession::next(time_t now, Item &out) {
+  while (!_learning.empty() && _learning.top().ready <= now) {
+    out = _learning.top().item;
+    _learning.pop();
+    if (out.deck->findCard(out.cardId))
+      return true;
+  }
+  if (pullDue(now, out))
+    return true;
+
+  // learn ahead a little rather than keep the user waiting, but not so
+  // far that the learning steps lose their point
+  time_t ahead = now + (time_t)_limits.learnAheadMinutes * 60;
+  while (!_learning.empty() && _learning.top().ready <= ahead) {
+    out = _learning.top().item;
+    _learning.pop();
+    if (out.deck->findCard(out.cardId))
+      return true;
+  }
+  return false;
+}
+
+time_t ReviewSession::nextReady() const {
+  return _learning.empty() ? 0 : _learning.top().ready;
+}
+
+bool ReviewSession::pullDue(time_t now, Item &out) {
+  std::shared_ptr<Deck> deck;
+  int cardId;
+  while (_counts.newSeen < _limits.newCards ||
+         _counts.reviewed < _limits.reviews) {
+    if (!_merger.next(now, deck, cardId))
+      return false;
+    bool isNew = deck->findCard(cardId)->interval() == 0;
+    if (isNew ? _counts.newSeen >= _limits.newCards
+              : _counts.reviewed >= _limits.reviews)
+      continue;
+    out.deck = deck;
+    out.cardId = cardId;
+    out.step = -1;
+    out.isNew = isNew;
+    return true;
+  }
+  return false;
+}
+
+void ReviewSession::answer(const Item &item, Card &card, time_t now) {
+  static auto &reviewed =
+      Metrics::counter("tanki_cards_reviewed_total", "Answers recorded");
+  static auto &seconds = Metrics::histogram(
+      "tanki_review_answer_seconds",
+      "Time to schedule an answer and store the card");
+  Metrics::Timer timer(seconds);
+  reviewed.add();
+  int rating = card.lastRating();
+  bool lapse = SM2Scheduler::isLapse(rating);
+
+  if (item.step < 0) {
+    // counted once answered, so a card skipped by quitting is not
+    _counts.rollOver(now);
+    (item.isNew ? _counts.newSeen : _counts.reviewed)++;
+    _counts.save();
+    _sched.updateCard(card, rating, now);
+    if (lapse)
+      requeue(item, 0, now);
+  } else if (lapse) {
+    // failed again while learning: start over
+    requeue(item, 0, now);
+  } else {
+    // passed a step; the card graduates after the last one and keeps
+    // the due date the scheduler gave it when it lapsed
+    requeue(item, item.step + 1, now);
+  }
+  item.deck->updateCard(card);
+}
+
+int ReviewSession::learningCount() const { return (int)_learning.size(); }
+
+void ReviewSession::requeue(const Item &item, int step, time_t now) {
+  if (step >= (int)_limits.learningSteps.size())
+    return;
+  Item again = item;
+  again.step = step;
+  time_t ready = now + _limits.learningSteps[step] * 60;
+  _learning.push({ready, _seq++, again});
+}
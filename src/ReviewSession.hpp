@@ -0,0 +1,101 @@
+#ifndef TANKI_REVIEWSESSION_HPP
+#define TANKI_REVIEWSESSION_HPP
+
+#include "Deck.hpp"
+#include "DueMerger.hpp"
+#include "SM2Scheduler.hpp"
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+struct SessionLimits {
+  int perDeck = 0;   // cards per deck and session, 0 = no limit
+  int newCards = 20; // new cards per day
+  int reviews = 200; // review cards per day
+  // Re-show delays (minutes) for cards failed during the session
+  std::vector<int> learningSteps{1, 10};
+  // When nothing else is due, a failed card may come back this many
+  // minutes before its step is up (learn-ahead)
+  int learnAheadMinutes = 20;
+};
+
+// Cards answered today; reset when the calendar day changes. With a
+// file set, the counts are read when a session starts and written on
+// every answer, so the daily limits hold across restarts.
+struct DailyCounts {
+  int day = -1;
+  int newSeen = 0;
+  int reviewed = 0;
+  std::string file;
+
+  // `.daily-counts` in the deck directory
+  static std::string fileIn(const std::string &deckDir);
+  void load();
+  void save() const;
+  // Start from zero if `now` is on another day than the counts
+  void rollOver(time_t now);
+};
+
+/**
+ * One study session over one or more decks.
+ * - Due cards come from a DueMerger, so cards that fall due mid-session
+ *   are admitted as soon as they are due
+ * - Failed cards go into a timer queue and come back after each
+ *   learning step instead of disappearing until tomorrow
+ * - Daily new/review limits are checked as cards are handed out and
+ *   counted as they are answered
+ * Every next() is a heap pop/peek, i.e. O(log n).
+ */
+class ReviewSession {
+public:
+  struct Item {
+    std::shared_ptr<Deck> deck;
+    int cardId = 0;
+    int step = -1; // learning step, -1 for a regular due card
+    bool isNew = false;
+  };
+
+  ReviewSession(const std::vector<std::shared_ptr<Deck>> &decks,
+                const SessionLimits &limits, DailyCounts &counts);
+  ~ReviewSession();
+
+  // Next card to show. When nothing is due yet, the earliest failed
+  // card is shown ahead of time if it is ready within the learn-ahead
+  // window; otherwise there is no card until nextReady().
+  bool next(time_t now, Item &out);
+  // When the next failed card is ready, 0 if none is waiting
+  time_t nextReady() const;
+
+  // Apply card.lastRating() and write the card back into its deck.
+  void answer(const Item &item, Card &card, time_t now);
+
+  int learningCount() const;
+
+private:
+  struct Pending {
+    time_t ready;
+    unsigned long seq;
+    Item item;
+  };
+
+  struct Later {
+    bool operator()(const Pending &a, const Pending &b) const {
+      if (a.ready != b.ready)
+        return a.ready > b.ready;
+      return a.seq > b.seq;
+    }
+  };
+
+  DueMerger _merger;
+  SessionLimits _limits;
+  DailyCounts &_counts;
+  SM2Scheduler _sched;
+  std::priority_queue<Pending, std::vector<Pending>, Later> _learning;
+  unsigned long _seq;
+
+  bool pullDue(time_t now, Item &out);
+  void requeue(const Item &item, int step, time_t now);
+};
+
+#endif // TANKI_REVIEWSESSION_HPP
@@ -1,5 +1,4 @@
 #include "SM2Scheduler.hpp"
-#include <algorithm>
 #include <ctime>
 
 /** TODO: BETTER DEFAULTS
@@ -23,37 +22,11 @@ SM2Scheduler::SM2Scheduler() {}
 SM2Scheduler::~SM2Scheduler() {}
 
 void SM2Scheduler::updateCard(Card &card, int quality) {
-  quality = std::max(0, std::min(quality, 5));
-
-  double ef = card.easeFactor();
-  int ivl = card.interval();
-
-  if (quality < 3) {
-    // reset
-    ivl = 1;
-  } else {
-    switch (ivl) {
-    case 0:
-      ivl = 1;
-      break;
-    case 1:
-      ivl = 6;
-      break;
-    default:
-      ivl = (int)(ivl * ef + 0.5);
-      break;
-    }
-    ef = ef + (0.1 - (5 - quality) * (0.08 + (5 - quality) * 0.02));
-    if (ef < 1.3)
-      ef = 1.3;
-  }
-
-  card.setInterval(ivl);
-  card.setEaseFactor(ef);
+  updateCard(card, quality, std::time(nullptr));
+}
 
-  time_t now = std::time(nullptr);
-  time_t next = now + (ivl * 24 * 60 * 60);
-  card.setDueDate(next);
+void SM2Scheduler::updateCard(Card &card, int quality, time_t now) {
+  step(card.schedule(), quality, now);
 
   // potential leech detection
   // e.g. if user fails multiple times => card.setSuspended(true);
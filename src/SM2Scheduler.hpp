@@ -2,6 +2,7 @@
 #define TANKI_SM2SCHEDULER_HPP
 
 #include "Card.hpp"
+#include <ctime>
 
 class SM2Scheduler {
 public:
@@ -9,6 +10,29 @@ public:
   ~SM2Scheduler();
 
   void updateCard(Card &card, int quality);
+  void updateCard(Card &card, int quality, time_t now);
+
+  // Ratings below "Good" reset the interval
+  static bool isLapse(int quality) { return quality < 3; }
+
+  // The SM-2 update on the scheduling fields alone. Inline, so batch
+  // rescheduling (BatchScheduler::ApplyRating) compiles it into its loop.
+  static void step(Card::Schedule &s, int quality, time_t now) {
+    quality = quality < 0 ? 0 : quality > 5 ? 5 : quality;
+    double ef = s.ease / 1000.0;
+    int ivl = s.interval;
+    if (isLapse(quality)) {
+      ivl = 1;
+    } else {
+      ivl = ivl == 0 ? 1 : ivl == 1 ? 6 : (int)(ivl * ef + 0.5);
+      ef += 0.1 - (5 - quality) * (0.08 + (5 - quality) * 0.02);
+      ef = ef < 1.3 ? 1.3 : ef > 65.0 ? 65.0 : ef;
+    }
+    s.interval = ivl;
+    s.ease = (uint16_t)(ef * 1000.0 + 0.5);
+    s.due = now + (time_t)ivl * 24 * 60 * 60;
+    s.modified = now;
+  }
 };
 
 #endif // TANKI_SM2SCHEDULER_HPP
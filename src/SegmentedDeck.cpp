@@ -0,0 +1,228 @@
+#include "SegmentedDeck.hpp"
+#include "FileManager.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <set>
+
+static const char MAGIC[] = "TANKI-SEGMENTS 1";
+
+bool SegmentedDeck::isSegmented(const std::string &path) {
+  std::ifstream fin(path);
+  std::string first;
+  return std::getline(fin, first) && first == MAGIC;
+}
+
+std::string SegmentedDeck::segmentDirectory(const std::string &path) {
+  std::filesystem::path p(path);
+  return (p.parent_path() / ("." + p.stem().string() + ".segments"))
+      .string();
+}
+
+std::string SegmentedDeck::segmentFile(const std::string &dir,
+                                       uint32_t file) {
+  return dir + "/" + std::to_string(file) + ".seg";
+}
+
+bool SegmentedDeck::readIndex(const std::string &path, std::string &name,
+                              std::vector<Deck::Segment> &segments,
+                              Deck::Tombstones &tombstones) {
+  std::string index;
+  if (!FileManager::readFile(path, index))
+    return false;
+  std::vector<std::string> lines;
+  size_t start = 0, nl;
+  while ((nl = index.find('\n', start)) != std::string::npos) {
+    lines.push_back(index.substr(start, nl - start));
+    start = nl + 1;
+  }
+  if (lines.size() < 2 || lines[0] != MAGIC)
+    return false;
+  name = lines[1];
+  segments.clear();
+  tombstones.clear();
+  std::string front;
+  time_t when;
+  for (size_t i = 2; i < lines.size(); i++) {
+    if (FileManager::parseTombstone(lines[i], front, when)) {
+      tombstones[front] = when;
+      continue;
+    }
+    // file|count|hash; older indexes stop after count
+    Deck::Segment seg;
+    const char *p = lines[i].c_str();
+    char *end = nullptr;
+    seg.file = (uint32_t)std::strtoul(p, &end, 10);
+    if (end == p || *end != '|')
+      return false;
+    seg.count = (uint32_t)std::strtoul(end + 1, &end, 10);
+    if (*end == '|')
+      seg.hash = std::strtoull(end + 1, nullptr, 16);
+    seg.dirty = false;
+    segments.push_back(seg);
+  }
+  return true;
+}
+
+bool SegmentedDeck::writeIndex(const std::string &path,
+                               const std::string &name,
+                               const std::vector<Deck::Segment> &segments,
+                               const Deck::Tombstones &tombstones) {
+  namespace fs = std::filesystem;
+  std::string index = std::string(MAGIC) + "\n" + name + "\n";
+  char line[64];
+  for (auto &seg : segments) {
+    std::snprintf(line, sizeof(line), "%u|%u|%016llx\n", seg.file, seg.count,
+                  (unsigned long long)seg.hash);
+    index += line;
+  }
+  index += FileManager::formatTombstones(tombstones);
+
+  // readers see either the old index and files or the new ones, and
+  // after a crash the index never names a segment that is not on disk
+  std::string dir = segmentDirectory(path);
+  FileManager::syncDirectory(dir);
+  if (!FileManager::replaceFile(path, index))
+    return false;
+
+  std::set<std::string> live;
+  for (auto &seg : segments)
+    live.insert(segmentFile(dir, seg.file));
+  std::error_code ec;
+  for (auto &e : fs::directory_iterator(dir, ec)) {
+    if (!live.count(e.path().string()))
+      fs::remove(e.path(), ec);
+  }
+  return true;
+}
+
+uint32_t SegmentedDeck::nextFile(const std::string &dir) {
+  uint32_t next = 1;
+  std::error_code ec;
+  for (auto &e : std::filesystem::directory_iterator(dir, ec)) {
+    unsigned long n = std::strtoul(e.path().stem().c_str(), nullptr, 10);
+    if (n >= next)
+      next = (uint32_t)n + 1;
+  }
+  return next;
+}
+
+uint64_t SegmentedDeck::hash(const std::string &data) {
+  // FNV-1a
+  uint64_t h = 14695981039346656037ull;
+  for (unsigned char c : data) {
+    h ^= c;
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+std::shared_ptr<Deck> SegmentedDeck::read(const std::string &path) {
+  std::string name;
+  std::vector<Deck::Segment> index;
+  Deck::Tombstones tombstones;
+  if (!readIndex(path, name, index, tombstones))
+    return nullptr;
+
+  auto deck = std::make_shared<Deck>(name);
+  deck->setFormat(Deck::Segmented);
+  std::string dir = segmentDirectory(path);
+  std::vector<Deck::Segment> segments;
+  std::string data, line;
+  std::vector<Card> cards;
+  for (Deck::Segment seg : index) {
+    if (!FileManager::readFile(segmentFile(dir, seg.file), data))
+      return nullptr;
+
+    // cards are appended in file order, so positions follow the index
+    seg.count = 0;
+    for (size_t pos = 0; pos < data.size();) {
+      size_t end = data.find('\n', pos);
+      if (end == std::string::npos)
+        end = data.size();
+      line.assign(data, pos, end - pos);
+      pos = end + 1;
+      Card c;
+      if (!FileManager::parseCardLine(line, c))
+        continue;
+      seg.count++;
+      cards.push_back(std::move(c));
+    }
+    if (seg.count > 0)
+      segments.push_back(seg);
+  }
+  deck->addCards(std::move(cards));
+  deck->setTombstones(std::move(tombstones));
+  deck->segments() = segments;
+  return deck;
+}
+
+bool SegmentedDeck::write(Deck &deck, const std::string &path) {
+  std::string dir = segmentDirectory(path);
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+
+  std::vector<Deck::Segment> segments = deck.segments();
+  size_t total = 0;
+  for (auto &seg : segments)
+    total += seg.count;
+  if (segments.empty() || total != deck.size() || needsCompaction(segments))
+    segments = layout(deck);
+
+  // new files never overwrite ones the current index names
+  uint32_t next = nextFile(dir);
+  std::vector<Deck::Segment> written;
+  size_t first = 0;
+  for (auto seg : segments) {
+    size_t end = first + seg.count;
+    if (seg.count == 0)
+      continue;
+    if (seg.dirty || seg.file == 0) {
+      std::string data;
+      for (size_t i = first; i < end; i++) {
+        data += FileManager::formatCardLine(deck.at(i));
+        data += '\n';
+      }
+      seg.file = next++;
+      seg.hash = hash(data);
+      seg.dirty = false;
+      if (!FileManager::writeFile(segmentFile(dir, seg.file), data, true))
+        return false;
+    }
+    written.push_back(seg);
+    first = end;
+  }
+
+  if (!writeIndex(path, deck.name(), written, deck.tombstones()))
+    return false;
+  deck.segments() = written;
+  return true;
+}
+
+void SegmentedDeck::removeSegments(const std::string &path) {
+  std::error_code ec;
+  std::filesystem::remove_all(segmentDirectory(path), ec);
+}
+
+bool SegmentedDeck::needsCompaction(
+    const std::vector<Deck::Segment> &segments) {
+  size_t cards = 0;
+  for (auto &seg : segments)
+    cards += seg.count;
+  return segments.size() > 1 &&
+         cards * 2 < segments.size() * Deck::Segment::Capacity;
+}
+
+std::vector<Deck::Segment> SegmentedDeck::layout(const Deck &deck) {
+  // split the deck as it is ordered, a Capacity of cards at a time
+  std::vector<Deck::Segment> segments;
+  for (size_t i = 0; i < deck.size(); i += Deck::Segment::Capacity) {
+    Deck::Segment seg;
+    seg.count = (uint32_t)std::min<size_t>(deck.size() - i,
+                                           Deck::Segment::Capacity);
+    segments.push_back(seg);
+  }
+  return segments;
+}
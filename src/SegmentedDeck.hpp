@@ -0,0 +1,60 @@
+#ifndef TANKI_SEGMENTEDDECK_HPP
+#define TANKI_SEGMENTEDDECK_HPP
+
+#include "Deck.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Segmented deck storage for large decks.
+ *
+ * The .deck file is a small index:
+ *   "TANKI-SEGMENTS 1"
+ *   name
+ *   file|cards|hash      one line per segment, in deck order
+ *   front|deleted|stamp| one line per tombstone (Deck::Tombstones)
+ * and the cards live in .<name>.segments/<file>.seg next to it, each a
+ * run of plain-format card lines. Saving rewrites only the segments
+ * whose cards changed (Deck::Segment::dirty) into new files, then
+ * replaces the index and removes the files it no longer names. The hash
+ * (of the file's bytes, in hex) lets DeckSync tell equal segments apart
+ * without reading them; older indexes lack it.
+ */
+class SegmentedDeck {
+public:
+  // Plain decks with more cards than this are saved segmented
+  static constexpr size_t threshold = 4 * Deck::Segment::Capacity;
+
+  static bool isSegmented(const std::string &path);
+  static std::string segmentDirectory(const std::string &path);
+
+  static std::shared_ptr<Deck> read(const std::string &path);
+  // Updates the deck's segment table on success
+  static bool write(Deck &deck, const std::string &path);
+
+  // Remove the segment directory of a deck that is no longer segmented
+  static void removeSegments(const std::string &path);
+
+  // The index alone: deck name, segments (file, count, hash) and
+  // tombstones
+  static bool readIndex(const std::string &path, std::string &name,
+                        std::vector<Deck::Segment> &segments,
+                        Deck::Tombstones &tombstones);
+  // Replace the index, then remove segment files it does not name.
+  // Segment files must already be written with fsync.
+  static bool writeIndex(const std::string &path, const std::string &name,
+                         const std::vector<Deck::Segment> &segments,
+                         const Deck::Tombstones &tombstones);
+  static std::string segmentFile(const std::string &dir, uint32_t file);
+  // A number above every segment file in dir
+  static uint32_t nextFile(const std::string &dir);
+  static uint64_t hash(const std::string &data);
+
+private:
+  // Lay the deck out afresh when segments are mostly empty
+  static bool needsCompaction(const std::vector<Deck::Segment> &segments);
+  static std::vector<Deck::Segment> layout(const Deck &deck);
+};
+
+#endif // TANKI_SEGMENTEDDECK_HPP
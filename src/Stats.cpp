@@ -1,5 +1,6 @@
 #include "Stats.hpp"
 #include <ctime>
+#include <iomanip>
 #include <sstream>
 
 std::string Stats::generateStats(std::shared_ptr<Deck> deck) {
@@ -63,3 +64,37 @@ std::string Stats::generateScheduleInfo(std::shared_ptr<Deck> deck) {
   }
   return oss.str();
 }
+
+static std::string formatBytes(size_t bytes) {
+  std::ostringstream oss;
+  if (bytes < 1024)
+    oss << bytes << " B";
+  else if (bytes < 1024 * 1024)
+    oss << std::fixed << std::setprecision(1) << bytes / 1024.0 << " KiB";
+  else
+    oss << std::fixed << std::setprecision(1) << bytes / (1024.0 * 1024.0)
+        << " MiB";
+  return oss.str();
+}
+
+std::string Stats::generateMemoryReport(std::shared_ptr<Deck> deck) {
+  if (!deck)
+    return "No deck.";
+  auto m = deck->memoryUsage();
+
+  std::ostringstream oss;
+  oss << "Memory (" << deck->name() << ", " << m.cards << " cards):\n";
+  oss << "Text: " << formatBytes(m.text) << "\n";
+  oss << "Tags: " << formatBytes(m.tags) << "\n";
+  oss << "Scheduling: " << formatBytes(m.scheduling) << "\n";
+  oss << "Indexes: " << formatBytes(m.indexes) << "\n";
+  oss << "Total: " << formatBytes(m.total());
+  if (m.text > 0) {
+    oss << " (" << std::fixed << std::setprecision(2)
+        << (double)m.total() / m.text << "x text)";
+  }
+  oss << "\n";
+  oss << "Shared tag table: " << Card::tagTableSize() << " tags, "
+      << formatBytes(Card::tagTableBytes()) << "\n";
+  return oss.str();
+}
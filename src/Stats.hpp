@@ -9,6 +9,8 @@ class Stats {
 public:
   static std::string generateStats(std::shared_ptr<Deck> deck);
   static std::string generateScheduleInfo(std::shared_ptr<Deck> deck);
+  // Bytes held by the loaded deck, split by what they are used for
+  static std::string generateMemoryReport(std::shared_ptr<Deck> deck);
 
 private:
   // helper(s)
@@ -0,0 +1,200 @@
+#include "StudyClient.hpp"
+#include "StudyServer.hpp"
+#include "UI.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <ctime>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+StudyClient::StudyClient() : _fd(-1) {}
+
+StudyClient::~StudyClient() {
+  if (_fd >= 0)
+    close(_fd);
+}
+
+bool StudyClient::connect(const std::string &socketPath) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (socketPath.size() >= sizeof(addr.sun_path))
+    return false;
+  std::strcpy(addr.sun_path, socketPath.c_str());
+
+  _fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (_fd < 0)
+    return false;
+  if (::connect(_fd, (sockaddr *)&addr, sizeof(addr)) < 0) {
+    close(_fd);
+    _fd = -1;
+    return false;
+  }
+  return true;
+}
+
+bool StudyClient::request(const std::vector<std::string> &fields,
+                          std::vector<std::vector<std::string>> &lines,
+                          std::string &error) {
+  lines.clear();
+  std::string msg = StudyServer::encode(fields);
+  for (size_t sent = 0; sent < msg.size();) {
+    ssize_t len = send(_fd, msg.data() + sent, msg.size() - sent,
+                       MSG_NOSIGNAL);
+    if (len <= 0) {
+      error = "lost connection to the server";
+      return false;
+    }
+    sent += len;
+  }
+
+  std::string line;
+  while (readLine(line)) {
+    auto reply = StudyServer::decode(line);
+    if (reply[0] == "OK")
+      return true;
+    if (reply[0] == "ERR") {
+      error = reply.size() > 1 ? reply[1] : "error";
+      return false;
+    }
+    lines.push_back(reply);
+  }
+  error = "lost connection to the server";
+  return false;
+}
+
+bool StudyClient::decks(std::vector<DeckSummary> &out) {
+  std::vector<std::vector<std::string>> lines;
+  std::string error;
+  if (!request({"DECKS"}, lines, error))
+    return false;
+  out.clear();
+  for (auto &l : lines) {
+    if (l.size() < 6 || l[0] != "DECK")
+      continue;
+    DeckSummary s;
+    s.name = l[1];
+    s.cardCount = std::stoi(l[2]);
+    s.dueCount = std::stoi(l[3]);
+    s.nextDue = (time_t)std::stoll(l[4]);
+    s.stamped = (time_t)std::stoll(l[5]);
+    if (l.size() > 6)
+      s.newCount = std::stoi(l[6]);
+    out.push_back(s);
+  }
+  return true;
+}
+
+bool StudyClient::stats(const std::string &deck, std::string &out) {
+  std::vector<std::vector<std::string>> lines;
+  std::string error;
+  if (!request({"STATS", deck}, lines, error) || lines.empty() ||
+      lines[0].size() < 2)
+    return false;
+  out = lines[0][1];
+  return true;
+}
+
+bool StudyClient::startReview(const std::string &deck) {
+  std::vector<std::vector<std::string>> lines;
+  std::string error;
+  return request({"REVIEW", deck}, lines, error);
+}
+
+bool StudyClient::nextCard(Card &out, int &wait, int &waiting) {
+  std::vector<std::vector<std::string>> lines;
+  std::string error;
+  wait = waiting = 0;
+  if (!request({"NEXT"}, lines, error) || lines.empty())
+    return false;
+  if (lines[0].size() == 3 && lines[0][0] == "WAIT") {
+    wait = std::atoi(lines[0][1].c_str());
+    waiting = std::atoi(lines[0][2].c_str());
+    return false;
+  }
+  if (lines[0].size() < 5)
+    return false;
+  out = Card(lines[0][2], lines[0][3]);
+  out.setTags(lines[0][4]);
+  return true;
+}
+
+bool StudyClient::answer(int rating, double flipSeconds) {
+  std::vector<std::vector<std::string>> lines;
+  std::string error;
+  char secs[32];
+  std::snprintf(secs, sizeof(secs), "%.1f", flipSeconds);
+  return request({"ANSWER", std::to_string(rating), secs}, lines, error);
+}
+
+int StudyClient::runTerminal() {
+  UI ui;
+  ui.init();
+  DeckTree tree;
+  int status = 0;
+  while (true) {
+    std::vector<DeckSummary> list;
+    if (!decks(list)) {
+      status = 1;
+      break;
+    }
+    if (list.empty()) {
+      ui.showMessage("The server has no decks. Run Tanki --local to "
+                     "create one.");
+      break;
+    }
+    tree.build(list, std::time(nullptr));
+    int idx = ui.startScreenWithDecks(tree);
+    if (idx == -1)
+      break;
+    if (idx == -2) {
+      ui.showMessage("Decks are created in the full UI (Tanki --local).");
+      continue;
+    }
+    if (idx < 0 || idx >= (int)list.size())
+      continue;
+
+    const std::string &name = list[idx].name;
+    if (!startReview(name)) {
+      ui.showMessage("Could not start a review of " + name + ".");
+      continue;
+    }
+    Card card("", "");
+    UI::Timing timing;
+    int wait, waiting;
+    while (true) {
+      if (!nextCard(card, wait, waiting)) {
+        if (wait > 0 && ui.waitForCard(std::time(nullptr) + wait, waiting))
+          continue;
+        break;
+      }
+      if (!ui.reviewCard(card, false, &timing) ||
+          !answer(card.lastRating(), timing.flip))
+        break;
+    }
+    ui.showMessage("Review session complete.");
+    std::string text;
+    if (stats(name, text))
+      ui.showLongText("Stats", text);
+  }
+  ui.shutdown();
+  if (status != 0)
+    std::cerr << "Lost connection to the Tanki server.\n";
+  return status;
+}
+
+bool StudyClient::readLine(std::string &line) {
+  size_t nl;
+  while ((nl = _buffer.find('\n')) == std::string::npos) {
+    char buf[4096];
+    ssize_t len = recv(_fd, buf, sizeof(buf), 0);
+    if (len <= 0)
+      return false;
+    _buffer.append(buf, len);
+  }
+  line = _buffer.substr(0, nl);
+  _buffer.erase(0, nl + 1);
+  return true;
+}
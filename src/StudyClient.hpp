@@ -0,0 +1,48 @@
+#ifndef TANKI_STUDYCLIENT_HPP
+#define TANKI_STUDYCLIENT_HPP
+
+#include "Card.hpp"
+#include "DeckManifest.hpp"
+#include <string>
+#include <vector>
+
+/**
+ * Client side of StudyServer. When a server is running, plain `Tanki`
+ * starts this thin UI instead of loading the decks itself: deck lists,
+ * reviews and stats all come from the server's resident copies.
+ */
+class StudyClient {
+public:
+  StudyClient();
+  ~StudyClient();
+
+  // False when no server is listening on the socket
+  bool connect(const std::string &socketPath);
+
+  // Send one request; data lines of the reply go to `lines`.
+  // False on an ERR reply (message in `error`) or a lost connection.
+  bool request(const std::vector<std::string> &fields,
+               std::vector<std::vector<std::string>> &lines,
+               std::string &error);
+
+  bool decks(std::vector<DeckSummary> &out);
+  bool stats(const std::string &deck, std::string &out);
+
+  // Review session over one deck ("*" for all of them)
+  bool startReview(const std::string &deck);
+  // False when the session has no more cards, or none yet: then `wait`
+  // is the seconds until one of `waiting` failed cards is ready
+  bool nextCard(Card &out, int &wait, int &waiting);
+  bool answer(int rating, double flipSeconds);
+
+  // Thin terminal UI; returns a process exit code
+  int runTerminal();
+
+private:
+  int _fd;
+  std::string _buffer;
+
+  bool readLine(std::string &line);
+};
+
+#endif // TANKI_STUDYCLIENT_HPP
@@ -0,0 +1,439 @@
+#include "StudyServer.hpp"
+#include "DeckIO.hpp"
+#include "DeckManifest.hpp"
+#include "FileManager.hpp"
+#include "Metrics.hpp"
+#include "Stats.hpp"
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+StudyServer::StudyServer(const std::string &deckDir)
+    : _dir(deckDir), _socketPath(socketPath(deckDir)), _epoll(-1),
+      _listen(-1), _signals(-1) {
+  _counts.file = DailyCounts::fileIn(deckDir);
+}
+
+StudyServer::~StudyServer() {
+  for (auto &kv : _clients)
+    ::close(kv.first);
+  if (_listen >= 0) {
+    ::close(_listen);
+    ::unlink(_socketPath.c_str());
+  }
+  if (_signals >= 0)
+    ::close(_signals);
+  if (_epoll >= 0)
+    ::close(_epoll);
+}
+
+std::string StudyServer::socketPath(const std::string &deckDir) {
+  return deckDir + "/.tanki.sock";
+}
+
+std::string StudyServer::encode(const std::vector<std::string> &fields) {
+  std::string line;
+  for (size_t i = 0; i < fields.size(); i++) {
+    if (i)
+      line += '\t';
+    for (char ch : fields[i]) {
+      if (ch == '\\')
+        line += "\\\\";
+      else if (ch == '\t')
+        line += "\\t";
+      else if (ch == '\n')
+        line += "\\n";
+      else
+        line += ch;
+    }
+  }
+  return line + "\n";
+}
+
+std::vector<std::string> StudyServer::decode(const std::string &line) {
+  std::vector<std::string> fields(1);
+  for (size_t i = 0; i < line.size(); i++) {
+    char ch = line[i];
+    if (ch == '\t') {
+      fields.emplace_back();
+    } else if (ch == '\\' && i + 1 < line.size()) {
+      char e = line[++i];
+      fields.back() += e == 't' ? '\t' : e == 'n' ? '\n' : e;
+    } else if (ch != '\r') {
+      fields.back() += ch;
+    }
+  }
+  return fields;
+}
+
+#ifdef __linux__
+
+int StudyServer::run() {
+  if (!openSocket())
+    return 1;
+  loadDecks();
+  _watcher.start(_dir);
+  Metrics::startExport(_dir, "server");
+  std::cout << "Serving " << _decks.size() << " decks on " << _socketPath
+            << std::endl;
+
+  epoll_event events[64];
+  bool running = true;
+  while (running) {
+    int n = epoll_wait(_epoll, events, 64, 1000);
+    if (n < 0 && errno != EINTR)
+      break;
+    for (int i = 0; i < n; i++) {
+      int fd = events[i].data.fd;
+      if (fd == _signals) {
+        running = false;
+      } else if (fd == _listen) {
+        acceptClient();
+      } else {
+        auto it = _clients.find(fd);
+        if (it == _clients.end())
+          continue;
+        // a hang-up still comes with EPOLLIN while requests are unread
+        if ((events[i].events & EPOLLERR) ||
+            (events[i].events & (EPOLLHUP | EPOLLIN)) == EPOLLHUP) {
+          dropClient(fd);
+          continue;
+        }
+        if (events[i].events & EPOLLIN)
+          readFrom(it->second);
+        it = _clients.find(fd);
+        if (it != _clients.end() && (events[i].events & EPOLLOUT))
+          writeTo(it->second);
+      }
+    }
+    applyDeckChanges();
+    saveDirty();
+  }
+
+  _watcher.stop();
+  saveDirty();
+  Metrics::stopExport();
+  std::cout << "Stopped." << std::endl;
+  return 0;
+}
+
+bool StudyServer::openSocket() {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (_socketPath.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "Socket path too long: " << _socketPath << "\n";
+    return false;
+  }
+  std::strcpy(addr.sun_path, _socketPath.c_str());
+
+  // refuse to start twice; a socket nobody answers on is stale
+  int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (probe >= 0 && connect(probe, (sockaddr *)&addr, sizeof(addr)) == 0) {
+    ::close(probe);
+    std::cerr << "A Tanki server is already running on " << _socketPath
+              << "\n";
+    return false;
+  }
+  if (probe >= 0)
+    ::close(probe);
+  ::unlink(_socketPath.c_str());
+
+  _listen = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (_listen < 0 || bind(_listen, (sockaddr *)&addr, sizeof(addr)) < 0 ||
+      ::listen(_listen, 16) < 0) {
+    std::cerr << "Cannot listen on " << _socketPath << ": "
+              << std::strerror(errno) << "\n";
+    return false;
+  }
+
+  // SIGINT/SIGTERM arrive as events so decks are saved before exiting
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  sigprocmask(SIG_BLOCK, &mask, nullptr);
+  signal(SIGPIPE, SIG_IGN);
+  _signals = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+  _epoll = epoll_create1(EPOLL_CLOEXEC);
+  if (_epoll < 0 || _signals < 0)
+    return false;
+  for (int fd : {_listen, _signals}) {
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &ev);
+  }
+  return true;
+}
+
+void StudyServer::acceptClient() {
+  int fd;
+  while ((fd = accept4(_listen, nullptr, nullptr,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &ev) < 0) {
+      ::close(fd);
+      continue;
+    }
+    _clients[fd].fd = fd;
+  }
+}
+
+void StudyServer::readFrom(Client &c) {
+  char buf[4096];
+  while (c.in.size() <= MAX_LINE) {
+    ssize_t len = read(c.fd, buf, sizeof(buf));
+    if (len > 0) {
+      c.in.append(buf, len);
+      continue;
+    }
+    if (len == 0) {
+      // the client is done sending; answer what it sent, then drop it
+      c.finished = true;
+      break;
+    }
+    if (errno == EINTR)
+      continue;
+    if (errno != EAGAIN) {
+      dropClient(c.fd);
+      return;
+    }
+    break;
+  }
+
+  size_t start = 0, nl;
+  while ((nl = c.in.find('\n', start)) != std::string::npos) {
+    handle(c, decode(c.in.substr(start, nl - start)));
+    start = nl + 1;
+  }
+  c.in.erase(0, start);
+  if (c.in.size() > MAX_LINE) {
+    dropClient(c.fd);
+    return;
+  }
+  writeTo(c);
+}
+
+void StudyServer::writeTo(Client &c) {
+  while (!c.out.empty()) {
+    ssize_t len = write(c.fd, c.out.data(), c.out.size());
+    if (len < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN) {
+        dropClient(c.fd);
+        return;
+      }
+      break;
+    }
+    c.out.erase(0, len);
+  }
+  if (c.finished && c.out.empty()) {
+    dropClient(c.fd);
+    return;
+  }
+  // only ask for EPOLLOUT while there is something left to send, and
+  // for EPOLLIN while the client may still send
+  epoll_event ev{};
+  ev.events = 0;
+  if (!c.finished)
+    ev.events |= EPOLLIN;
+  if (!c.out.empty())
+    ev.events |= EPOLLOUT;
+  ev.data.fd = c.fd;
+  epoll_ctl(_epoll, EPOLL_CTL_MOD, c.fd, &ev);
+}
+
+void StudyServer::dropClient(int fd) {
+  epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+  ::close(fd);
+  _clients.erase(fd);
+}
+
+#else
+
+int StudyServer::run() {
+  std::cerr << "The Tanki server needs Linux (epoll).\n";
+  return 1;
+}
+
+bool StudyServer::openSocket() { return false; }
+void StudyServer::acceptClient() {}
+void StudyServer::readFrom(Client &) {}
+void StudyServer::writeTo(Client &) {}
+void StudyServer::dropClient(int) {}
+
+#endif
+
+void StudyServer::handle(Client &c, const std::vector<std::string> &req) {
+  static auto &requests =
+      Metrics::counter("tanki_server_requests_total", "Requests handled");
+  requests.add();
+  const std::string &cmd = req[0];
+  auto reply = [&](const std::vector<std::string> &fields) {
+    c.out += encode(fields);
+  };
+  auto fail = [&](const std::string &msg) { reply({"ERR", msg}); };
+
+  if (cmd == "DECKS") {
+    time_t now = std::time(nullptr);
+    for (auto &e : _decks) {
+      auto s = DeckManifest::summarize(*e.deck, e.path);
+      reply({"DECK", s.name, std::to_string(s.cardCount),
+             std::to_string(s.dueCount), std::to_string(s.nextDue),
+             std::to_string(now), std::to_string(s.newCount)});
+    }
+  } else if (cmd == "STATS" && req.size() == 2) {
+    Entry *e = find(req[1]);
+    if (!e)
+      return fail("no such deck");
+    reply({"TEXT", Stats::generateStats(e->deck)});
+  } else if (cmd == "REVIEW" && req.size() == 2) {
+    // a deck brings its subdecks (`Name::Sub`) along
+    std::vector<std::shared_ptr<Deck>> decks;
+    std::string sub = req[1] + "::";
+    for (auto &e : _decks) {
+      std::string name = e.deck->name();
+      if (req[1] == "*" || name == req[1] || name.rfind(sub, 0) == 0)
+        decks.push_back(e.deck);
+    }
+    if (decks.empty())
+      return fail("no such deck");
+    c.session.reset(new ReviewSession(decks, _limits, _counts));
+    c.hasItem = false;
+  } else if (cmd == "NEXT") {
+    if (!c.session)
+      return fail("no review session");
+    c.hasItem = false;
+    while (c.session->next(std::time(nullptr), c.item)) {
+      // the card may have been deleted by a reload since it was queued
+      const Card *card = c.item.deck->findCard(c.item.cardId);
+      if (!card)
+        continue;
+      c.hasItem = true;
+      reply({"CARD", std::to_string(card->id()), std::string(card->front()),
+             std::string(card->back()), card->tagsString()});
+      break;
+    }
+    if (!c.hasItem && c.session->nextReady()) {
+      time_t wait = c.session->nextReady() - std::time(nullptr);
+      reply({"WAIT", std::to_string(std::max<time_t>(wait, 1)),
+             std::to_string(c.session->learningCount())});
+    }
+  } else if (cmd == "ANSWER" && (req.size() == 2 || req.size() == 3)) {
+    const Card *found =
+        c.hasItem ? c.item.deck->findCard(c.item.cardId) : nullptr;
+    if (!found)
+      return fail("no card to answer");
+    int rating = std::atoi(req[1].c_str());
+    if (rating < 0 || rating > 5)
+      return fail("rating must be 0-5");
+    Card card = *found;
+    card.setLastRating(rating);
+    if (req.size() == 3)
+      card.addRecallTime(std::atof(req[2].c_str()));
+    c.session->answer(c.item, card, std::time(nullptr));
+    c.hasItem = false;
+    for (auto &e : _decks) {
+      if (e.deck == c.item.deck)
+        e.dirty = true;
+    }
+  } else if (cmd == "SAVE") {
+    saveDirty();
+  } else {
+    return fail("unknown request: " + cmd);
+  }
+  reply({"OK"});
+}
+
+void StudyServer::loadDecks() {
+  auto paths = FileManager::listDeckFiles(_dir);
+  auto decks = DeckIO::loadAll(paths);
+  for (size_t i = 0; i < paths.size(); i++) {
+    if (decks[i])
+      _decks.push_back({paths[i], decks[i], false});
+  }
+  countDecks();
+}
+
+void StudyServer::saveDirty() {
+  bool any = false;
+  for (auto &e : _decks) {
+    if (!e.dirty)
+      continue;
+    if (FileManager::saveDeck(e.deck, _dir)) {
+      e.dirty = false;
+      any = true;
+    }
+  }
+  if (!any)
+    return;
+  // keep the manifest current so a local UI still starts quickly
+  std::vector<DeckSummary> summaries;
+  for (auto &e : _decks)
+    summaries.push_back(DeckManifest::summarize(*e.deck, e.path));
+  DeckManifest::save(_dir, summaries);
+}
+
+/**
+ * Pick up deck files written by someone else (a local UI, a CLI merge).
+ * Our own saves still match the deck's file stamp and are skipped.
+ */
+void StudyServer::applyDeckChanges() {
+  for (auto &path : _watcher.takeChanges()) {
+    auto it = std::find_if(_decks.begin(), _decks.end(),
+                           [&](const Entry &e) { return e.path == path; });
+    if (!std::filesystem::exists(path)) {
+      if (it != _decks.end())
+        _decks.erase(it);
+      continue;
+    }
+    int64_t mtime;
+    uintmax_t size;
+    if (it != _decks.end() && FileManager::fileIdentity(path, mtime, size) &&
+        it->deck->matchesFileStamp(mtime, size))
+      continue;
+    auto disk = FileManager::loadDeck(path);
+    if (!disk)
+      continue;
+    if (it == _decks.end())
+      _decks.push_back({path, disk, false});
+    else
+      it->deck->reloadFrom(*disk);
+  }
+  countDecks();
+}
+
+void StudyServer::countDecks() {
+  static auto &decks =
+      Metrics::gauge("tanki_decks_loaded", "Decks held in memory");
+  static auto &cards =
+      Metrics::gauge("tanki_cards_loaded", "Cards in the loaded decks");
+  size_t total = 0;
+  for (auto &e : _decks)
+    total += e.deck->size();
+  decks.set((double)_decks.size());
+  cards.set((double)total);
+}
+
+StudyServer::Entry *StudyServer::find(const std::string &name) {
+  for (auto &e : _decks) {
+    if (e.deck->name() == name)
+      return &e;
+  }
+  return nullptr;
+}
@@ -0,0 +1,93 @@
+#ifndef TANKI_STUDYSERVER_HPP
+#define TANKI_STUDYSERVER_HPP
+
+#include "Deck.hpp"
+#include "DeckWatcher.hpp"
+#include "ReviewSession.hpp"
+#include <ctime>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Optional daemon (`Tanki serve`) that keeps every deck loaded and
+ * serves deck lists, stats and review sessions to local clients over a
+ * Unix domain socket in the deck directory. Linux only (epoll).
+ *
+ * Protocol: one request per line, fields separated by tabs (see
+ * encode/decode). A reply is zero or more data lines followed by a line
+ * that is either "OK" or "ERR<tab>message".
+ *   DECKS                 DECK name cards due nextDue now new, per deck
+ *   STATS name            TEXT stats
+ *   REVIEW name|*         start a review session for this connection
+ *                         (a deck includes its name::subdecks)
+ *   NEXT                  CARD id front back tags; WAIT secs count
+ *                         when failed cards are left but not ready yet;
+ *                         no line when done
+ *   ANSWER rating [secs]  rate the card last returned by NEXT, with the
+ *                         seconds taken to flip it if timed
+ *   SAVE                  write changed decks now
+ * Changed decks are saved through FileManager within a second.
+ */
+class StudyServer {
+public:
+  explicit StudyServer(const std::string &deckDir);
+  ~StudyServer();
+
+  // Serve until SIGINT/SIGTERM; returns a process exit code
+  int run();
+
+  static std::string socketPath(const std::string &deckDir);
+
+  // One protocol line from fields, escaping \, tab and newline
+  static std::string encode(const std::vector<std::string> &fields);
+  static std::vector<std::string> decode(const std::string &line);
+
+private:
+  // Longest request line accepted; a client sending more is dropped
+  static const size_t MAX_LINE = 1 << 20;
+
+  struct Entry {
+    std::string path;
+    std::shared_ptr<Deck> deck;
+    bool dirty = false;
+  };
+
+  struct Client {
+    int fd = -1;
+    std::string in;
+    std::string out;
+    bool finished = false; // sent EOF; dropped once `out` is sent
+    std::unique_ptr<ReviewSession> session;
+    ReviewSession::Item item;
+    bool hasItem = false;
+  };
+
+  std::string _dir;
+  std::string _socketPath;
+  int _epoll;
+  int _listen;
+  int _signals;
+  std::vector<Entry> _decks;
+  std::map<int, Client> _clients;
+  DeckWatcher _watcher;
+  SessionLimits _limits;
+  DailyCounts _counts;
+
+  bool openSocket();
+  void loadDecks();
+  void saveDirty();
+  void applyDeckChanges();
+  // Update the deck and card gauges
+  void countDecks();
+  Entry *find(const std::string &name);
+
+  void acceptClient();
+  void readFrom(Client &c);
+  void writeTo(Client &c);
+  void dropClient(int fd);
+  void handle(Client &c, const std::vector<std::string> &req);
+};
+
+#endif // TANKI_STUDYSERVER_HPP
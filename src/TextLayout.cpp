@@ -0,0 +1,142 @@
+#include "TextLayout.hpp"
+#include "Utf8.hpp"
+#include <functional>
+
+std::vector<LayoutLine> TextLayout::wrap(std::string_view text, int width) {
+  std::vector<LayoutLine> out;
+  if (width < 1)
+    width = 1;
+  const bool ascii = Utf8::isAscii(text);
+
+  size_t pos = 0;
+  while (pos <= text.size()) {
+    size_t nl = text.find('\n', pos);
+    size_t end = nl == std::string_view::npos ? text.size() : nl;
+    std::string_view para = text.substr(0, end);
+    if (pos == end)
+      out.push_back({(uint32_t)pos, 0});
+    if (ascii)
+      wrapAscii(para, pos, width, out);
+    else
+      wrapUtf8(para, pos, width, out);
+
+    if (nl == std::string_view::npos)
+      break;
+    pos = nl + 1;
+  }
+  return out;
+}
+
+// one column per byte
+void TextLayout::wrapAscii(std::string_view text, size_t start, int width,
+                           std::vector<LayoutLine> &out) {
+  const size_t w = width;
+  const size_t end = text.size();
+  size_t lineStart = start;
+  while (lineStart < end) {
+    if (end - lineStart <= w) {
+      out.push_back({(uint32_t)lineStart, (uint32_t)(end - lineStart)});
+      break;
+    }
+    // last space that still fits, or a hard split
+    size_t cut = text.rfind(' ', lineStart + w);
+    if (cut == std::string_view::npos || cut <= lineStart)
+      cut = lineStart + w;
+    out.push_back({(uint32_t)lineStart, (uint32_t)(cut - lineStart)});
+    lineStart = cut;
+    while (lineStart < end && text[lineStart] == ' ')
+      lineStart++;
+  }
+}
+
+// by display columns; may break at a space or next to a wide (CJK)
+// character, never inside a cluster
+void TextLayout::wrapUtf8(std::string_view text, size_t start, int width,
+                          std::vector<LayoutLine> &out) {
+  const size_t end = text.size();
+  size_t lineStart = start;
+  while (lineStart < end) {
+    int cols = 0;
+    size_t i = lineStart;
+    size_t breakAt = 0; // last break opportunity so far
+    bool prevWide = false;
+    while (i < end) {
+      int w;
+      size_t next = Utf8::nextCluster(text, i, w);
+      if (i > lineStart && (w == 2 || prevWide || text[i] == ' '))
+        breakAt = i;
+      if (cols + w > width)
+        break;
+      cols += w;
+      prevWide = w == 2;
+      i = next;
+    }
+    if (i >= end) {
+      out.push_back({(uint32_t)lineStart, (uint32_t)(end - lineStart)});
+      break;
+    }
+    size_t cut = breakAt > lineStart ? breakAt : i;
+    if (cut == lineStart) // a single cluster wider than the line
+      cut = Utf8::nextCluster(text, i, cols);
+    size_t last = cut;
+    while (last > lineStart && text[last - 1] == ' ')
+      last--;
+    out.push_back({(uint32_t)lineStart, (uint32_t)(last - lineStart)});
+    lineStart = cut;
+    while (lineStart < end && text[lineStart] == ' ')
+      lineStart++;
+  }
+}
+
+const std::vector<LayoutLine> &LayoutCache::lines(int cardId, int side,
+                                                  std::string_view text,
+                                                  int width) {
+  Entry &e = _entries[key(cardId, side, width)];
+  if (e.lines.empty() || !e.source.matches(text))
+    e.lines = TextLayout::wrap(text, width);
+  return e.lines;
+}
+
+const std::string &LayoutCache::preview(int cardId, int side,
+                                        std::string_view text, int width) {
+  Preview &p = _previews[key(cardId, side, width)];
+  if (!p.source.matches(text) || (p.text.empty() && !text.empty()))
+    p.text = Utf8::truncate(text, width);
+  return p.text;
+}
+
+bool LayoutCache::Source::matches(std::string_view text) {
+  if (text.data() == data && text.size() == size)
+    return true;
+  size_t h = std::hash<std::string_view>()(text);
+  bool same = data && h == hash && text.size() == size;
+  data = text.data();
+  size = text.size();
+  hash = h;
+  return same;
+}
+
+void LayoutCache::invalidate(int cardId) {
+  for (auto it = _entries.begin(); it != _entries.end();) {
+    if ((int)(it->first >> 32) == cardId)
+      it = _entries.erase(it);
+    else
+      ++it;
+  }
+  for (auto it = _previews.begin(); it != _previews.end();) {
+    if ((int)(it->first >> 32) == cardId)
+      it = _previews.erase(it);
+    else
+      ++it;
+  }
+}
+
+void LayoutCache::clear() {
+  _entries.clear();
+  _previews.clear();
+}
+
+uint64_t LayoutCache::key(int cardId, int side, int width) {
+  return ((uint64_t)(uint32_t)cardId << 32) |
+         ((uint64_t)(side & 1) << 31) | (uint32_t)(width & 0x7fffffff);
+}
@@ -0,0 +1,74 @@
+#ifndef TANKI_TEXTLAYOUT_HPP
+#define TANKI_TEXTLAYOUT_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// One wrapped line: a byte range of the source text
+struct LayoutLine {
+  uint32_t start;
+  uint32_t length;
+};
+
+/**
+ * Word wrapping for card text, by terminal columns (UTF-8 aware).
+ * - Breaks at spaces or between wide CJK characters, keeps newlines
+ * - Words longer than the width are split between characters
+ * - Pure ASCII text takes a byte-per-column fast path
+ */
+class TextLayout {
+public:
+  static std::vector<LayoutLine> wrap(std::string_view text, int width);
+
+private:
+  static void wrapAscii(std::string_view text, size_t start, int width,
+                        std::vector<LayoutLine> &out);
+  static void wrapUtf8(std::string_view text, size_t start, int width,
+                       std::vector<LayoutLine> &out);
+};
+
+/**
+ * Wrapped lines and one-line previews per (card, side, width).
+ * Layout and display widths are computed once per card and window
+ * width; a changed text (edit) or a cleared cache (resize) triggers a
+ * new layout. A lookup for the same text buffer is a hit without
+ * reading the text; only a new buffer (a copied or edited card) is
+ * hashed to tell whether the text changed.
+ */
+class LayoutCache {
+public:
+  const std::vector<LayoutLine> &lines(int cardId, int side,
+                                       std::string_view text, int width);
+  // text cut to `width` columns on a character boundary, "..." if cut
+  const std::string &preview(int cardId, int side, std::string_view text,
+                             int width);
+  void invalidate(int cardId);
+  void clear();
+
+private:
+  // The text an entry was made from
+  struct Source {
+    const char *data = nullptr;
+    size_t size = 0;
+    size_t hash = 0;
+    // Same text as before; updates `data` when only the buffer moved
+    bool matches(std::string_view text);
+  };
+  struct Entry {
+    Source source;
+    std::vector<LayoutLine> lines;
+  };
+  struct Preview {
+    Source source;
+    std::string text;
+  };
+  static uint64_t key(int cardId, int side, int width);
+
+  std::unordered_map<uint64_t, Entry> _entries;
+  std::unordered_map<uint64_t, Preview> _previews;
+};
+
+#endif // TANKI_TEXTLAYOUT_HPP
@@ -1,7 +1,12 @@
 #include "UI.hpp"
+#include "CardQuery.hpp"
+#include "Metrics.hpp"
 #include <algorithm>
+#include <clocale>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
 #include <ncurses.h>
-#include <sstream>
 
 UI::UI() : mainWin(nullptr), statusWin(nullptr) {
   colorMenu = 1;
@@ -15,6 +20,8 @@ UI::UI() : mainWin(nullptr), statusWin(nullptr) {
 UI::~UI() {}
 
 void UI::init() {
+  // UTF-8 card text needs the user's locale and the wide ncurses
+  setlocale(LC_ALL, "");
   initscr();
   cbreak();
   noecho();
@@ -35,10 +42,27 @@ void UI::init() {
   getmaxyx(stdscr, h, w);
   mainWin = newwin(h - 1, w, 0, 0);
   statusWin = newwin(1, w, h - 1, 0);
+  keypad(mainWin, TRUE);
   wrefresh(mainWin);
   wrefresh(statusWin);
 }
 
+void UI::handleResize() {
+  int h, w;
+  getmaxyx(stdscr, h, w);
+  wresize(mainWin, h - 1, w);
+  wresize(statusWin, 1, w);
+  mvwin(statusWin, h - 1, 0);
+  // layouts for the old width are of no use any more
+  layoutCache.clear();
+  clear();
+  refresh();
+}
+
+void UI::invalidateLayout(int cardId) { layoutCache.invalidate(cardId); }
+
+void UI::invalidateLayouts() { layoutCache.clear(); }
+
 void UI::shutdown() {
   if (mainWin)
     delwin(mainWin);
@@ -55,60 +79,59 @@ void UI::shutdown() {
  *   - -1 if user quits
  *   - -2 if user picks "create"
  */
-int UI::startScreenWithDecks(const std::vector<std::shared_ptr<Deck>> &decks) {
-  clearAll();
-  wattron(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
-  box(mainWin, 0, 0);
-  wattroff(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
+int UI::startScreenWithDecks(DeckTree &tree) {
+  std::vector<int> rows = tree.visible();
+  int cursor = 0;
+  while (true) {
+    clearAll();
+    wattron(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
+    box(mainWin, 0, 0);
+    wattroff(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
 
-  // ASCII logoa
-  //
-  wattron(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
-  mvwprintw(mainWin, 1, 3, " ______          __    ");
-  mvwprintw(mainWin, 2, 3, "/_  __/__ ____  / /__ (_)");
-  mvwprintw(mainWin, 3, 3, " / / / _ \\/ _ \\/  '_// / ");
-  mvwprintw(mainWin, 4, 3, "/_/  \\_,_/_//_/_/\\_\\/_/  ");
-  mvwprintw(mainWin, 6, 3, "Tanki --  A Terminal SRS  ");
-  wattroff(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
+    // ASCII logoa
+    //
+    wattron(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
+    mvwprintw(mainWin, 1, 3, " ______          __    ");
+    mvwprintw(mainWin, 2, 3, "/_  __/__ ____  / /__ (_)");
+    mvwprintw(mainWin, 3, 3, " / / / _ \\/ _ \\/  '_// / ");
+    mvwprintw(mainWin, 4, 3, "/_/  \\_,_/_//_/_/\\_\\/_/  ");
+    mvwprintw(mainWin, 6, 3, "Tanki --  A Terminal SRS  ");
+    wattroff(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
+
+    // Show decks
+    wattron(mainWin, COLOR_PAIR(colorNormal) | A_BOLD);
+    mvwprintw(mainWin, 8, 2, "Select a deck to open:");
+    wattroff(mainWin, COLOR_PAIR(colorNormal) | A_BOLD);
 
-  // Show decks
-  wattron(mainWin, COLOR_PAIR(colorNormal) | A_BOLD);
-  mvwprintw(mainWin, 8, 2, "Select a deck to open:");
-  wattroff(mainWin, COLOR_PAIR(colorNormal) | A_BOLD);
+    // leave room for the two actions below the list
+    int height = std::max(1, getmaxy(mainWin) - 14);
+    drawDeckTree(tree, rows, cursor, 10, height);
+    int y = 10 + std::min(height, (int)rows.size());
 
-  int y = 10;
-  for (size_t i = 0; i < decks.size(); i++) {
     wattron(mainWin, COLOR_PAIR(colorMenu));
-    mvwprintw(mainWin, y, 2, "[%zu]", i);
+    mvwprintw(mainWin, y + 1, 2, "[c]");
     wattroff(mainWin, COLOR_PAIR(colorMenu));
-    mvwprintw(mainWin, y, 6, "%s", decks[i]->name().c_str());
-    y++;
-  }
+    mvwprintw(mainWin, y + 1, 6, "Create New Deck");
 
-  wattron(mainWin, COLOR_PAIR(colorMenu));
-  mvwprintw(mainWin, y + 1, 2, "[c]");
-  wattroff(mainWin, COLOR_PAIR(colorMenu));
-  mvwprintw(mainWin, y + 1, 6, "Create New Deck");
-
-  wattron(mainWin, COLOR_PAIR(colorMenu));
-  mvwprintw(mainWin, y + 2, 2, "[q]");
-  wattroff(mainWin, COLOR_PAIR(colorMenu));
-  mvwprintw(mainWin, y + 2, 6, "Quit");
+    wattron(mainWin, COLOR_PAIR(colorMenu));
+    mvwprintw(mainWin, y + 2, 2, "[q]");
+    wattroff(mainWin, COLOR_PAIR(colorMenu));
+    mvwprintw(mainWin, y + 2, 6, "Quit");
 
-  wrefresh(mainWin);
-  drawStatusLine("Press deck number, 'c' for create, or 'q' to quit.");
+    present();
+    drawStatusLine("Up/Down and Enter to open, Space to fold, 'c' for "
+                   "create, or 'q' to quit.");
 
-  while (true) {
     int ch = wgetch(mainWin);
+    int deck;
     if (ch == 'q') {
       return -1;
     } else if (ch == 'c') {
       return -2;
-    } else if (isdigit(ch)) {
-      int idx = ch - '0';
-      if (idx >= 0 && idx < (int)decks.size()) {
-        return idx;
-      }
+    } else if (ch == KEY_RESIZE) {
+      handleResize();
+    } else if (deckTreeKey(tree, rows, cursor, ch, deck)) {
+      return deck;
     }
   }
 }
@@ -138,7 +161,7 @@ int UI::startScreenNoDecks() {
   wattroff(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
   waddstr(mainWin, " to quit.");
 
-  wrefresh(mainWin);
+  present();
 
   while (true) {
     int ch = wgetch(mainWin);
@@ -176,57 +199,82 @@ void UI::drawMainMenu(const std::string &deckName) {
     mvwprintw(mainWin, 5, 8, "Review due cards");
 
     wattron(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
-    mvwprintw(mainWin, 6, 4, "[c]");
+    mvwprintw(mainWin, 6, 4, "[a]");
+    wattroff(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
+    mvwprintw(mainWin, 6, 8, "Review all decks");
+
+    wattron(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
+    mvwprintw(mainWin, 7, 4, "[c]");
+    wattroff(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
+    mvwprintw(mainWin, 7, 8, "Cram");
+
+    wattron(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
+    mvwprintw(mainWin, 8, 4, "[b]");
     wattroff(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
-    mvwprintw(mainWin, 6, 8, "Cram");
+    mvwprintw(mainWin, 8, 8, "Browse cards");
 
     wattron(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
-    mvwprintw(mainWin, 7, 4, "[b]");
+    mvwprintw(mainWin, 9, 4, "[i]");
     wattroff(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
-    mvwprintw(mainWin, 7, 8, "Browse cards");
+    mvwprintw(mainWin, 9, 8, "Import CSV");
 
     wattron(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
-    mvwprintw(mainWin, 8, 4, "[i]");
+    mvwprintw(mainWin, 10, 4, "[x]");
     wattroff(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
-    mvwprintw(mainWin, 8, 8, "Import CSV");
+    mvwprintw(mainWin, 10, 8, "Delete card ([X] by query)");
 
     wattron(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
-    mvwprintw(mainWin, 9, 4, "[x]");
+    mvwprintw(mainWin, 11, 4, "[t]");
     wattroff(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
-    mvwprintw(mainWin, 9, 8, "Delete card");
+    mvwprintw(mainWin, 11, 8, "Stats");
 
     wattron(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
-    mvwprintw(mainWin, 10, 4, "[t]");
+    mvwprintw(mainWin, 12, 4, "[s]");
     wattroff(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
-    mvwprintw(mainWin, 10, 8, "Stats");
+    mvwprintw(mainWin, 12, 8, "Schedule");
 
     wattron(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
-    mvwprintw(mainWin, 11, 4, "[s]");
+    mvwprintw(mainWin, 13, 4, "[d]");
     wattroff(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
-    mvwprintw(mainWin, 11, 8, "Schedule");
+    mvwprintw(mainWin, 13, 8, "Switch deck");
 
     wattron(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
-    mvwprintw(mainWin, 12, 4, "[d]");
+    mvwprintw(mainWin, 14, 4, "[z]");
     wattroff(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
-    mvwprintw(mainWin, 12, 8, "Switch deck");
+    mvwprintw(mainWin, 14, 8, "Toggle compressed storage");
+
+    wattron(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
+    mvwprintw(mainWin, 15, 4, "[m]");
+    wattroff(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
+    mvwprintw(mainWin, 15, 8, "Merge another deck into this one");
+
+    wattron(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
+    mvwprintw(mainWin, 16, 4, "[p]");
+    wattroff(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
+    mvwprintw(mainWin, 16, 8, "Split cards into a new deck");
+
+    wattron(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
+    mvwprintw(mainWin, 17, 4, "[u]");
+    wattroff(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
+    mvwprintw(mainWin, 17, 8, "Undo last change ([y] to redo)");
   }
 
   wattron(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
-  mvwprintw(mainWin, 14, 4, "[n]");
+  mvwprintw(mainWin, 19, 4, "[n]");
   wattroff(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
-  mvwprintw(mainWin, 14, 8, "Create deck");
+  mvwprintw(mainWin, 19, 8, "Create deck");
 
   wattron(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
-  mvwprintw(mainWin, 15, 4, "[?]");
+  mvwprintw(mainWin, 20, 4, "[?]");
   wattroff(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
-  mvwprintw(mainWin, 15, 8, "Help");
+  mvwprintw(mainWin, 20, 8, "Help");
 
   wattron(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
-  mvwprintw(mainWin, 16, 4, "[q]");
+  mvwprintw(mainWin, 21, 4, "[q]");
   wattroff(mainWin, COLOR_PAIR(colorMenu) | A_BOLD);
-  mvwprintw(mainWin, 16, 8, "Quit");
+  mvwprintw(mainWin, 21, 8, "Quit");
 
-  wrefresh(mainWin);
+  present();
   drawStatusLine("Ready.");
 }
 
@@ -249,14 +297,24 @@ std::string UI::promptString(const std::string &message) {
 
   mvwprintw(mainWin, 4, 2, "> ");
   wmove(mainWin, 4, 4);
-  wrefresh(mainWin);
+  present();
 
-  char buffer[512];
-  wgetnstr(mainWin, buffer, 511);
+  wint_t buffer[512];
+  if (wgetn_wstr(mainWin, buffer, 511) == ERR)
+    buffer[0] = 0;
 
   noecho();
   curs_set(0);
-  return std::string(buffer);
+
+  std::wstring wide;
+  for (int i = 0; buffer[i]; i++)
+    wide.push_back((wchar_t)buffer[i]);
+  std::string out(wide.size() * MB_CUR_MAX + 1, '\0');
+  size_t n = wcstombs(&out[0], wide.c_str(), out.size());
+  if (n == (size_t)-1)
+    return std::string();
+  out.resize(n);
+  return out;
 }
 
 void UI::browseDeck(std::shared_ptr<Deck> deck) {
@@ -265,10 +323,23 @@ void UI::browseDeck(std::shared_ptr<Deck> deck) {
     return;
   }
 
-  auto cards = deck->cards();
+  static const char *orderNames[Deck::OrderCount] = {
+      "deck order", "due date", "ease", "interval", "last rating", "front"};
   const int PAGE_SIZE = 10;
-  int total = (int)cards.size();
+  int total = (int)deck->size();
   int page = 0;
+  Deck::Order order = Deck::DeckOrder;
+  bool reversed = false;
+  // cards matching the filter, in `order`; unused without a filter
+  CardQuery filter;
+  std::vector<int> shown;
+  auto refilter = [&]() {
+    shown = filter.select(*deck);
+    std::sort(shown.begin(), shown.end(), [&](int a, int b) {
+      return Deck::sortsBefore(order, *deck->findCard(a), *deck->findCard(b));
+    });
+    total = (int)shown.size();
+  };
 
   while (true) {
     clearAll();
@@ -280,31 +351,52 @@ void UI::browseDeck(std::shared_ptr<Deck> deck) {
     mvwprintw(mainWin, 0, 2, " BROWSE ");
     wattroff(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
 
-    mvwprintw(mainWin, 1, 2, "Deck: %s (%d cards)", deck->name().c_str(),
-              total);
+    mvwprintw(mainWin, 1, 2, "Deck: %s (%d cards), by %s%s",
+              deck->name().c_str(), total, orderNames[order],
+              reversed ? ", reversed" : "");
+    if (!filter.empty())
+      mvwprintw(mainWin, 2, 2, "Filter: %s", filter.text().c_str());
 
     int start = page * PAGE_SIZE;
     int end = std::min(start + PAGE_SIZE, total);
     int y = 3;
     for (int i = start; i < end; i++) {
+      int pos = reversed ? total - 1 - i : i;
+      const Card &card = filter.empty() ? deck->at(order, pos)
+                                        : *deck->findCard(shown[pos]);
       wattron(mainWin, COLOR_PAIR(colorMenu));
       mvwprintw(mainWin, y, 2, "[%d]", i);
       wattroff(mainWin, COLOR_PAIR(colorMenu));
 
       // short preview of front
-      std::string front = cards[i].front();
-      if (front.size() > 50) {
-        front = front.substr(0, 47) + "...";
-      }
+      const std::string &front =
+          layoutCache.preview(card.id(), 0, card.front(), 50);
       wattron(mainWin, COLOR_PAIR(colorFront));
-      mvwprintw(mainWin, y, 7, "%s", front.c_str());
+      mvwprintw(mainWin, y, 11, "%s", front.c_str());
       wattroff(mainWin, COLOR_PAIR(colorFront));
+
+      // the value the cards are sorted by
+      char value[32] = "";
+      if (order == Deck::ByDue) {
+        time_t due = card.dueDate();
+        std::strftime(value, sizeof(value), "%Y-%m-%d",
+                      std::localtime(&due));
+      } else if (order == Deck::ByEase) {
+        std::snprintf(value, sizeof(value), "%.2f", card.easeFactor());
+      } else if (order == Deck::ByInterval) {
+        std::snprintf(value, sizeof(value), "%dd", card.interval());
+      } else if (order == Deck::ByLastRating) {
+        std::snprintf(value, sizeof(value), "%d", card.lastRating());
+      }
+      mvwprintw(mainWin, y, 63, "%s", value);
       y++;
     }
 
-    mvwprintw(mainWin, PAGE_SIZE + 5, 2, "Page %d/%d (n=Next, p=Prev, q=Quit)",
+    mvwprintw(mainWin, PAGE_SIZE + 5, 2,
+              "Page %d/%d (n=Next, p=Prev, o=Order, r=Reverse, g=Go to, "
+              "f=Filter, q=Quit)",
               page + 1, (total + PAGE_SIZE - 1) / PAGE_SIZE);
-    wrefresh(mainWin);
+    present();
 
     int c = wgetch(mainWin);
     if (c == 'q') {
@@ -315,6 +407,32 @@ void UI::browseDeck(std::shared_ptr<Deck> deck) {
     } else if (c == 'p') {
       if (page > 0)
         page--;
+    } else if (c == 'o') {
+      order = (Deck::Order)((order + 1) % Deck::OrderCount);
+      page = 0;
+      if (!filter.empty())
+        refilter();
+    } else if (c == 'r') {
+      reversed = !reversed;
+      page = 0;
+    } else if (c == 'g') {
+      int n = std::atoi(promptString("Go to card number:").c_str());
+      if (n >= 0 && n < total)
+        page = n / PAGE_SIZE;
+    } else if (c == 'f') {
+      std::string error;
+      CardQuery q;
+      if (!CardQuery::parse(promptString("Filter (blank=all cards):"), q,
+                            error)) {
+        showMessage("Bad query: " + error);
+        continue;
+      }
+      filter = q;
+      page = 0;
+      if (filter.empty())
+        total = (int)deck->size();
+      else
+        refilter();
     }
   }
 }
@@ -352,10 +470,8 @@ int UI::promptIndexToDelete(const std::vector<Card> &cards,
       mvwprintw(mainWin, y, 2, "[%d]", i);
       wattroff(mainWin, COLOR_PAIR(colorMenu));
 
-      std::string front = cards[i].front();
-      if (front.size() > 50) {
-        front = front.substr(0, 47) + "...";
-      }
+      const std::string &front =
+          layoutCache.preview(cards[i].id(), 0, cards[i].front(), 50);
       wattron(mainWin, COLOR_PAIR(colorFront));
       mvwprintw(mainWin, y, 7, "%s", front.c_str());
       wattroff(mainWin, COLOR_PAIR(colorFront));
@@ -366,7 +482,7 @@ int UI::promptIndexToDelete(const std::vector<Card> &cards,
         mainWin, PAGE_SIZE + 5, 2,
         "Page %d/%d - Enter index to delete, 'n'=Next, 'p'=Prev, 'q'=Cancel",
         page + 1, (total + PAGE_SIZE - 1) / PAGE_SIZE);
-    wrefresh(mainWin);
+    present();
 
     int c = wgetch(mainWin);
     if (c == 'q') {
@@ -387,36 +503,33 @@ int UI::promptIndexToDelete(const std::vector<Card> &cards,
   }
 }
 
-int UI::showDeckSelection(const std::vector<std::shared_ptr<Deck>> &decks) {
-  clearAll();
-  wattron(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
-  box(mainWin, 0, 0);
-  wattroff(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
-
-  wattron(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
-  mvwprintw(mainWin, 0, 2, " SWITCH DECK ");
-  wattroff(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
+int UI::showDeckSelection(DeckTree &tree) {
+  std::vector<int> rows = tree.visible();
+  int cursor = 0;
+  while (true) {
+    clearAll();
+    wattron(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
+    box(mainWin, 0, 0);
+    wattroff(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
 
-  for (size_t i = 0; i < decks.size(); i++) {
-    wattron(mainWin, COLOR_PAIR(colorMenu));
-    mvwprintw(mainWin, i + 2, 2, "[%zu]", i);
-    wattroff(mainWin, COLOR_PAIR(colorMenu));
+    wattron(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
+    mvwprintw(mainWin, 0, 2, " SWITCH DECK ");
+    wattroff(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
 
-    mvwprintw(mainWin, i + 2, 6, "%s", decks[i]->name().c_str());
-  }
-  mvwprintw(mainWin, decks.size() + 3, 2, "Enter number or 'q' to cancel:");
-  wrefresh(mainWin);
+    int height = std::max(1, getmaxy(mainWin) - 5);
+    drawDeckTree(tree, rows, cursor, 2, height);
+    mvwprintw(mainWin, 3 + std::min(height, (int)rows.size()), 2,
+              "Enter to pick, Space to fold, 'q' to cancel:");
+    present();
 
-  while (true) {
     int ch = wgetch(mainWin);
+    int deck;
     if (ch == 'q') {
       return -1;
-    }
-    if (isdigit(ch)) {
-      int idx = ch - '0';
-      if (idx >= 0 && idx < (int)decks.size()) {
-        return idx;
-      }
+    } else if (ch == KEY_RESIZE) {
+      handleResize();
+    } else if (deckTreeKey(tree, rows, cursor, ch, deck)) {
+      return deck;
     }
   }
 }
@@ -433,107 +546,240 @@ void UI::showMessage(const std::string &message) {
 
   mvwprintw(mainWin, 2, 2, "%s", message.c_str());
   mvwprintw(mainWin, 4, 2, "[Press any key]");
-  wrefresh(mainWin);
+  present();
   wgetch(mainWin);
 }
 
+bool UI::waitForCard(time_t ready, int waiting) {
+  bool done = false;
+  while (!done) {
+    time_t left = ready - std::time(nullptr);
+    if (left <= 0)
+      break;
+    clearAll();
+    wattron(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
+    box(mainWin, 0, 0);
+    wattroff(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
+
+    wattron(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
+    mvwprintw(mainWin, 0, 2, " LEARNING ");
+    wattroff(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
+
+    mvwprintw(mainWin, 2, 2, "%d failed card%s still to come back.", waiting,
+              waiting == 1 ? " is" : "s are");
+    mvwprintw(mainWin, 3, 2, "Next one in %lld:%02lld.",
+              (long long)left / 60, (long long)left % 60);
+    mvwprintw(mainWin, 5, 2, "[Press any key to end the session]");
+    present();
+    wtimeout(mainWin, 1000);
+    int c = wgetch(mainWin);
+    if (c == KEY_RESIZE)
+      handleResize();
+    else if (c != ERR)
+      done = true;
+  }
+  wtimeout(mainWin, -1);
+  return !done;
+}
+
 void UI::showLongText(const std::string &title, const std::string &content) {
-  clearAll();
-  wattron(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
-  box(mainWin, 0, 0);
-  wattroff(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
+  int first = 0;
+  while (true) {
+    clearAll();
+    wattron(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
+    box(mainWin, 0, 0);
+    wattroff(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
 
-  wattron(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
-  mvwprintw(mainWin, 0, 2, " %s ", title.c_str());
-  wattroff(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
+    wattron(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
+    mvwprintw(mainWin, 0, 2, " %s ", title.c_str());
+    wattroff(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
 
-  int maxy, maxx;
-  getmaxyx(mainWin, maxy, maxx);
-  int row = 2;
-  int col = 2;
-
-  std::istringstream iss(content);
-  std::string word;
-  while (iss >> word) {
-    if (col + (int)word.size() + 1 >= maxx - 2) {
-      row++;
-      col = 2;
-    }
-    if (row >= maxy - 2) {
-      mvwprintw(mainWin, maxy - 1, 2, "[Press any key]");
-      wrefresh(mainWin);
-      wgetch(mainWin);
-
-      clearAll();
-      wattron(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
-      box(mainWin, 0, 0);
-      wattroff(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
-
-      wattron(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
-      mvwprintw(mainWin, 0, 2, " %s ", title.c_str());
-      wattroff(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
-
-      row = 2;
-      col = 2;
+    int maxy, maxx;
+    getmaxyx(mainWin, maxy, maxx);
+    int rows = std::max(1, maxy - 5);
+    auto lines = TextLayout::wrap(content, maxx - 4);
+    first = std::max(0, std::min(first, (int)lines.size() - rows));
+    drawLines(content, lines, first, 2, 2, rows);
+
+    bool more = first + rows < (int)lines.size();
+    mvwprintw(mainWin, maxy - 2, 2, "%s",
+              more ? "[Down/PgDn = more, any other key to continue]"
+                   : "[Press any key to continue]");
+    present();
+
+    int c = wgetch(mainWin);
+    if (c == KEY_RESIZE) {
+      handleResize();
+    } else if (c == KEY_DOWN && more) {
+      first++;
+    } else if (c == KEY_UP) {
+      first--;
+    } else if (c == KEY_NPAGE || (c == ' ' && more)) {
+      first += rows;
+    } else if (c == KEY_PPAGE) {
+      first -= rows;
+    } else {
+      break;
     }
-    mvwprintw(mainWin, row, col, "%s ", word.c_str());
-    col += word.size() + 1;
   }
+}
 
-  mvwprintw(mainWin, row + 2, 2, "[Press any key to continue]");
-  wrefresh(mainWin);
-  wgetch(mainWin);
+void UI::drawLines(std::string_view text, const std::vector<LayoutLine> &lines,
+                   int first, int top, int left, int rows) {
+  for (int r = 0; r < rows && first + r < (int)lines.size(); r++) {
+    const LayoutLine &l = lines[first + r];
+    mvwprintw(mainWin, top + r, left, "%.*s", (int)l.length,
+              text.data() + l.start);
+  }
 }
 
-bool UI::reviewCard(Card &card, bool isCram) {
-  clearAll();
-  wattron(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
-  box(mainWin, 0, 0);
-  wattroff(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
+int UI::showCardSide(const Card &card, int side, const char *title,
+                     const std::string &hint,
+                     const std::chrono::steady_clock::time_point *deadline) {
+  using Clock = std::chrono::steady_clock;
+  std::string_view text = side == 0 ? card.front() : card.back();
+  int first = 0;
+  bool shown = false;
+  while (true) {
+    clearAll();
+    wattron(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
+    box(mainWin, 0, 0);
+    wattroff(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
 
-  wattron(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
-  mvwprintw(mainWin, 0, 2, " %s ", isCram ? "CRAM" : "REVIEW");
-  wattroff(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
+    wattron(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
+    mvwprintw(mainWin, 0, 2, " %s ", title);
+    wattroff(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
 
-  wattron(mainWin, COLOR_PAIR(colorMenu));
-  mvwprintw(mainWin, 2, 2, "Front:");
-  wattroff(mainWin, COLOR_PAIR(colorMenu));
+    wattron(mainWin, COLOR_PAIR(colorMenu));
+    mvwprintw(mainWin, 2, 2, "%s", side == 0 ? "Front:" : "Back:");
+    wattroff(mainWin, COLOR_PAIR(colorMenu));
 
-  wattron(mainWin, COLOR_PAIR(colorFront) | A_BOLD);
-  mvwprintw(mainWin, 3, 4, "%s", card.front().c_str());
-  wattroff(mainWin, COLOR_PAIR(colorFront) | A_BOLD);
+    int maxy, maxx;
+    getmaxyx(mainWin, maxy, maxx);
+    int rows = std::max(1, maxy - 7);
+    const auto &lines = layoutCache.lines(card.id(), side, text, maxx - 6);
+    first = std::max(0, std::min(first, (int)lines.size() - rows));
+
+    int color = side == 0 ? colorFront : colorBack;
+    wattron(mainWin, COLOR_PAIR(color) | A_BOLD);
+    drawLines(text, lines, first, 3, 4, rows);
+    wattroff(mainWin, COLOR_PAIR(color) | A_BOLD);
+
+    int shownLines = std::min(rows, (int)lines.size());
+    if ((int)lines.size() > rows) {
+      mvwprintw(mainWin, 3 + shownLines, 4,
+                "-- lines %d-%d of %zu (Up/Down) --", first + 1,
+                first + shownLines, lines.size());
+      shownLines++;
+    }
+    int hintRow = 4 + shownLines;
+    mvwprintw(mainWin, hintRow, 2, "%s", hint.c_str());
+    present();
+    if (!shown) {
+      sideShown = Clock::now();
+      shown = true;
+    }
 
-  mvwprintw(mainWin, 5, 2, "[Press any key to flip or 'q' to quit]");
-  wrefresh(mainWin);
+    int c;
+    if (deadline) {
+      // wake once a second to redraw only the countdown
+      while (true) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        *deadline - Clock::now())
+                        .count();
+        if (left <= 0) {
+          c = ERR;
+          break;
+        }
+        mvwprintw(mainWin, hintRow, 4 + (int)hint.size(), "%3llds left",
+                  (long long)(left + 999) / 1000);
+        wrefresh(mainWin);
+        wtimeout(mainWin, (int)((left - 1) % 1000 + 1));
+        c = wgetch(mainWin);
+        if (c != ERR)
+          break;
+      }
+      wtimeout(mainWin, -1);
+    } else {
+      c = wgetch(mainWin);
+    }
+    if (c == KEY_RESIZE) {
+      handleResize();
+    } else if (c == KEY_DOWN) {
+      first++;
+    } else if (c == KEY_UP) {
+      first--;
+    } else if (c == KEY_NPAGE) {
+      first += rows;
+    } else if (c == KEY_PPAGE) {
+      first -= rows;
+    } else {
+      return c;
+    }
+  }
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point t) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t)
+      .count();
+}
 
-  int c = wgetch(mainWin);
+bool UI::reviewCard(Card &card, bool isCram, Timing *timing) {
+  static auto &flipSeconds = Metrics::histogram(
+      "tanki_review_flip_seconds", "Time from a card's front to its flip");
+  static auto &rateSeconds = Metrics::histogram(
+      "tanki_review_rate_seconds", "Time from a card's back to its rating");
+  const char *title = isCram ? "CRAM" : "REVIEW";
+  int c = showCardSide(card, 0, title,
+                       "[Press any key to flip or 'q' to quit]");
   if (c == 'q') {
     return false;
   }
+  double flip = secondsSince(sideShown);
 
-  // Show back
-  clearAll();
-  wattron(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
-  box(mainWin, 0, 0);
-  wattroff(mainWin, COLOR_PAIR(colorBorder) | A_BOLD);
-
-  wattron(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
-  mvwprintw(mainWin, 0, 2, " %s ", isCram ? "CRAM" : "REVIEW");
-  wattroff(mainWin, COLOR_PAIR(colorTitle) | A_BOLD);
-
-  wattron(mainWin, COLOR_PAIR(colorMenu));
-  mvwprintw(mainWin, 2, 2, "Back:");
-  wattroff(mainWin, COLOR_PAIR(colorMenu));
-
-  wattron(mainWin, COLOR_PAIR(colorBack) | A_BOLD);
-  mvwprintw(mainWin, 3, 4, "%s", card.back().c_str());
-  wattroff(mainWin, COLOR_PAIR(colorBack) | A_BOLD);
+  // Show back; a stray key redraws it without restarting the clock
+  auto backShown = std::chrono::steady_clock::now();
+  while (true) {
+    int rc = showCardSide(card, 1, title,
+                          "Rate: 1=Again, 2=Hard, 3=Good, 4=Easy, q=quit");
+    if (rc == 'q') {
+      return false;
+    }
+    if (rc >= '1' && rc <= '4') {
+      card.setLastRating(rc - '0');
+      break;
+    }
+  }
+  double rate = secondsSince(backShown);
+  if (!isCram) {
+    flipSeconds.observe(flip);
+    rateSeconds.observe(rate);
+  }
+  if (timing) {
+    timing->flip = flip;
+    timing->rate = rate;
+  }
+  return true;
+}
 
-  mvwprintw(mainWin, 5, 2, "Rate: 1=Again, 2=Hard, 3=Good, 4=Easy, q=quit");
-  wrefresh(mainWin);
+bool UI::drillCard(Card &card, int limitSeconds, Timing &timing,
+                   bool &timedOut) {
+  auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::seconds(limitSeconds);
+  int c = showCardSide(card, 0, "DRILL",
+                       "[Any key to flip, 'q' to quit]", &deadline);
+  if (c == 'q') {
+    return false;
+  }
+  timedOut = c == ERR;
+  timing.flip = timedOut ? limitSeconds : secondsSince(sideShown);
 
+  const char *hint =
+      timedOut ? "Time's up! Rate: 1=Again, 2=Hard, 3=Good, 4=Easy, q=quit"
+               : "Rate: 1=Again, 2=Hard, 3=Good, 4=Easy, q=quit";
+  auto backShown = std::chrono::steady_clock::now();
   while (true) {
-    int rc = wgetch(mainWin);
+    int rc = showCardSide(card, 1, "DRILL", hint);
     if (rc == 'q') {
       return false;
     }
@@ -542,6 +788,7 @@ bool UI::reviewCard(Card &card, bool isCram) {
       break;
     }
   }
+  timing.rate = secondsSince(backShown);
   return true;
 }
 
@@ -551,9 +798,33 @@ void UI::drawStatusLine(const std::string &text) {
   wrefresh(statusWin);
 }
 
+void UI::drawProgress(const std::string &label, size_t done,
+                      size_t total) {
+  const int barWidth = 20;
+  int filled = total ? (int)(done * barWidth / total) : barWidth;
+  std::string bar = label + " [" + std::string(filled, '#') +
+                    std::string(barWidth - filled, ' ') + "] " +
+                    std::to_string(done) + "/" + std::to_string(total);
+  drawStatusLine(bar);
+}
+
 void UI::clearAll() {
   werase(mainWin);
   wrefresh(mainWin);
+  frameStart = std::chrono::steady_clock::now();
+  frameOpen = true;
+}
+
+void UI::present() {
+  static auto &seconds = Metrics::histogram(
+      "tanki_ui_frame_seconds", "Time to lay out and draw one screen");
+  wrefresh(mainWin);
+  if (frameOpen) {
+    std::chrono::duration<double> took =
+        std::chrono::steady_clock::now() - frameStart;
+    seconds.observe(took.count());
+    frameOpen = false;
+  }
 }
 
 void UI::drawBoxTitle(WINDOW *win, const std::string &title) {
@@ -563,3 +834,71 @@ void UI::drawBoxTitle(WINDOW *win, const std::string &title) {
   mvwprintw(win, 0, 2, " %s ", title.c_str());
   wrefresh(win);
 }
+
+void UI::drawDeckTree(const DeckTree &tree, const std::vector<int> &rows,
+                      int cursor, int top, int height) {
+  int first = std::max(0, cursor - height + 1);
+  for (int r = 0; r < height && first + r < (int)rows.size(); r++) {
+    const DeckTree::Node &n = tree.node(rows[first + r]);
+    int y = top + r;
+    wattron(mainWin, COLOR_PAIR(colorMenu));
+    if (!n.children.empty())
+      mvwprintw(mainWin, y, 2, n.collapsed ? "[+]" : "[-]");
+    wattroff(mainWin, COLOR_PAIR(colorMenu));
+
+    if (first + r == cursor)
+      wattron(mainWin, A_REVERSE);
+    if (n.deck < 0)
+      wattron(mainWin, A_DIM);
+    mvwprintw(mainWin, y, 6 + 2 * n.depth, "%s", n.label.c_str());
+    wattroff(mainWin, A_REVERSE | A_DIM);
+
+    const DeckTree::Counts &c = n.total;
+    wattron(mainWin, COLOR_PAIR(colorBack));
+    wprintw(mainWin, "  (%d cards, %d%s due, %d new)", c.cards, c.due,
+            c.inexact ? "+" : "", c.newCards);
+    wattroff(mainWin, COLOR_PAIR(colorBack));
+  }
+}
+
+bool UI::deckTreeKey(DeckTree &tree, std::vector<int> &rows, int &cursor,
+                     int ch, int &deck) {
+  if (rows.empty())
+    return false;
+  int node = rows[cursor];
+  const DeckTree::Node &n = tree.node(node);
+  bool fold = false;
+  if (ch == KEY_UP || ch == 'k') {
+    cursor = std::max(cursor - 1, 0);
+  } else if (ch == KEY_DOWN || ch == 'j') {
+    cursor = std::min(cursor + 1, (int)rows.size() - 1);
+  } else if (ch == KEY_PPAGE) {
+    cursor = std::max(cursor - 10, 0);
+  } else if (ch == KEY_NPAGE) {
+    cursor = std::min(cursor + 10, (int)rows.size() - 1);
+  } else if (ch == KEY_LEFT || ch == 'h') {
+    if (!n.children.empty() && !n.collapsed) {
+      fold = true;
+    } else if (n.parent >= 0) {
+      // step out to the parent
+      cursor = (int)(std::find(rows.begin(), rows.end(), n.parent) -
+                     rows.begin());
+    }
+  } else if (ch == KEY_RIGHT || ch == 'l') {
+    fold = n.collapsed;
+  } else if (ch == ' ') {
+    fold = true;
+  } else if (ch == '\n' || ch == KEY_ENTER) {
+    if (n.deck >= 0) {
+      deck = n.deck;
+      return true;
+    }
+    fold = true;
+  }
+  if (fold) {
+    tree.toggle(node);
+    rows = tree.visible();
+    cursor = (int)(std::find(rows.begin(), rows.end(), node) - rows.begin());
+  }
+  return false;
+}
@@ -3,6 +3,10 @@
 
 #include "Card.hpp"
 #include "Deck.hpp"
+#include "DeckManifest.hpp"
+#include "DeckTree.hpp"
+#include "TextLayout.hpp"
+#include <chrono>
 #include <memory>
 #include <ncurses.h>
 #include <string>
@@ -24,8 +28,9 @@ public:
   void shutdown();
   void setColorTheme(const std::string &theme);
 
-  // Fancy start screens
-  int startScreenWithDecks(const std::vector<std::shared_ptr<Deck>> &decks);
+  // Fancy start screens. Decks are picked from the tree, which keeps
+  // the parents folded or unfolded here.
+  int startScreenWithDecks(DeckTree &tree);
   int startScreenNoDecks();
 
   // Main menu
@@ -41,15 +46,37 @@ public:
   int promptIndexToDelete(const std::vector<Card> &cards,
                           const std::string &deckName);
 
-  // Deck selection
-  int showDeckSelection(const std::vector<std::shared_ptr<Deck>> &decks);
+  // Deck selection; the index of the deck picked, -1 if cancelled
+  int showDeckSelection(DeckTree &tree);
 
   // Messages & large text
   void showMessage(const std::string &message);
+  // Progress bar in the status line, for long-running deck I/O
+  void drawProgress(const std::string &label, size_t done, size_t total);
   void showLongText(const std::string &title, const std::string &content);
 
-  // Review UI
-  bool reviewCard(Card &card, bool isCram);
+  // Review UI. Times are measured on a monotonic clock from the moment
+  // a side is on screen: flip is the front until a key, rate the back
+  // until a rating.
+  struct Timing {
+    double flip = 0;
+    double rate = 0;
+  };
+  bool reviewCard(Card &card, bool isCram, Timing *timing = nullptr);
+  // One timed drill card: the front is flipped by a key or after
+  // `limitSeconds`, then the back is rated. timedOut tells which.
+  // Returns false on 'q'.
+  bool drillCard(Card &card, int limitSeconds, Timing &timing,
+                 bool &timedOut);
+
+  // Count down to `ready`, when the next of `waiting` failed cards
+  // comes back. False if a key was pressed to end the session first.
+  bool waitForCard(time_t ready, int waiting);
+
+  // Card text changed outside of review (edit/import)
+  void invalidateLayout(int cardId);
+  // Any card's text may have changed (a deck was reloaded from disk)
+  void invalidateLayouts();
 
 private:
   WINDOW *mainWin;
@@ -63,12 +90,44 @@ private:
   int colorNormal;
   int colorTitle;
 
+  // wrapped card text, per card and width
+  LayoutCache layoutCache;
+
+  // clearAll() starts a frame, present() ends it
+  std::chrono::steady_clock::time_point frameStart;
+  bool frameOpen = false;
+  // when showCardSide first put its side on screen
+  std::chrono::steady_clock::time_point sideShown;
+
   void drawStatusLine(const std::string &text);
+  // Recreate the windows after KEY_RESIZE
+  void handleResize();
+  // Draw rows [first, first + rows) of wrapped text at (top, left)
+  void drawLines(std::string_view text, const std::vector<LayoutLine> &lines,
+                 int first, int top, int left, int rows);
+  // One side of a card, scrollable with arrows/PgUp/PgDn.
+  // Returns the first other key pressed, or ERR once `deadline` (if
+  // given) has passed; the seconds left are counted down on screen.
+  int showCardSide(const Card &card, int side, const char *title,
+                   const std::string &hint,
+                   const std::chrono::steady_clock::time_point *deadline =
+                       nullptr);
   void clearAll();
+  // Refresh the main window and record the frame time
+  void present();
   void smallTransition();
 
   // optional box w/ title
   void drawBoxTitle(WINDOW *win, const std::string &title);
+
+  // Rows of visible tree nodes from `top`, scrolled so row `cursor`
+  // shows: "[-] name  (N cards, M due, K new)", counts per subtree
+  void drawDeckTree(const DeckTree &tree, const std::vector<int> &rows,
+                    int cursor, int top, int height);
+  // Move around the tree for one key. Returns true with `deck` set when
+  // a deck is picked; Enter on a parent that is not a deck folds it.
+  bool deckTreeKey(DeckTree &tree, std::vector<int> &rows, int &cursor,
+                   int ch, int &deck);
 };
 
 #endif // TANKI_UI_HPP
@@ -0,0 +1,47 @@
+#include "UndoHistory.hpp"
+#include <algorithm>
+
+UndoHistory::UndoHistory(size_t maxSteps) : _maxSteps(maxSteps) {}
+
+void UndoHistory::record(const std::shared_ptr<Deck> &deck,
+                         const std::string &label) {
+  if (!deck)
+    return;
+  _undo.push_back({deck, deck->snapshot(), label});
+  if (_undo.size() > _maxSteps)
+    _undo.pop_front();
+  _redo.clear();
+}
+
+bool UndoHistory::undo(std::shared_ptr<Deck> &deck, std::string &label) {
+  return flip(_undo, _redo, deck, label);
+}
+
+bool UndoHistory::redo(std::shared_ptr<Deck> &deck, std::string &label) {
+  return flip(_redo, _undo, deck, label);
+}
+
+void UndoHistory::forget(const std::shared_ptr<Deck> &deck) {
+  auto ofDeck = [&](const Step &s) { return s.deck == deck; };
+  _undo.erase(std::remove_if(_undo.begin(), _undo.end(), ofDeck),
+              _undo.end());
+  _redo.erase(std::remove_if(_redo.begin(), _redo.end(), ofDeck),
+              _redo.end());
+}
+
+size_t UndoHistory::undoSteps() const { return _undo.size(); }
+
+size_t UndoHistory::redoSteps() const { return _redo.size(); }
+
+bool UndoHistory::flip(std::deque<Step> &from, std::deque<Step> &to,
+                       std::shared_ptr<Deck> &deck, std::string &label) {
+  if (from.empty())
+    return false;
+  Step step = std::move(from.back());
+  from.pop_back();
+  to.push_back({step.deck, step.deck->snapshot(), step.label});
+  step.deck->restore(step.state);
+  deck = step.deck;
+  label = step.label;
+  return true;
+}
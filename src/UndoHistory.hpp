@@ -0,0 +1,48 @@
+#ifndef TANKI_UNDOHISTORY_HPP
+#define TANKI_UNDOHISTORY_HPP
+
+#include "Deck.hpp"
+#include <deque>
+#include <memory>
+#include <string>
+
+/**
+ * Multi-level undo/redo of deck changes.
+ * Record a step just before changing a deck; the step keeps a
+ * Deck::Snapshot, which shares every card the change does not touch.
+ */
+class UndoHistory {
+public:
+  explicit UndoHistory(size_t maxSteps = 100);
+
+  // `label` says what is about to change, e.g. "delete card"
+  void record(const std::shared_ptr<Deck> &deck, const std::string &label);
+
+  // Revert / reapply the latest step. On success `deck` and `label`
+  // describe it; false if there is nothing to undo / redo.
+  bool undo(std::shared_ptr<Deck> &deck, std::string &label);
+  bool redo(std::shared_ptr<Deck> &deck, std::string &label);
+
+  // Drop the steps of a deck that changed outside the history
+  // (reloaded from disk, merged, split or deleted)
+  void forget(const std::shared_ptr<Deck> &deck);
+
+  size_t undoSteps() const;
+  size_t redoSteps() const;
+
+private:
+  struct Step {
+    std::shared_ptr<Deck> deck;
+    Deck::Snapshot state;
+    std::string label;
+  };
+  std::deque<Step> _undo;
+  std::deque<Step> _redo;
+  size_t _maxSteps;
+
+  // Move the top step of `from` onto `to`, restoring its state
+  static bool flip(std::deque<Step> &from, std::deque<Step> &to,
+                   std::shared_ptr<Deck> &deck, std::string &label);
+};
+
+#endif // TANKI_UNDOHISTORY_HPP
@@ -0,0 +1,155 @@
+#include "Utf8.hpp"
+#include <algorithm>
+
+namespace {
+struct Range {
+  char32_t first;
+  char32_t last;
+};
+
+// Combining marks, zero-width spaces/joiners and variation selectors
+const Range ZERO_WIDTH[] = {
+    {0x0300, 0x036F},   {0x0483, 0x0489},   {0x0591, 0x05BD},
+    {0x0610, 0x061A},   {0x064B, 0x065F},   {0x0E31, 0x0E31},
+    {0x0E34, 0x0E3A},   {0x0E47, 0x0E4E},   {0x1AB0, 0x1AFF},
+    {0x1DC0, 0x1DFF},   {0x200B, 0x200F},   {0x2028, 0x202E},
+    {0x2060, 0x2064},   {0x20D0, 0x20FF},   {0x3099, 0x309A},
+    {0xFE00, 0xFE0F},   {0xFE20, 0xFE2F},   {0xFEFF, 0xFEFF},
+    {0x1F3FB, 0x1F3FF}, {0xE0100, 0xE01EF},
+};
+
+// East Asian Wide and Fullwidth blocks, wide emoji
+const Range WIDE[] = {
+    {0x1100, 0x115F},   {0x231A, 0x231B},   {0x2329, 0x232A},
+    {0x23E9, 0x23EC},   {0x25FD, 0x25FE},   {0x2614, 0x2615},
+    {0x2648, 0x2653},   {0x26AA, 0x26AB},   {0x26BD, 0x26BE},
+    {0x26F5, 0x26F5},   {0x26FA, 0x26FA},   {0x2705, 0x2705},
+    {0x270A, 0x270B},   {0x2728, 0x2728},   {0x274C, 0x274C},
+    {0x2753, 0x2755},   {0x2795, 0x2797},   {0x2B1B, 0x2B1C},
+    {0x2E80, 0x303E},   {0x3041, 0x3247},   {0x3250, 0x4DBF},
+    {0x4E00, 0xA4CF},   {0xA960, 0xA97F},   {0xAC00, 0xD7A3},
+    {0xF900, 0xFAFF},   {0xFE10, 0xFE19},   {0xFE30, 0xFE6F},
+    {0xFF00, 0xFF60},   {0xFFE0, 0xFFE6},   {0x16FE0, 0x18CFF},
+    {0x1B000, 0x1B2FF}, {0x1F004, 0x1F004}, {0x1F0CF, 0x1F0CF},
+    {0x1F18E, 0x1F18E}, {0x1F191, 0x1F19A}, {0x1F200, 0x1F251},
+    {0x1F300, 0x1F64F}, {0x1F680, 0x1F6FF}, {0x1F7E0, 0x1F7EB},
+    {0x1F90C, 0x1F9FF}, {0x1FA70, 0x1FAFF}, {0x20000, 0x2FFFD},
+    {0x30000, 0x3FFFD},
+};
+
+template <size_t N> bool inRanges(const Range (&table)[N], char32_t cp) {
+  size_t lo = 0, hi = N;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (cp < table[mid].first)
+      hi = mid;
+    else if (cp > table[mid].last)
+      lo = mid + 1;
+    else
+      return true;
+  }
+  return false;
+}
+
+const char32_t ZWJ = 0x200D;
+} // namespace
+
+char32_t Utf8::decode(std::string_view s, size_t &i) {
+  unsigned char c = s[i];
+  if (c < 0x80) {
+    i++;
+    return c;
+  }
+  int len = (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3
+                                   : (c & 0xF8) == 0xF0 ? 4
+                                                        : 0;
+  if (len == 0 || i + len > s.size()) {
+    i++;
+    return 0xFFFD;
+  }
+  char32_t cp = c & (0x7F >> len);
+  for (int k = 1; k < len; k++) {
+    unsigned char cc = s[i + k];
+    if ((cc & 0xC0) != 0x80) {
+      i++;
+      return 0xFFFD;
+    }
+    cp = (cp << 6) | (cc & 0x3F);
+  }
+  i += len;
+  return cp;
+}
+
+int Utf8::codepointWidth(char32_t cp) {
+  if (cp < 0x300)
+    return (cp < 0x20 || (cp >= 0x7F && cp < 0xA0)) ? 0 : 1;
+  if (inRanges(ZERO_WIDTH, cp))
+    return 0;
+  return inRanges(WIDE, cp) ? 2 : 1;
+}
+
+size_t Utf8::nextCluster(std::string_view s, size_t i, int &width) {
+  char32_t cp = decode(s, i);
+  width = codepointWidth(cp);
+  bool join = false;
+  while (i < s.size()) {
+    size_t j = i;
+    char32_t next = decode(s, j);
+    if (next == ZWJ) {
+      join = true;
+    } else if (!join && codepointWidth(next) != 0) {
+      break;
+    } else {
+      join = false;
+    }
+    i = j;
+  }
+  return i;
+}
+
+bool Utf8::isAscii(std::string_view s) {
+  for (unsigned char c : s) {
+    if (c >= 0x80)
+      return false;
+  }
+  return true;
+}
+
+int Utf8::width(std::string_view s) {
+  if (isAscii(s))
+    return (int)s.size();
+  int total = 0;
+  for (size_t i = 0; i < s.size();) {
+    int w;
+    i = nextCluster(s, i, w);
+    total += w;
+  }
+  return total;
+}
+
+size_t Utf8::fitPrefix(std::string_view s, int maxCols, int &usedCols) {
+  if (isAscii(s)) {
+    size_t n = std::min(s.size(), (size_t)std::max(0, maxCols));
+    usedCols = (int)n;
+    return n;
+  }
+  size_t i = 0;
+  usedCols = 0;
+  while (i < s.size()) {
+    int w;
+    size_t end = nextCluster(s, i, w);
+    if (usedCols + w > maxCols)
+      break;
+    usedCols += w;
+    i = end;
+  }
+  return i;
+}
+
+std::string Utf8::truncate(std::string_view s, int maxCols) {
+  if (width(s) <= maxCols)
+    return std::string(s);
+  int used;
+  size_t n = fitPrefix(s, maxCols - 3, used);
+  return std::string(s.substr(0, n)) + "...";
+}
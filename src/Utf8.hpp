@@ -0,0 +1,36 @@
+#ifndef TANKI_UTF8_HPP
+#define TANKI_UTF8_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+/**
+ * UTF-8 helpers for terminal output.
+ * Widths are terminal columns: 2 for East Asian wide/fullwidth
+ * characters, 0 for combining marks and joiners, 1 otherwise.
+ * A "cluster" is a base character plus the marks/joiners that follow
+ * it, so text is never cut inside a character or before its accents.
+ */
+class Utf8 {
+public:
+  // Decode the code point at s[i]; advances i (invalid bytes count as
+  // one U+FFFD each)
+  static char32_t decode(std::string_view s, size_t &i);
+
+  static int codepointWidth(char32_t cp);
+
+  // End of the cluster starting at s[i]; width receives its columns
+  static size_t nextCluster(std::string_view s, size_t i, int &width);
+
+  static bool isAscii(std::string_view s);
+  static int width(std::string_view s);
+
+  // Longest prefix of whole clusters that fits in maxCols columns
+  static size_t fitPrefix(std::string_view s, int maxCols, int &usedCols);
+
+  // s if it fits in maxCols, otherwise a prefix + "..."
+  static std::string truncate(std::string_view s, int maxCols);
+};
+
+#endif // TANKI_UTF8_HPP
@@ -1,6 +1,23 @@
 #include "App.hpp"
+#include "CLI.hpp"
+#include "FileManager.hpp"
+#include "StudyClient.hpp"
+#include "StudyServer.hpp"
+#include <string>
 
 int main(int argc, char **argv) {
+  bool local = argc > 1 && std::string(argv[1]) == "--local";
+  if (argc > 1 && !local)
+    return CLI::run(argc, argv);
+
+  // a running `Tanki serve` already holds the decks
+  if (!local) {
+    StudyClient client;
+    if (client.connect(
+            StudyServer::socketPath(FileManager::deckDirectory())))
+      return client.runTerminal();
+  }
+
   App app;
   app.run();
   return 0;
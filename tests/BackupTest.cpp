@@ -0,0 +1,67 @@
+#include "Backup.hpp"
+#include "Check.hpp"
+#include "FileManager.hpp"
+#include <filesystem>
+#include <random>
+
+static std::string cardLines(size_t n, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::string data = "big\n";
+  for (size_t i = 0; i < n; i++) {
+    data += "front " + std::to_string(i) + " " + std::to_string(rng()) +
+            "|back " + std::to_string(rng()) + "|0|2.5|0|0||0|0|\n";
+  }
+  return data;
+}
+
+// Chunk boundaries follow the content, so an edit in the middle of a
+// file leaves the chunks before and after it as they were
+static void testChunkBoundaries(const std::string &dir) {
+  std::string decks = dir + "/decks", repo = dir + "/repo";
+  std::filesystem::create_directories(decks);
+  std::string data = cardLines(40000, 1);
+  CHECK(FileManager::writeFile(decks + "/big.deck", data, false));
+
+  Backup::Result first;
+  std::string error;
+  CHECK(Backup::create(decks, repo, first, error));
+  CHECK(first.files == 1 && first.filesRead == 1);
+  CHECK(first.chunks > 50);
+  CHECK(first.newChunks == first.chunks);
+
+  // unchanged: nothing is read again
+  Backup::Result same;
+  CHECK(Backup::create(decks, repo, same, error));
+  CHECK(same.filesRead == 0 && same.newChunks == 0);
+
+  // insert a line in the middle: every chunk but the one or two around
+  // the edit is already stored
+  size_t middle = data.find('\n', data.size() / 2) + 1;
+  std::string edited = data;
+  edited.insert(middle, "inserted|line|0|2.5|0|0||0|0|\n");
+  CHECK(FileManager::writeFile(decks + "/big.deck", edited, false));
+  Backup::Result second;
+  CHECK(Backup::create(decks, repo, second, error));
+  CHECK(second.filesRead == 1);
+  CHECK(second.newChunks >= 1 && second.newChunks <= 3);
+  CHECK(second.bytesStored < second.bytes / 10);
+
+  // both snapshots restore byte for byte
+  std::vector<std::string> snapshots = Backup::list(repo);
+  CHECK(snapshots.size() == 3);
+  if (snapshots.size() != 3)
+    return;
+  std::string restored;
+  CHECK(Backup::restore(repo, snapshots[0], dir + "/r0", error));
+  CHECK(FileManager::readFile(dir + "/r0/big.deck", restored));
+  CHECK(restored == data);
+  CHECK(Backup::restore(repo, snapshots[2], dir + "/r2", error));
+  CHECK(FileManager::readFile(dir + "/r2/big.deck", restored));
+  CHECK(restored == edited);
+}
+
+int main() {
+  TempDir dir("backup");
+  testChunkBoundaries(dir.path());
+  return checkResult();
+}
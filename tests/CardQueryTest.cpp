@@ -0,0 +1,119 @@
+#include "CardQuery.hpp"
+#include "Check.hpp"
+#include <ctime>
+#include <random>
+
+static Card makeCard(const std::string &front, const std::string &back,
+                     const std::string &tags) {
+  Card c(front, back);
+  c.setTags(tags);
+  return c;
+}
+
+static bool parses(const std::string &text) {
+  CardQuery q;
+  std::string error;
+  return CardQuery::parse(text, q, error);
+}
+
+static bool matches(const std::string &text, const Card &c) {
+  CardQuery q;
+  std::string error;
+  if (!CardQuery::parse(text, q, error))
+    return false;
+  return q.matches(c);
+}
+
+static void testParsing() {
+  CHECK(parses(""));
+  CHECK(parses("tag:verbs due<3d ease<2.0 -suspended front:~ing"));
+  CHECK(parses("due>=-1w ivl>=21 rating<3 time>5"));
+  CHECK(parses("\"two words\" back:\"a b\""));
+
+  CardQuery q;
+  std::string error;
+  CHECK(!CardQuery::parse("ease<abc", q, error));
+  CHECK(!error.empty());
+  CHECK(!parses("due<3x"));
+  CHECK(!parses("ivl=<3"));
+  CHECK(!parses("\"unterminated"));
+
+  CHECK(CardQuery::parse("", q, error));
+  CHECK(q.empty());
+  CHECK(q.matches(Card("anything", "at all")));
+}
+
+static void testTerms() {
+  time_t now = std::time(nullptr);
+  Card c = makeCard("Running", "laufend", "verbs, german");
+  c.setEaseFactor(1.8);
+  c.setInterval(30);
+  c.setLastRating(2);
+  c.setDueDate(now + 86400);
+
+  CHECK(matches("tag:verbs", c));
+  CHECK(!matches("tag:nouns", c));
+  CHECK(matches("-tag:nouns", c));
+  CHECK(matches("front:running", c));
+  CHECK(!matches("front:run", c));
+  CHECK(matches("front:~UNN", c));
+  CHECK(matches("back:LAUFEND", c));
+  CHECK(matches("lauf", c));
+  CHECK(matches("ease<2.0 ivl>=21 rating=2", c));
+  CHECK(!matches("ease>=2.0", c));
+  CHECK(matches("due<3d", c));
+  CHECK(!matches("due", c));
+  CHECK(!matches("suspended", c));
+  c.setSuspended(true);
+  CHECK(matches("suspended", c));
+  CHECK(!matches("tag:verbs -suspended", c));
+}
+
+// Whatever order the planner picks, select() keeps exactly the cards
+// matches() accepts, in deck order
+static void testPlanning() {
+  Deck deck("query");
+  std::mt19937 rng(7);
+  time_t now = std::time(nullptr);
+  const char *tags[] = {"a", "b", "a, b", "", "rare"};
+  for (int i = 0; i < 5000; i++) {
+    Card c = makeCard("front " + std::to_string(i),
+                      i % 3 ? "back" : "other back",
+                      tags[rng() % (i % 997 ? 4 : 5)]);
+    c.setEaseFactor(1.3 + (rng() % 200) / 100.0);
+    c.setInterval(rng() % 60);
+    c.setDueDate(now + (long)(rng() % 20) * 86400 - 5 * 86400);
+    c.setSuspended(rng() % 10 == 0);
+    deck.addCard(c);
+  }
+  const char *queries[] = {
+      "tag:a",
+      "tag:rare ease<2.0",
+      "ease<2.0 tag:b -suspended ivl>10",
+      "due -tag:a other",
+      "front:~9 due<3d",
+      "front:\"front 42\"",
+      "tag:missing",
+      "-suspended -tag:b ease>=1.5 ivl<=30 due>=-2d",
+  };
+  for (const char *text : queries) {
+    CardQuery q;
+    std::string error;
+    CHECK(CardQuery::parse(text, q, error));
+    std::vector<int> expected;
+    for (size_t i = 0; i < deck.size(); i++) {
+      if (q.matches(deck.at(i)))
+        expected.push_back(deck.at(i).id());
+    }
+    if (q.select(deck) != expected)
+      std::fprintf(stderr, "select differs for \"%s\"\n", text);
+    CHECK(q.select(deck) == expected);
+  }
+}
+
+int main() {
+  testParsing();
+  testTerms();
+  testPlanning();
+  return checkResult();
+}
@@ -0,0 +1,54 @@
+#ifndef TANKI_CHECK_HPP
+#define TANKI_CHECK_HPP
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <unistd.h>
+
+/**
+ * Minimal test support: CHECK(cond) reports a failed condition and
+ * counts it; main returns checkResult() so ctest sees the failure.
+ */
+inline int &checkFailures() {
+  static int failures = 0;
+  return failures;
+}
+
+#define CHECK(cond)                                                        \
+  do {                                                                     \
+    if (!(cond)) {                                                         \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__,          \
+                   __LINE__, #cond);                                       \
+      checkFailures()++;                                                   \
+    }                                                                      \
+  } while (0)
+
+inline int checkResult() {
+  if (checkFailures())
+    std::fprintf(stderr, "%d check(s) failed\n", checkFailures());
+  return checkFailures() ? 1 : 0;
+}
+
+// A fresh, empty directory under the system temp directory, removed
+// when the test ends
+class TempDir {
+public:
+  explicit TempDir(const std::string &name) {
+    _path = (std::filesystem::temp_directory_path() /
+             ("tanki-" + name + "-" + std::to_string(getpid())))
+                .string();
+    std::filesystem::remove_all(_path);
+    std::filesystem::create_directories(_path);
+  }
+  ~TempDir() {
+    std::error_code ec;
+    std::filesystem::remove_all(_path, ec);
+  }
+  const std::string &path() const { return _path; }
+
+private:
+  std::string _path;
+};
+
+#endif // TANKI_CHECK_HPP
@@ -0,0 +1,129 @@
+#include "Check.hpp"
+#include "DeckSync.hpp"
+#include "FileManager.hpp"
+#include <filesystem>
+
+static const time_t Base = 1700000000;
+
+struct Sides {
+  std::string a, b;
+};
+
+static const Card *byFront(const Deck &d, const std::string &front) {
+  for (size_t i = 0; i < d.size(); i++) {
+    if (d.at(i).front() == front)
+      return &d.at(i);
+  }
+  return nullptr;
+}
+
+static std::shared_ptr<Deck> load(const std::string &dir) {
+  return FileManager::loadDeck(dir + "/d.deck");
+}
+
+static void edit(const std::string &dir, const std::string &front,
+                 const std::string &back, time_t when) {
+  auto deck = load(dir);
+  Card c = *byFront(*deck, front);
+  c.setBack(back);
+  c.setModified(when);
+  deck->updateCard(c);
+  FileManager::saveDeck(deck, dir);
+}
+
+static void erase(const std::string &dir, const std::string &front,
+                   time_t when) {
+  auto deck = load(dir);
+  deck->removeCard(byFront(*deck, front)->id());
+  // removeCard stamps the tombstone with the current time
+  Deck::Tombstones tombstones = deck->tombstones();
+  tombstones[front] = when;
+  deck->setTombstones(tombstones);
+  FileManager::saveDeck(deck, dir);
+}
+
+// Both sides hold the same deck of n cards
+static Sides start(const TempDir &dir, Deck::Format format, size_t n) {
+  Sides s{dir.path() + "/a", dir.path() + "/b"};
+  std::filesystem::remove_all(s.a);
+  std::filesystem::remove_all(s.b);
+  std::filesystem::create_directories(s.a);
+  std::filesystem::create_directories(s.b);
+  auto deck = std::make_shared<Deck>("d");
+  deck->setFormat(format);
+  for (size_t i = 0; i < n; i++) {
+    Card c("c" + std::to_string(i), "back");
+    c.setModified(Base);
+    deck->addCard(c);
+  }
+  FileManager::saveDeck(deck, s.a);
+  DeckSync::Result r;
+  std::string error;
+  CHECK(DeckSync::syncDirectories(s.a, s.b, r, error));
+  CHECK(r.decksCopied == 1);
+  return s;
+}
+
+static DeckSync::Result sync(const std::string &a, const std::string &b) {
+  DeckSync::Result r;
+  std::string error;
+  CHECK(DeckSync::syncDirectories(a, b, r, error));
+  CHECK(r.failed.empty());
+  return r;
+}
+
+static std::string backOf(const std::string &dir, const std::string &front) {
+  auto deck = load(dir);
+  const Card *c = deck ? byFront(*deck, front) : nullptr;
+  return c ? std::string(c->back()) : "<missing>";
+}
+
+static void testTies(const TempDir &dir, Deck::Format format, size_t n) {
+  // the newer edit wins whichever side it is on
+  Sides s = start(dir, format, n);
+  edit(s.a, "c1", "from a", Base + 20);
+  edit(s.b, "c1", "from b", Base + 10);
+  edit(s.a, "c2", "from a", Base + 10);
+  edit(s.b, "c2", "from b", Base + 20);
+  DeckSync::Result r = sync(s.a, s.b);
+  CHECK(r.ties == 0);
+  CHECK(backOf(s.a, "c1") == "from a" && backOf(s.b, "c1") == "from a");
+  CHECK(backOf(s.a, "c2") == "from b" && backOf(s.b, "c2") == "from b");
+
+  // equal stamps: the same version wins in either direction
+  for (bool swap : {false, true}) {
+    s = start(dir, format, n);
+    edit(s.a, "c3", "version x", Base + 30);
+    edit(s.b, "c3", "version y", Base + 30);
+    r = swap ? sync(s.b, s.a) : sync(s.a, s.b);
+    CHECK(r.ties == 1);
+    CHECK(backOf(s.a, "c3") == "version y");
+    CHECK(backOf(s.b, "c3") == "version y");
+  }
+
+  // a deletion is weighed by stamp; on a tie it stands
+  s = start(dir, format, n);
+  erase(s.a, "c4", Base + 40);
+  edit(s.b, "c4", "edited later", Base + 50);
+  erase(s.b, "c5", Base + 40);
+  edit(s.a, "c5", "edited at once", Base + 40);
+  erase(s.a, "c6", Base + 40);
+  sync(s.a, s.b);
+  for (auto &side : {s.a, s.b}) {
+    CHECK(backOf(side, "c4") == "edited later");
+    CHECK(backOf(side, "c5") == "<missing>");
+    CHECK(backOf(side, "c6") == "<missing>");
+    CHECK(load(side)->size() == n - 2);
+  }
+
+  // once in step, a sync changes nothing
+  r = sync(s.a, s.b);
+  CHECK(r.toA == 0 && r.toB == 0 && r.cardsWritten == 0);
+}
+
+int main() {
+  TempDir dir("sync");
+  testTies(dir, Deck::Plain, 20);
+  testTies(dir, Deck::Segmented, 3000);
+  return checkResult();
+}
@@ -0,0 +1,77 @@
+#include "Check.hpp"
+#include "DueMerger.hpp"
+#include <ctime>
+#include <memory>
+#include <vector>
+
+static const time_t Now = 1700000000;
+
+static std::shared_ptr<Deck> makeDeck(const std::string &name,
+                                      const std::vector<int> &dueInDays) {
+  auto deck = std::make_shared<Deck>(name);
+  for (size_t i = 0; i < dueInDays.size(); i++) {
+    Card c(name + std::to_string(i), "back");
+    c.setDueDate(Now + dueInDays[i] * 86400);
+    deck->addCard(c);
+  }
+  return deck;
+}
+
+static std::vector<time_t> drain(DueMerger &merger, time_t now) {
+  std::vector<time_t> dues;
+  std::shared_ptr<Deck> deck;
+  int id;
+  while (merger.next(now, deck, id))
+    dues.push_back(deck->findCard(id)->dueDate());
+  return dues;
+}
+
+static void testOrder() {
+  auto a = makeDeck("a", {-5, -1, 2, -3});
+  auto b = makeDeck("b", {-4, -2, 0, 9});
+  DueMerger merger({a, b});
+  std::vector<time_t> dues = drain(merger, Now);
+  std::vector<time_t> expected;
+  for (int d : {-5, -4, -3, -2, -1, 0})
+    expected.push_back(Now + d * 86400);
+  CHECK(dues == expected);
+
+  // a later `now` picks up where the merge stopped
+  CHECK(drain(merger, Now + 3 * 86400).size() == 1);
+
+  DueMerger limited({a, b}, 2);
+  CHECK(drain(limited, Now).size() == 4);
+}
+
+// Cards changed after the merge looked at them are not returned from
+// their old place in the queue
+static void testStaleEntries() {
+  auto a = makeDeck("a", {-3, -2, -1});
+  auto b = makeDeck("b", {-4});
+  DueMerger merger({a, b});
+
+  std::shared_ptr<Deck> deck;
+  int id;
+  CHECK(merger.next(Now, deck, id));
+  CHECK(deck == b);
+
+  // the head of deck a (-3) is rescheduled past the others, the next
+  // card (-2) is suspended and the last (-1) deleted
+  Card first = a->at(0);
+  first.setDueDate(Now - 86400 / 2);
+  a->updateCard(first);
+  Card second = a->at(1);
+  second.setSuspended(true);
+  a->updateCard(second);
+  a->removeCard(a->at(2).id());
+
+  CHECK(merger.next(Now, deck, id));
+  CHECK(deck == a && id == first.id());
+  CHECK(!merger.next(Now, deck, id));
+}
+
+int main() {
+  testOrder();
+  testStaleEntries();
+  return checkResult();
+}
@@ -0,0 +1,87 @@
+#include "Check.hpp"
+#include "SegmentedDeck.hpp"
+#include <filesystem>
+#include <set>
+
+static void testIndexRoundTrip(const std::string &dir) {
+  std::string path = dir + "/index.deck";
+  std::vector<Deck::Segment> segments(3);
+  for (uint32_t i = 0; i < segments.size(); i++) {
+    segments[i].file = 10 + i;
+    segments[i].count = 1000 + i;
+    segments[i].hash = 0x0123456789abcdefull * (i + 1);
+  }
+  segments[2].hash = 0; // an older index without hashes
+  Deck::Tombstones tombstones = {{"gone", 1700000000}, {"also gone", 5}};
+  CHECK(SegmentedDeck::writeIndex(path, "my deck", segments, tombstones));
+  CHECK(SegmentedDeck::isSegmented(path));
+
+  std::string name;
+  std::vector<Deck::Segment> read;
+  Deck::Tombstones readTombstones;
+  CHECK(SegmentedDeck::readIndex(path, name, read, readTombstones));
+  CHECK(name == "my deck");
+  CHECK(read.size() == segments.size());
+  for (size_t i = 0; i < read.size() && i < segments.size(); i++) {
+    CHECK(read[i].file == segments[i].file);
+    CHECK(read[i].count == segments[i].count);
+    CHECK(read[i].hash == segments[i].hash);
+    CHECK(!read[i].dirty);
+  }
+  CHECK(readTombstones == tombstones);
+}
+
+static std::set<std::string> segmentFiles(const std::string &path) {
+  std::set<std::string> files;
+  for (auto &e : std::filesystem::directory_iterator(
+           SegmentedDeck::segmentDirectory(path)))
+    files.insert(e.path().filename().string());
+  return files;
+}
+
+// Saving rewrites only the segments holding changed cards, and a deck
+// read back has the same cards in the same order
+static void testDeckRoundTrip(const std::string &dir) {
+  std::string path = dir + "/big.deck";
+  Deck deck("big");
+  deck.setFormat(Deck::Segmented);
+  const size_t cards = 3 * Deck::Segment::Capacity + 100;
+  for (size_t i = 0; i < cards; i++)
+    deck.addCard(Card("front " + std::to_string(i), "back"));
+  CHECK(SegmentedDeck::write(deck, path));
+  CHECK(deck.segments().size() == 4);
+  std::set<std::string> before = segmentFiles(path);
+  CHECK(before.size() == 4);
+
+  Card c = deck.at(Deck::Segment::Capacity + 5);
+  c.setInterval(12);
+  deck.updateCard(c);
+  CHECK(SegmentedDeck::write(deck, path));
+  std::set<std::string> after = segmentFiles(path);
+  CHECK(after.size() == 4);
+  size_t kept = 0;
+  for (auto &f : after)
+    kept += before.count(f);
+  CHECK(kept == 3);
+
+  auto back = SegmentedDeck::read(path);
+  CHECK(back && back->size() == cards);
+  if (!back)
+    return;
+  CHECK(back->name() == "big");
+  CHECK(back->format() == Deck::Segmented);
+  for (size_t i = 0; i < cards && i < back->size(); i++) {
+    if (back->at(i).front() != deck.at(i).front()) {
+      CHECK(back->at(i).front() == deck.at(i).front());
+      break;
+    }
+  }
+  CHECK(back->at(Deck::Segment::Capacity + 5).interval() == 12);
+}
+
+int main() {
+  TempDir dir("segments");
+  testIndexRoundTrip(dir.path());
+  testDeckRoundTrip(dir.path());
+  return checkResult();
+}
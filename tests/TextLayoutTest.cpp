@@ -0,0 +1,93 @@
+#include "Check.hpp"
+#include "TextLayout.hpp"
+#include "Utf8.hpp"
+#include <string>
+#include <vector>
+
+static std::vector<std::string> wrap(const std::string &text, int width) {
+  std::vector<std::string> out;
+  for (auto &l : TextLayout::wrap(text, width))
+    out.push_back(text.substr(l.start, l.length));
+  return out;
+}
+
+static void testWidths() {
+  CHECK(Utf8::width("abc") == 3);
+  CHECK(Utf8::width("日本語") == 6);
+  CHECK(Utf8::width("é") == 1);  // e + combining acute
+  CHECK(Utf8::width("ｱ") == 1);  // halfwidth katakana
+  CHECK(Utf8::width("Ｈ") == 2);  // fullwidth latin
+  CHECK(Utf8::isAscii("plain text"));
+  CHECK(!Utf8::isAscii("café"));
+
+  size_t i = 0;
+  CHECK(Utf8::decode("\xff" "a", i) == 0xFFFD);
+  CHECK(i == 1);
+
+  int used = 0;
+  // a cluster is never split from its accent
+  CHECK(Utf8::fitPrefix("aéb", 2, used) == 4);
+  CHECK(used == 2);
+  // a wide character that does not fit stays out
+  CHECK(Utf8::fitPrefix("a日", 2, used) == 1);
+  CHECK(used == 1);
+
+  CHECK(Utf8::truncate("short", 10) == "short");
+  std::string cut = Utf8::truncate("日本語のテキスト", 9);
+  CHECK(cut.size() > 3 && cut.compare(cut.size() - 3, 3, "...") == 0);
+  CHECK(Utf8::width(cut) <= 9);
+}
+
+static void testWrapping() {
+  CHECK((wrap("hello world", 5) == std::vector<std::string>{"hello", "world"}));
+  CHECK((wrap("hello world", 11) == std::vector<std::string>{"hello world"}));
+  CHECK((wrap("one\ntwo", 20) == std::vector<std::string>{"one", "two"}));
+  // a word longer than the width is split
+  CHECK((wrap("abcdefgh", 3) == std::vector<std::string>{"abc", "def", "gh"}));
+  // wide characters break between themselves, two columns each
+  CHECK((wrap("日本語です", 4) ==
+         std::vector<std::string>{"日本", "語で", "す"}));
+  CHECK(wrap("", 10).size() <= 1);
+
+  // every line fits, and the lines cover the text in order
+  std::vector<std::string> texts = {
+      "the quick brown fox jumps over the lazy dog",
+      "thé quick brôwn fox jumps över the lazy dög",
+      "mixed 日本語 text with ｗｉｄｅ letters and cafés",
+  };
+  for (auto &text : texts) {
+    for (int width = 1; width <= 20; width++) {
+      size_t bytes = 0;
+      for (auto &l : TextLayout::wrap(text, width)) {
+        std::string line = text.substr(l.start, l.length);
+        // a lone character wider than the width still gets a line
+        CHECK(Utf8::width(line) <= std::max(width, 2));
+        CHECK(l.start >= bytes);
+        bytes = l.start + l.length;
+      }
+      CHECK(bytes == text.size());
+    }
+  }
+  CHECK(wrap("the quick brown fox", 9).size() ==
+        wrap("th\xc3\xa9 quick brown fox", 9).size());
+}
+
+static void testCache() {
+  LayoutCache cache;
+  std::string text = "some card text to wrap";
+  auto first = cache.lines(1, 0, text, 8);
+  CHECK(first.size() == TextLayout::wrap(text, 8).size());
+  // an edit in place is noticed even though the buffer is the same
+  text.replace(0, 4, "long");
+  auto &again = cache.lines(1, 0, text, 8);
+  CHECK(again.size() == TextLayout::wrap(text, 8).size());
+  CHECK(cache.preview(1, 0, "a rather long preview", 10) ==
+        Utf8::truncate("a rather long preview", 10));
+}
+
+int main() {
+  testWidths();
+  testWrapping();
+  testCache();
+  return checkResult();
+}
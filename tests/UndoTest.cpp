@@ -0,0 +1,92 @@
+#include "CardStore.hpp"
+#include "Check.hpp"
+#include "UndoHistory.hpp"
+#include <memory>
+
+static void testStoreIsolation() {
+  CardStore store;
+  for (int i = 0; i < 300; i++)
+    store.push_back(Card("front " + std::to_string(i), "back"));
+  CardStore copy = store;
+  copy.edit(70).setInterval(9);
+  copy.erase(0);
+  copy.push_back(Card("new", "card"));
+  CHECK(store.size() == 300);
+  CHECK(store[70].interval() == 0);
+  CHECK(store[0].front() == "front 0");
+  CHECK(copy.size() == 300);
+  CHECK(copy[69].interval() == 9);
+  CHECK(copy[299].front() == "new");
+
+  size_t changed =
+      copy.editIf([](const Card &c) { return c.front() == "front 5"; },
+                  [](Card &c) { c.setInterval(3); });
+  CHECK(changed == 1);
+  CHECK(store[5].interval() == 0);
+}
+
+static void testSnapshots() {
+  Deck deck("undo");
+  for (int i = 0; i < 200; i++)
+    deck.addCard(Card("front " + std::to_string(i), "back"));
+  Deck::Snapshot before = deck.snapshot();
+
+  Card c = deck.at(10);
+  c.setInterval(7);
+  deck.updateCard(c);
+  deck.removeCard(deck.at(0).id());
+  deck.addCard(Card("added", "later"));
+  CHECK(before.cards.size() == 200);
+  CHECK(before.cards[10].interval() == 0);
+
+  deck.restore(before);
+  CHECK(deck.size() == 200);
+  CHECK(deck.at(0).front() == "front 0");
+  CHECK(deck.at(10).interval() == 0);
+  CHECK(deck.findCard(c.id()) && deck.findCard(c.id())->interval() == 0);
+}
+
+static void testHistory() {
+  auto deck = std::make_shared<Deck>("history");
+  for (int i = 0; i < 100; i++)
+    deck->addCard(Card("front " + std::to_string(i), "back"));
+  UndoHistory history(2);
+  std::string label;
+  CHECK(!history.undo(deck, label));
+
+  int first = deck->at(0).id();
+  history.record(deck, "delete card");
+  deck->removeCard(first);
+  Card c = deck->at(0);
+  c.setSuspended(true);
+  history.record(deck, "suspend card");
+  deck->updateCard(c);
+  CHECK(history.undoSteps() == 2);
+
+  CHECK(history.undo(deck, label));
+  CHECK(label == "suspend card");
+  CHECK(!deck->findCard(c.id())->isSuspended());
+  CHECK(history.undo(deck, label));
+  CHECK(label == "delete card");
+  CHECK(deck->size() == 100 && deck->findCard(first));
+  CHECK(!history.undo(deck, label));
+
+  CHECK(history.redo(deck, label));
+  CHECK(label == "delete card");
+  CHECK(deck->size() == 99 && !deck->findCard(first));
+  CHECK(history.redoSteps() == 1);
+
+  // a new change drops what could be redone; the oldest step goes
+  // once maxSteps is reached
+  history.record(deck, "edit");
+  CHECK(history.redoSteps() == 0);
+  history.record(deck, "edit again");
+  CHECK(history.undoSteps() == 2);
+}
+
+int main() {
+  testStoreIsolation();
+  testSnapshots();
+  testHistory();
+  return checkResult();
+}